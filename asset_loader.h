@@ -0,0 +1,762 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <learnopengl/mesh.h>
+
+#include "model_asset.h"
+#include "lod.h"
+#include "meshlets.h"
+#include "occlusion_culling.h"
+#include "texture_baker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// --------- Tunables ---------
+#define ASSET_UPLOAD_BUDGET_BYTES (4u * 1024u * 1024u) // per frame, at least one step always runs
+#define ASSET_MAX_WORKERS 4
+#define ASSET_PBO_COUNT 2
+#define ASSET_COMPACT_VERTICES true // default for AsyncAssetLoader::compactVertices
+
+inline double assetClockMs()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// --------- CPU side (worker threads) ---------
+// Nothing in here touches GL; everything a worker produces is handed to the GL thread
+// ready to copy straight into a buffer.
+struct CpuTexture {
+    std::string type;      // texture_diffuse, texture_specular, ...
+    std::string path;      // as referenced by the material
+    std::string fullPath;
+    BakedFormat format = BAKED_RGBA8;
+    std::vector<BakedLevel> levels;
+    uint64_t contentHash = 0;
+    bool ok = false;
+};
+
+struct CpuModel {
+    std::vector<LodMeshData> meshes;
+    std::vector<std::vector<unsigned int>> meshTextures; // per mesh, indices into `textures`
+    std::vector<float> meshOpacity;                      // per mesh, see ModelAsset::meshOpacity
+    std::vector<CpuTexture> textures;                    // paths only, decoded as separate assets
+    std::vector<std::vector<LodMeshData>> lods;
+    std::vector<std::vector<Meshlet>> meshlets;           // per mesh, indices already reordered
+    std::vector<CompactMeshData> compact;                 // parallel to `meshes` when quantized
+    std::vector<std::vector<CompactMeshData>> compactLods;
+    OccluderMesh occluder;
+    bool ok = false;
+};
+
+inline uint64_t fnv1a64(const std::vector<uint8_t>& bytes)
+{
+    uint64_t h = 1469598103934665603ull;
+    for (uint8_t b : bytes) {
+        h ^= b;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Reads the baked .dds if there is one, otherwise the source image, and hashes the bytes.
+inline bool readTextureFile(const std::string& fullPath, std::vector<uint8_t>& bytes, bool& baked, uint64_t& hash)
+{
+    baked = readFileBytes(fullPath + BAKED_TEXTURE_EXT, bytes);
+    if (!baked && !readFileBytes(fullPath, bytes)) {
+        std::cout << "Texture failed to load at path: " << fullPath << std::endl;
+        return false;
+    }
+    hash = fnv1a64(bytes);
+    return true;
+}
+
+// Baked levels as-is (or decoded to RGBA8 without S3TC), otherwise stb_image + a CPU-built
+// mip chain. stb's global flip flag is left alone (other threads may be decoding), the
+// flip is done here.
+inline bool decodeTexture(std::vector<uint8_t>& bytes, bool baked, bool flipY, bool s3tc, CpuTexture& out)
+{
+    if (baked) {
+        BakedImage image;
+        image.file.swap(bytes);
+        if (!parseBakedImage(image)) {
+            std::cout << "Texture failed to parse: " << out.fullPath << BAKED_TEXTURE_EXT << std::endl;
+            return false;
+        }
+        bool decode = image.format != BAKED_RGBA8 && !s3tc;
+        int w = image.width, h = image.height;
+        for (const uint8_t* data : image.levels) {
+            BakedLevel level;
+            level.width = w;
+            level.height = h;
+            if (decode) level.data = decodeBlocks(data, w, h, image.format);
+            else        level.data.assign(data, data + bakedLevelSize(image.format, w, h));
+            out.levels.push_back(std::move(level));
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+        out.format = decode ? BAKED_RGBA8 : image.format;
+        out.ok = true;
+        return true;
+    }
+
+    int width, height, nrChannels;
+    unsigned char* pixels = stbi_load_from_memory(bytes.data(), (int)bytes.size(), &width, &height, &nrChannels, 4);
+    if (!pixels) {
+        std::cout << "Texture failed to load at path: " << out.fullPath << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> base(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+    if (flipY) flipRowsRGBA8(base, width, height);
+    out.format = BAKED_RGBA8;
+    out.levels = buildMipChain(std::move(base), width, height, BAKED_RGBA8);
+    out.ok = true;
+    return true;
+}
+
+// Same material handling as learnopengl's Model::loadMaterialTextures.
+inline void collectMaterialTextures(aiMaterial* mat, aiTextureType type, const std::string& typeName,
+                                    const std::string& directory, CpuModel& model, std::vector<unsigned int>& meshTextures)
+{
+    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
+        aiString str;
+        mat->GetTexture(type, i, &str);
+        std::string path = str.C_Str();
+        size_t found = model.textures.size();
+        for (size_t j = 0; j < model.textures.size(); ++j)
+            if (model.textures[j].path == path) { found = j; break; }
+        if (found == model.textures.size()) {
+            CpuTexture tex;
+            tex.type = typeName;
+            tex.path = path;
+            tex.fullPath = directory + '/' + path;
+            model.textures.push_back(tex);
+        }
+        meshTextures.push_back((unsigned int)found);
+    }
+}
+
+// Same vertex layout as learnopengl's Model::processMesh.
+inline void processAssimpNode(aiNode* node, const aiScene* scene, const std::string& directory, CpuModel& model)
+{
+    for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        LodMeshData data;
+        data.sourceMesh = model.meshes.size();
+        data.vertices.resize(mesh->mNumVertices);
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++) {
+            Vertex vertex = {};
+            vertex.Position = glm::vec3(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z);
+            if (mesh->HasNormals())
+                vertex.Normal = glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z);
+            if (mesh->mTextureCoords[0]) {
+                vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y);
+                vertex.Tangent = glm::vec3(mesh->mTangents[v].x, mesh->mTangents[v].y, mesh->mTangents[v].z);
+                vertex.Bitangent = glm::vec3(mesh->mBitangents[v].x, mesh->mBitangents[v].y, mesh->mBitangents[v].z);
+            }
+            data.vertices[v] = vertex;
+        }
+        for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+            const aiFace& face = mesh->mFaces[f];
+            for (unsigned int j = 0; j < face.mNumIndices; j++)
+                data.indices.push_back(face.mIndices[j]);
+        }
+
+        std::vector<unsigned int> textures;
+        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", directory, model, textures);
+        collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", directory, model, textures);
+        collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", directory, model, textures);
+        collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", directory, model, textures);
+        // dissolve: `d` below 1 or an alpha map (map_d) make the mesh transparent
+        float opacity = 1.0f;
+        material->Get(AI_MATKEY_OPACITY, opacity);
+        bool transparent = opacity < 1.0f || material->GetTextureCount(aiTextureType_OPACITY) > 0;
+        model.meshOpacity.push_back(transparent ? opacity : -1.0f);
+
+        model.meshes.push_back(std::move(data));
+        model.meshTextures.push_back(textures);
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+        processAssimpNode(node->mChildren[i], scene, directory, model);
+}
+
+inline bool decodeModel(const std::string& path, CpuModel& out, bool compact)
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+    std::string directory = path.substr(0, path.find_last_of('/'));
+    processAssimpNode(scene->mRootNode, scene, directory, out);
+    out.lods = simplifyLodLevels(out.meshes);
+    for (auto& mesh : out.meshes) out.meshlets.push_back(buildMeshlets(mesh.vertices, mesh.indices));
+    out.occluder = buildOccluderMesh(out.lods.empty() ? out.meshes : out.lods.back());
+    if (compact) {
+        for (const auto& mesh : out.meshes) out.compact.push_back(quantizeVertices(mesh.vertices));
+        for (const auto& level : out.lods) {
+            out.compactLods.emplace_back();
+            for (const auto& mesh : level) out.compactLods.back().push_back(quantizeVertices(mesh.vertices));
+        }
+    }
+    out.ok = true;
+    return true;
+}
+
+// Vertex memory of the quantized meshes against the float layout, per LOD 0 mesh and
+// in total including the LODs (indices are the same either way and are left out).
+inline void logVertexSavings(const CpuModel& model, const std::string& name)
+{
+    size_t floatTotal = 0, compactTotal = 0;
+    auto account = [&](const LodMeshData& mesh, const CompactMeshData& compact, bool print, size_t index) {
+        size_t floatBytes = mesh.vertices.size() * sizeof(Vertex);
+        size_t compactBytes = compact.vertices.size() * sizeof(CompactVertex);
+        floatTotal += floatBytes;
+        compactTotal += compactBytes;
+        if (!print) return;
+        std::cout << "  mesh " << index << ": " << mesh.vertices.size() << " verts, "
+                  << floatBytes / 1024 << " KB -> " << compactBytes / 1024 << " KB"
+                  << " (saved " << (floatBytes - compactBytes) / 1024 << " KB, max error "
+                  << compact.maxPositionError * 1000.0f << " mm, uv " << compact.maxUvError << ")" << std::endl;
+    };
+    std::cout << "Compact vertices " << name << " (" << sizeof(Vertex) << " -> " << sizeof(CompactVertex) << " bytes):" << std::endl;
+    for (size_t i = 0; i < model.meshes.size() && i < model.compact.size(); ++i)
+        account(model.meshes[i], model.compact[i], true, i);
+    for (size_t l = 0; l < model.lods.size() && l < model.compactLods.size(); ++l)
+        for (size_t i = 0; i < model.lods[l].size() && i < model.compactLods[l].size(); ++i)
+            account(model.lods[l][i], model.compactLods[l][i], false, i);
+    std::cout << "  total with LODs: " << floatTotal / 1024 << " KB -> " << compactTotal / 1024
+              << " KB (saved " << (floatTotal - compactTotal) / 1024 << " KB)" << std::endl;
+}
+
+// --------- Async loader ---------
+// loadModel/loadTexture return immediately. Workers parse and decode, the GL thread
+// calls update() once per frame and uploads at most `budgetBytes` of it: textures one
+// mip level at a time through a pixel buffer object (smallest level first, so a
+// streaming texture sharpens instead of sampling garbage), meshes one at a time. A
+// model is swapped in whole once its meshes are on the GPU; its textures are separate
+// assets resolved through `resolveTexture` and stream on their own.
+//
+// Before decoding, a worker hashes the texture file; if another live texture already
+// has the same bytes the job becomes an alias of it and nothing is decoded or uploaded.
+struct AssetJob {
+    enum Kind { MODEL, TEXTURE } kind;
+    std::string path;
+    bool flipY = false;
+    bool rebake = false;     // TEXTURE: refresh the .dds from the source first
+    bool reload = false;     // TEXTURE: stream into a new name, swapped in by finish()
+    bool compact = false;    // MODEL: quantized vertices
+    ModelHandle model;       // MODEL
+    TextureHandle texture;   // TEXTURE
+    TextureHandle aliasOf;   // TEXTURE: same content as an already loaded texture
+
+    CpuModel cpu;
+    CpuTexture tex;
+
+    // GL thread progress
+    std::vector<TextureHandle> textures;
+    unsigned int target = 0; // TEXTURE: the GL name the levels go into
+    size_t nextLevel = 0, nextMesh = 0, nextLod = 0;
+    std::vector<Mesh> meshes;
+    std::vector<std::vector<Mesh>> lodMeshes;
+
+    double requestedMs = 0.0, decodedMs = 0.0;
+};
+
+class AsyncAssetLoader {
+public:
+    // GL thread stats
+    size_t uploadedBytes = 0;
+    size_t finishedJobs = 0;
+    double lastUpdateMs = 0.0;
+    double maxUpdateMs = 0.0;
+
+    // Quantize vertices on the workers (vertex_quantize.h). Only affects models
+    // requested after it is changed.
+    bool compactVertices = ASSET_COMPACT_VERTICES;
+
+    // Set by the owner (the asset registry): how a model's material textures are
+    // found, and what to patch when a texture's GL name changes (it turned out to be an
+    // alias, or a reload swapped its new name in).
+    std::function<TextureHandle(const std::string& path)> resolveTexture;
+    std::function<void(const TextureAsset& texture)> onTextureRenamed;
+
+    explicit AsyncAssetLoader(int workers = 0)
+    {
+        s3tc = hasCompressedFormat(GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) && hasCompressedFormat(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+        glGenBuffers(ASSET_PBO_COUNT, pbos);
+
+        // 1x1 grey stand-in for the placeholder boxes
+        placeholderTexture = createStreamingTexture();
+        placeholderBox = makeUnitBox(placeholderTexture);
+
+        if (workers <= 0)
+            workers = std::max(1, std::min(ASSET_MAX_WORKERS, (int)std::thread::hardware_concurrency() - 1));
+        for (int i = 0; i < workers; ++i)
+            threads.emplace_back(&AsyncAssetLoader::workerLoop, this);
+    }
+
+    ~AsyncAssetLoader() { stopWorkers(); }
+
+    // Frees the PBOs, the placeholder and whatever was still streaming in, after
+    // stopping the workers; must run while the context is current.
+    void release()
+    {
+        stopWorkers();
+        for (auto& job : uploading) {
+            if (job->kind == AssetJob::TEXTURE && job->target && job->target != job->texture->id)
+                glDeleteTextures(1, &job->target);
+            for (auto& mesh : job->meshes) releaseMesh(mesh);
+            for (auto& level : job->lodMeshes)
+                for (auto& mesh : level) releaseMesh(mesh);
+        }
+        uploading.clear();
+        decoded.clear();
+        queued.clear();
+        pending = 0;
+        if (placeholderBox) releaseMesh(*placeholderBox);
+        placeholderBox.reset();
+        if (placeholderTexture) glDeleteTextures(1, &placeholderTexture);
+        placeholderTexture = 0;
+        if (pbos[0]) glDeleteBuffers(ASSET_PBO_COUNT, pbos);
+        for (unsigned int& pbo : pbos) pbo = 0;
+    }
+
+    // Fills `model` (path, placeholder bounds already set) in the background.
+    void loadModel(const ModelHandle& model)
+    {
+        std::unique_ptr<AssetJob> job(new AssetJob());
+        job->kind = AssetJob::MODEL;
+        job->path = model->path;
+        job->compact = compactVertices;
+        job->model = model;
+        submit(std::move(job));
+    }
+
+    // Streams the file into `texture->id`, which stays the same GL name throughout.
+    // `rebake` re-runs the offline bake for this one file on the worker first.
+    void loadTexture(const TextureHandle& texture, bool flipY, bool rebake = false)
+    {
+        std::unique_ptr<AssetJob> job(new AssetJob());
+        job->kind = AssetJob::TEXTURE;
+        job->path = texture->path;
+        job->flipY = flipY;
+        job->rebake = rebake;
+        job->texture = texture;
+        submit(std::move(job));
+    }
+
+    // Hot reload: streams the file into a new GL name while `texture->id` stays bound
+    // with the old contents; finish() swaps the names once the whole chain is up.
+    void reloadTexture(const TextureHandle& texture, bool flipY, bool rebake)
+    {
+        std::unique_ptr<AssetJob> job(new AssetJob());
+        job->kind = AssetJob::TEXTURE;
+        job->path = texture->path;
+        job->flipY = flipY;
+        job->rebake = rebake;
+        job->reload = true;
+        job->texture = texture;
+        submit(std::move(job));
+    }
+
+    // 1x1 grey texture the real levels can later be streamed into.
+    unsigned int createStreamingTexture()
+    {
+        const uint8_t grey[4] = { 128, 128, 128, 255 };
+        unsigned int id;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        return id;
+    }
+
+    bool idle() const { return pending == 0; }
+
+    // GL thread, once per frame.
+    void update(size_t budgetBytes = ASSET_UPLOAD_BUDGET_BYTES)
+    {
+        double begin = assetClockMs();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!decoded.empty()) {
+                uploading.push_back(std::move(decoded.front()));
+                decoded.pop_front();
+            }
+        }
+
+        size_t spent = 0;
+        while (!uploading.empty() && (spent == 0 || spent < budgetBytes)) {
+            AssetJob& job = *uploading.front();
+            bool done = job.kind == AssetJob::TEXTURE ? uploadTextureStep(job, spent) : uploadModelStep(job, spent);
+            if (done) {
+                finish(job);
+                uploading.erase(uploading.begin());
+            }
+        }
+        uploadedBytes += spent;
+
+        lastUpdateMs = assetClockMs() - begin;
+        maxUpdateMs = std::max(maxUpdateMs, lastUpdateMs);
+    }
+
+    // Unit box scaled to the model's placeholder bounds.
+    void submitPlaceholder(const ModelAsset& model, const glm::mat4& transform, RenderQueue& queue, Shader& shader, float distance)
+    {
+        glm::mat4 box = glm::translate(transform, model.bounds.center);
+        box = glm::scale(box, model.bounds.max - model.bounds.min);
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.vao = placeholderBox->VAO;
+        packet.count = (GLsizei)placeholderBox->indices.size();
+        packet.textures = &placeholderBox->textures;
+        packet.matrix = queue.matrix(box);
+        queue.submit(packet, RENDER_PASS_OPAQUE, distance);
+    }
+
+    Mesh& placeholderMesh() { return *placeholderBox; }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::unique_ptr<AssetJob>> queued;     // waiting for a worker
+    std::deque<std::unique_ptr<AssetJob>> decoded;    // waiting for the GL thread
+    std::vector<std::unique_ptr<AssetJob>> uploading; // GL thread only
+    std::unordered_map<uint64_t, std::weak_ptr<TextureAsset>> contentOwners; // under `mutex`
+    bool quit = false;
+    int pending = 0;                                  // GL thread only
+    bool s3tc = false;
+
+    unsigned int pbos[ASSET_PBO_COUNT] = {};
+    int pboNext = 0;
+    unsigned int placeholderTexture = 0;
+    std::unique_ptr<Mesh> placeholderBox;
+
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cv.notify_all();
+        for (auto& t : threads) t.join();
+        threads.clear();
+    }
+
+    void submit(std::unique_ptr<AssetJob> job)
+    {
+        job->requestedMs = assetClockMs();
+        ++pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.push_back(std::move(job));
+        }
+        cv.notify_one();
+    }
+
+    void workerLoop()
+    {
+        while (true) {
+            std::unique_ptr<AssetJob> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return quit || !queued.empty(); });
+                if (quit) return;
+                job = std::move(queued.front());
+                queued.pop_front();
+            }
+            if (job->kind == AssetJob::MODEL) decodeModel(job->path, job->cpu, job->compact);
+            else decodeTextureJob(*job);
+            job->decodedMs = assetClockMs();
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(job));
+        }
+    }
+
+    void decodeTextureJob(AssetJob& job)
+    {
+        std::vector<uint8_t> bytes;
+        bool baked;
+        job.tex.fullPath = job.path;
+        if (!job.rebake && bakedTextureStale(job.path)) {
+            std::cout << "Texture " << job.path << ": source is newer than its bake, re-baking" << std::endl;
+            job.rebake = true;
+        }
+        if (job.rebake) {
+            BakedImage previous;
+            bool compress = !(readBakedImage(job.path + BAKED_TEXTURE_EXT, previous) && previous.format == BAKED_RGBA8);
+            bakeTexture(job.path, job.flipY, compress);
+        }
+        if (!readTextureFile(job.path, bytes, baked, job.tex.contentHash)) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // a reloaded texture no longer owns its old contents
+            for (auto it = contentOwners.begin(); it != contentOwners.end();) {
+                if (it->second.lock() == job.texture) it = contentOwners.erase(it);
+                else ++it;
+            }
+            auto it = contentOwners.find(job.tex.contentHash);
+            TextureHandle owner = it != contentOwners.end() ? it->second.lock() : TextureHandle();
+            if (owner && owner != job.texture) {
+                job.aliasOf = owner;
+                return;
+            }
+            contentOwners[job.tex.contentHash] = job.texture;
+        }
+        decodeTexture(bytes, baked, job.flipY, s3tc, job.tex);
+    }
+
+    // Uploads tex.levels[level] into `id` through the next PBO and widens the texture's
+    // level range to include it.
+    void uploadLevel(unsigned int id, const CpuTexture& tex, size_t level)
+    {
+        const BakedLevel& l = tex.levels[level];
+        unsigned int pbo = pbos[pboNext];
+        pboNext = (pboNext + 1) % ASSET_PBO_COUNT;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)l.data.size(), NULL, GL_STREAM_DRAW); // orphan
+        void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)l.data.size(),
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        const void* src = (void*)0; // offset into the PBO
+        if (dst) {
+            memcpy(dst, l.data.data(), l.data.size());
+            if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) dst = nullptr; // store lost, contents undefined
+        }
+        if (!dst) {
+            // the PBO holds nothing: upload straight from client memory instead
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            src = l.data.data();
+        }
+
+        glBindTexture(GL_TEXTURE_2D, id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (tex.format == BAKED_RGBA8) {
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGBA8, l.width, l.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, src);
+        } else {
+            GLenum glFormat = tex.format == BAKED_BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, glFormat, l.width, l.height, 0, (GLsizei)l.data.size(), src);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        // levels [level, last] are now complete
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)tex.levels.size() - 1);
+    }
+
+    // One mip level per call; returns true once the whole chain is up.
+    bool uploadTextureStep(AssetJob& job, size_t& spent)
+    {
+        if (job.aliasOf || !job.tex.ok) return true;
+        if (!job.target) job.target = job.reload ? createStreamingTexture() : job.texture->id;
+        size_t level = job.tex.levels.size() - 1 - job.nextLevel;
+        uploadLevel(job.target, job.tex, level);
+        spent += job.tex.levels[level].data.size();
+        return ++job.nextLevel == job.tex.levels.size();
+    }
+
+    // Resolve textures, then LOD 0 meshes one per call, then one coarser LOD per call.
+    bool uploadModelStep(AssetJob& job, size_t& spent)
+    {
+        CpuModel& cpu = job.cpu;
+        if (!cpu.ok) return true;
+
+        if (job.textures.size() < cpu.textures.size()) {
+            for (const auto& tex : cpu.textures)
+                job.textures.push_back(resolveTexture(tex.fullPath));
+        }
+
+        if (job.nextMesh < cpu.meshes.size()) {
+            const CompactMeshData* compact = cpu.compact.empty() ? nullptr : &cpu.compact[job.nextMesh];
+            job.meshes.push_back(uploadMesh(job, cpu.meshes[job.nextMesh], compact, spent));
+            ++job.nextMesh;
+            return false;
+        }
+
+        if (job.nextLod < cpu.lods.size()) {
+            std::vector<Mesh> level;
+            for (size_t i = 0; i < cpu.lods[job.nextLod].size(); ++i) {
+                const CompactMeshData* compact = cpu.compactLods.empty() ? nullptr : &cpu.compactLods[job.nextLod][i];
+                level.push_back(uploadMesh(job, cpu.lods[job.nextLod][i], compact, spent));
+            }
+            job.lodMeshes.push_back(level);
+            ++job.nextLod;
+            return false;
+        }
+        return true;
+    }
+
+    Mesh uploadMesh(const AssetJob& job, const LodMeshData& data, const CompactMeshData* compact, size_t& spent)
+    {
+        size_t indexBytes = data.indices.size() * sizeof(unsigned int);
+        if (compact) {
+            spent += compact->vertices.size() * sizeof(CompactVertex) + indexBytes;
+            return makeCompactMesh(data.vertices, data.indices, meshTextures(job, data.sourceMesh), compact->vertices);
+        }
+        spent += data.vertices.size() * sizeof(Vertex) + indexBytes;
+        return Mesh(data.vertices, data.indices, meshTextures(job, data.sourceMesh));
+    }
+
+    std::vector<Texture> meshTextures(const AssetJob& job, size_t mesh) const
+    {
+        std::vector<Texture> textures;
+        for (unsigned int t : job.cpu.meshTextures[mesh]) {
+            const CpuTexture& tex = job.cpu.textures[t];
+            textures.push_back({ job.textures[t]->id, tex.type, tex.path });
+        }
+        return textures;
+    }
+
+    void finish(AssetJob& job)
+    {
+        --pending;
+        ++finishedJobs;
+        double now = assetClockMs();
+        if (job.kind == AssetJob::MODEL && job.cpu.ok) {
+            // texture ids may have changed since the meshes were built (aliases)
+            for (size_t i = 0; i < job.meshes.size(); ++i)
+                job.meshes[i].textures = meshTextures(job, job.cpu.meshes[i].sourceMesh);
+            for (size_t l = 0; l < job.lodMeshes.size(); ++l)
+                for (size_t i = 0; i < job.lodMeshes[l].size(); ++i)
+                    job.lodMeshes[l][i].textures = meshTextures(job, job.cpu.lods[l][i].sourceMesh);
+
+            ModelAsset& model = *job.model;
+            model.releaseMeshes();
+            model.textures_loaded.clear();
+            for (size_t t = 0; t < job.cpu.textures.size(); ++t)
+                model.textures_loaded.push_back({ job.textures[t]->id, job.cpu.textures[t].type, job.cpu.textures[t].path });
+            model.textureRefs = job.textures;
+            model.meshes = std::move(job.meshes);
+            model.lodLevels = std::move(job.lodMeshes);
+            for (const auto& compact : job.cpu.compact) model.meshDecode.push_back(compact.decode);
+            for (const auto& level : job.cpu.compactLods) {
+                model.lodDecode.emplace_back();
+                for (const auto& compact : level) model.lodDecode.back().push_back(compact.decode);
+            }
+            model.lodTriangles[0] = 0;
+            for (const auto& mesh : model.meshes) model.lodTriangles[0] += mesh.indices.size() / 3;
+            for (size_t l = 0; l < model.lodLevels.size(); ++l) {
+                model.lodTriangles[l + 1] = 0;
+                for (const auto& mesh : model.lodLevels[l]) model.lodTriangles[l + 1] += mesh.indices.size() / 3;
+            }
+            auto diffuseOf = [&job](size_t mesh) {
+                for (unsigned int t : job.cpu.meshTextures[mesh])
+                    if (job.cpu.textures[t].type == "texture_diffuse") return (int)t;
+                return -1;
+            };
+            for (const auto& data : job.cpu.meshes) model.meshDiffuse.push_back(diffuseOf(data.sourceMesh));
+            for (const auto& level : job.cpu.lods) {
+                model.lodDiffuse.emplace_back();
+                for (const auto& data : level) model.lodDiffuse.back().push_back(diffuseOf(data.sourceMesh));
+            }
+            for (const auto& data : job.cpu.meshes) model.meshOpacity.push_back(job.cpu.meshOpacity[data.sourceMesh]);
+            for (const auto& level : job.cpu.lods) {
+                model.lodOpacity.emplace_back();
+                for (const auto& data : level) model.lodOpacity.back().push_back(job.cpu.meshOpacity[data.sourceMesh]);
+            }
+            model.meshlets = std::move(job.cpu.meshlets);
+            model.occluder = std::move(job.cpu.occluder);
+            model.bounds = computeMeshBounds(model.meshes);
+            model.resident = true;
+            static unsigned int modelVersions = 0;
+            model.version = ++modelVersions;
+            logLodLevels(model, job.path.substr(job.path.find_last_of('/') + 1));
+            logMeshlets(model, job.path.substr(job.path.find_last_of('/') + 1));
+            if (!job.cpu.compact.empty()) logVertexSavings(job.cpu, job.path.substr(job.path.find_last_of('/') + 1));
+        }
+        if (job.kind == AssetJob::TEXTURE) {
+            TextureAsset& tex = *job.texture;
+            tex.contentHash = job.tex.contentHash;
+            if (job.aliasOf) {
+                unsigned int own = tex.aliasOf ? 0 : tex.id; // an alias's name is its twin's
+                tex.id = job.aliasOf->id;
+                tex.aliasOf = job.aliasOf;
+                tex.gpuBytes = 0;
+                if (onTextureRenamed) onTextureRenamed(tex);
+                if (own) glDeleteTextures(1, &own);
+            } else if (job.tex.ok) {
+                if (job.target != tex.id) {
+                    // a reload: its new name replaces the old one only now it is complete
+                    unsigned int old = tex.aliasOf ? 0 : tex.id;
+                    tex.id = job.target;
+                    tex.aliasOf.reset();
+                    if (onTextureRenamed) onTextureRenamed(tex);
+                    if (old) glDeleteTextures(1, &old);
+                }
+                tex.gpuBytes = 0;
+                for (const auto& level : job.tex.levels) tex.gpuBytes += level.data.size();
+                tex.width = job.tex.levels[0].width;
+                tex.height = job.tex.levels[0].height;
+                tex.levels = (int)job.tex.levels.size();
+                tex.glFormat = job.tex.format == BAKED_RGBA8 ? GL_RGBA8
+                             : job.tex.format == BAKED_BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            }
+            ++tex.version;
+            tex.resident = true;
+        }
+        std::cout << "Asset " << job.path.substr(job.path.find_last_of('/') + 1)
+                  << (job.aliasOf ? " (alias of " + job.aliasOf->path.substr(job.aliasOf->path.find_last_of('/') + 1) + ")" : std::string())
+                  << ": decoded in " << (int)(job.decodedMs - job.requestedMs)
+                  << " ms, resident after " << (int)(now - job.requestedMs) << " ms" << std::endl;
+    }
+
+    std::unique_ptr<Mesh> makeUnitBox(unsigned int texture)
+    {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        for (int face = 0; face < 6; ++face) {
+            int axis = face / 2;
+            float sign = (face % 2) ? 1.0f : -1.0f;
+            glm::vec3 n(0.0f);
+            n[axis] = sign;
+            glm::vec3 u(0.0f), v(0.0f);
+            u[(axis + 1) % 3] = 0.5f;
+            v[(axis + 2) % 3] = 0.5f;
+            unsigned int base = (unsigned int)vertices.size();
+            const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+            for (int c = 0; c < 4; ++c) {
+                Vertex vertex = {};
+                vertex.Position = n * 0.5f + u * corners[c][0] + v * corners[c][1];
+                vertex.Normal = n;
+                vertex.TexCoords = glm::vec2(corners[c][0] * 0.5f + 0.5f, corners[c][1] * 0.5f + 0.5f);
+                vertices.push_back(vertex);
+            }
+            unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+            for (unsigned int q : quad) indices.push_back(base + q);
+        }
+        std::vector<Texture> textures = { { texture, "texture_diffuse", "placeholder" } };
+        return std::unique_ptr<Mesh>(new Mesh(vertices, indices, textures));
+    }
+};
+
+#endif
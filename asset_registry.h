@@ -0,0 +1,318 @@
+#ifndef ASSET_REGISTRY_H
+#define ASSET_REGISTRY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include "asset_loader.h"
+#include "impostors.h"
+#include "model_asset.h"
+#include "texture_array.h"
+#include "uniforms.h"
+
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::shared_ptr<Shader> ShaderHandle;
+
+// Collapses "//", "/./" and "dir/../" so the same file always gets the same key.
+inline std::string normalizeAssetPath(const std::string& path)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    bool absolute = !path.empty() && path[0] == '/';
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos) end = path.size();
+        std::string part = path.substr(start, end - start);
+        if (part == "..") {
+            if (!parts.empty() && parts.back() != "..") parts.pop_back();
+            else if (!absolute) parts.push_back(part);
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        start = end + 1;
+    }
+    std::string out = absolute ? "/" : "";
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (i) out += '/';
+        out += parts[i];
+    }
+    return out;
+}
+
+// --------- Shader includes ---------
+// GLSL has no #include, so shaders share code (bin/*.glsl) through lines of the
+// form `#include "file"`, resolved against the including shader's directory. learnopengl's
+// Shader only compiles files, so a shader with includes is expanded into a file of its
+// own next to it, with `defines` (sizes from the C++ side) after its #version line.
+#define SHADER_EXPANDED_EXT ".expanded"
+#define SHADER_INCLUDE_DEPTH 8
+
+inline bool appendShaderSource(const std::string& path, std::string& out, int& includes, int depth = 0)
+{
+    std::ifstream in(path);
+    if (!in) {
+        std::cout << "Shader " << path << ": Failed to read" << std::endl;
+        return false;
+    }
+    std::string dir = path.find_last_of('/') == std::string::npos ? "" : path.substr(0, path.find_last_of('/') + 1);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 10, "#include \"") != 0) {
+            out += line + "\n";
+            continue;
+        }
+        size_t end = line.find('"', 10);
+        if (end == std::string::npos || depth >= SHADER_INCLUDE_DEPTH) {
+            std::cout << "Shader " << path << ": Failed to include " << line.substr(9) << std::endl;
+            return false;
+        }
+        ++includes;
+        if (!appendShaderSource(dir + line.substr(10, end - 10), out, includes, depth + 1)) return false;
+    }
+    return true;
+}
+
+// The path to compile for `path`: itself when it includes nothing (or can't be read,
+// so the compile reports it), otherwise its expansion.
+inline std::string expandShaderIncludes(const std::string& path, const std::string& defines)
+{
+    std::string source;
+    int includes = 0;
+    if (!appendShaderSource(path, source, includes) || !includes) return path;
+    size_t body = source.compare(0, 8, "#version") == 0 ? source.find('\n') + 1 : 0;
+    source.insert(body, defines);
+    std::string expanded = path + SHADER_EXPANDED_EXT;
+    std::ofstream out(expanded);
+    out << source;
+    if (!out) {
+        std::cout << "Shader " << expanded << ": Failed to write" << std::endl;
+        return path;
+    }
+    return expanded;
+}
+
+// --------- Asset registry ---------
+// One entry per file for the whole process: asking for a path that is already loaded
+// (or still streaming) returns the same ref-counted handle, so every model, texture and
+// shader is decoded and uploaded once no matter how many building types share it. The
+// registry only holds weak references; the GL objects go away with the last handle,
+// so handles must be dropped while the context is still current.
+class AssetRegistry {
+public:
+    explicit AssetRegistry(AsyncAssetLoader& loader) : loader(loader)
+    {
+        loader.resolveTexture = [this](const std::string& path) {
+            TextureHandle material = texture(path, false);
+            material->packable = true;
+            return material;
+        };
+        loader.onTextureRenamed = [this](const TextureAsset& texture) { retargetTexture(texture); };
+    }
+
+    // `#define` lines every shader with includes is compiled with; set before loading them.
+    std::string shaderDefines;
+
+    // `placeholderMin/Max` is the box drawn until the model is resident.
+    ModelHandle model(const std::string& path, const glm::vec3& placeholderMin, const glm::vec3& placeholderMax)
+    {
+        std::string key = normalizeAssetPath(path);
+        auto it = models.find(key);
+        if (it != models.end())
+            if (ModelHandle existing = it->second.lock()) return existing;
+
+        ModelHandle handle(new ModelAsset(), [](ModelAsset* m) {
+            m->releaseMeshes();
+            delete m;
+        });
+        handle->path = key;
+        handle->directory = key.substr(0, key.find_last_of('/'));
+        handle->bounds = boundsFromBox(placeholderMin, placeholderMax);
+        models[key] = handle;
+        // a baked impostor atlas (impostors.h) streams in next to the model
+        if (std::ifstream(key + IMPOSTOR_EXT + BAKED_TEXTURE_EXT).good()) handle->impostor = texture(key + IMPOSTOR_EXT, false);
+        loader.loadModel(handle);
+        return handle;
+    }
+
+    TextureHandle texture(const std::string& path, bool flipY)
+    {
+        std::string file = normalizeAssetPath(path);
+        std::string key = flipY ? file + "#flipY" : file;
+        auto it = textures.find(key);
+        if (it != textures.end())
+            if (TextureHandle existing = it->second.lock()) return existing;
+
+        TextureHandle handle(new TextureAsset(), [](TextureAsset* t) {
+            if (!t->aliasOf) glDeleteTextures(1, &t->id);
+            delete t;
+        });
+        handle->path = file;
+        handle->id = loader.createStreamingTexture();
+        textures[key] = handle;
+        loader.loadTexture(handle, flipY);
+        return handle;
+    }
+
+    // Shaders are tiny, so they are still compiled synchronously; this only dedups them.
+    // Uniform locations are cached as soon as the program is linked (uniforms.h).
+    ShaderHandle shader(const std::string& vertexPath, const std::string& fragmentPath)
+    {
+        std::string key = vertexPath + "|" + fragmentPath;
+        auto it = shaders.find(key);
+        if (it != shaders.end())
+            if (ShaderHandle existing = it->second.lock()) return existing;
+
+        std::string vertexFile = expandShaderIncludes(vertexPath, shaderDefines);
+        std::string fragmentFile = expandShaderIncludes(fragmentPath, shaderDefines);
+        ShaderHandle handle(new Shader(vertexFile.c_str(), fragmentFile.c_str()), [](Shader* s) {
+            forgetUniforms(s->ID);
+            glDeleteProgram(s->ID);
+            delete s;
+        });
+        linkUniforms(*handle);
+        shaders[key] = handle;
+        return handle;
+    }
+
+    // Hot reload entry point: re-streams every asset that was loaded from `path`, re-baking
+    // a texture's .dds first if it has one. The old data stays drawable until the new data
+    // is fully resident. Returns the number of assets affected.
+    int fileChanged(const std::string& path)
+    {
+        std::string file = normalizeAssetPath(path);
+        std::string ext = file.substr(file.find_last_of('.') + 1);
+        for (auto& c : ext) c = (char)tolower(c);
+        if (ext == "dds") return 0; // our own bake output
+
+        int affected = 0;
+        std::string dir = file.substr(0, file.find_last_of('/'));
+        for (auto& entry : models) {
+            ModelHandle m = entry.second.lock();
+            if (!m) continue;
+            if (entry.first == file || (ext == "mtl" && m->directory == dir)) {
+                loader.loadModel(m);
+                ++affected;
+            }
+        }
+        for (bool flipY : { false, true }) {
+            auto it = textures.find(flipY ? file + "#flipY" : file);
+            if (it == textures.end()) continue;
+            if (TextureHandle t = it->second.lock()) {
+                reloadTexture(t, flipY);
+                ++affected;
+            }
+        }
+        if (affected) std::cout << "Hot reload: " << file << " (" << affected << " assets)" << std::endl;
+        return affected;
+    }
+
+    // Packs material textures into texture arrays (texture_array.h) once everything
+    // requested so far is resident; cheap when nothing finished since the last call.
+    void packTextures()
+    {
+        if (!loader.idle() || loader.finishedJobs == packedAtJobs) return;
+        packedAtJobs = loader.finishedJobs;
+        std::vector<TextureHandle> packable;
+        for (auto& entry : textures)
+            if (TextureHandle t = entry.second.lock())
+                if (t->packable) packable.push_back(t);
+        if (int rebuilt = packer.pack(packable))
+            std::cout << "Texture arrays: " << rebuilt << " rebuilt, " << packable.size() << " material textures, "
+                      << packer.gpuBytes() / 1024 << " KB" << std::endl;
+    }
+
+    // Frees the texture arrays; call before the context goes away.
+    void releaseTextureArrays() { packer.clear(); }
+
+    // Per-asset GPU memory and how many handles share each entry.
+    void report(std::ostream& out)
+    {
+        size_t total = 0;
+        out << "Assets:" << std::endl;
+        for (auto it = models.begin(); it != models.end();) {
+            ModelHandle m = it->second.lock();
+            if (!m) { it = models.erase(it); continue; }
+            out << "  model   " << std::setw(8) << m->gpuBytes() / 1024 << " KB  refs " << m.use_count() - 1
+                << (m->resident ? "  " : "  (streaming) ") << it->first << std::endl;
+            total += m->gpuBytes();
+            ++it;
+        }
+        for (auto it = textures.begin(); it != textures.end();) {
+            TextureHandle t = it->second.lock();
+            if (!t) { it = textures.erase(it); continue; }
+            out << "  texture " << std::setw(8) << t->gpuBytes / 1024 << " KB  refs " << t.use_count() - 1
+                << (t->resident ? "  " : "  (streaming) ") << it->first;
+            if (t->aliasOf) out << "  = " << t->aliasOf->path;
+            out << std::endl;
+            total += t->gpuBytes;
+            ++it;
+        }
+        for (auto it = shaders.begin(); it != shaders.end();) {
+            ShaderHandle s = it->second.lock();
+            if (!s) { it = shaders.erase(it); continue; }
+            out << "  shader  program " << s->ID << "  refs " << s.use_count() - 1 << "  " << it->first << std::endl;
+            ++it;
+        }
+        packer.report(out);
+        total += packer.gpuBytes();
+        out << "  total   " << std::setw(8) << total / 1024 << " KB" << std::endl;
+    }
+
+private:
+    AsyncAssetLoader& loader;
+    std::unordered_map<std::string, std::weak_ptr<ModelAsset>> models;
+    std::unordered_map<std::string, std::weak_ptr<TextureAsset>> textures;
+    std::unordered_map<std::string, std::weak_ptr<Shader>> shaders;
+    TextureArrayPacker packer;
+    size_t packedAtJobs = 0;
+
+    // `texture->id` changed (it became an alias, or a reload swapped in its new name):
+    // every live model that references it rebinds its meshes to the new name.
+    void retargetTexture(const TextureAsset& texture)
+    {
+        for (auto& entry : models) {
+            ModelHandle m = entry.second.lock();
+            if (!m) continue;
+            for (size_t i = 0; i < m->textureRefs.size() && i < m->textures_loaded.size(); ++i) {
+                if (m->textureRefs[i].get() != &texture) continue;
+                Texture& loaded = m->textures_loaded[i];
+                auto patch = [&loaded, &texture](std::vector<Texture>& list) {
+                    for (auto& t : list)
+                        if (t.path == loaded.path) t.id = texture.id;
+                };
+                for (auto& mesh : m->meshes) patch(mesh.textures);
+                for (auto& level : m->lodLevels)
+                    for (auto& mesh : level) patch(mesh.textures);
+                loaded.id = texture.id;
+            }
+        }
+        // its aliases draw its name, so they follow it rather than keep a deleted one
+        for (auto& entry : textures) {
+            TextureHandle alias = entry.second.lock();
+            if (!alias || alias->aliasOf.get() != &texture || alias->id == texture.id) continue;
+            alias->id = texture.id;
+            ++alias->version;
+            retargetTexture(*alias);
+        }
+    }
+
+    // An alias keeps drawing its twin's name until the reload has streamed its own (or
+    // found it is still the same content); the loader swaps and retargets in one go.
+    void reloadTexture(const TextureHandle& texture, bool flipY)
+    {
+        bool baked = std::ifstream(texture->path + BAKED_TEXTURE_EXT).good();
+        loader.reloadTexture(texture, flipY, baked);
+    }
+};
+
+#endif
@@ -1,11 +1,44 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 Weight; // transparent pass only (transparency.h)
 
 in vec2 TexCoords;
+in vec3 Normal;
+in vec3 WorldPos;
+in float ViewDepth;
+flat in float Fade;
 
 uniform sampler2D texture_diffuse1;
 
+// packed material textures: one layer per texture, -1 = use texture_diffuse1
+uniform sampler2DArray diffuseArray;
+uniform int diffuseLayer = -1;
+
+// transparent materials: alpha is the diffuse alpha times the material's opacity, and
+// the transparent pass writes weighted blended accumulation instead of a color
+uniform float opacity = 1.0;
+uniform bool transparentPass = false;
+
+#include "lighting.glsl"
+
+#include "dither.glsl"
+
 void main()
-{    
-    FragColor = texture(texture_diffuse1, TexCoords);
-}
\ No newline at end of file
+{
+    if (meshFadedOut(Fade)) discard;
+    vec4 albedo;
+    if (diffuseLayer >= 0)
+        albedo = texture(diffuseArray, vec3(TexCoords, float(diffuseLayer)));
+    else
+        albedo = texture(texture_diffuse1, TexCoords);
+    vec3 color = albedo.rgb * clusteredLight(WorldPos, Normal, ViewDepth);
+    if (transparentPass) {
+        // nearer layers weigh more (McGuire and Bavoil's depth weight)
+        float a = albedo.a * opacity;
+        float w = a * clamp(10.0 / (1e-5 + pow(ViewDepth / 5.0, 2.0) + pow(ViewDepth / 200.0, 6.0)), 1e-2, 3e3);
+        FragColor = vec4(color * a * w, a);
+        Weight = vec4(a * w);
+        return;
+    }
+    FragColor = vec4(color, albedo.a);
+}
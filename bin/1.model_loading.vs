@@ -2,15 +2,43 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 aInstanceModel; // 7..10, per instance when `instanced`
+layout (location = 11) in float aInstanceFade; // per instance, 0 unless fading
 
 out vec2 TexCoords;
+out vec3 Normal;
+out vec3 WorldPos;
+out float ViewDepth; // for the light clusters
+flat out float Fade; // impostors.h: how far this instance has faded into its impostor
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform bool instanced = false;
+
+// per-frame camera, shared by every program (uniforms.h FrameData)
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 eye;
+};
+
+// compact vertices: aPos is 0..1 inside the mesh bounds, aNormal.xy is octahedral
+uniform vec3 posOffset = vec3(0.0);
+uniform vec3 posScale = vec3(1.0);
+uniform bool octNormals = false;
+
+#include "octahedral.glsl"
 
 void main()
 {
-    TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    mat4 world = instanced ? aInstanceModel : model;
+    Fade = instanced ? aInstanceFade : 0.0;
+    vec3 pos = posOffset + aPos * posScale;
+    vec3 normal = octNormals ? octahedralDecode(aNormal.xy) : aNormal;
+    TexCoords = aTexCoords;
+    Normal = mat3(world) * normal;
+    WorldPos = vec3(world * vec4(pos, 1.0));
+    ViewDepth = -(view * vec4(WorldPos, 1.0)).z;
+    gl_Position = viewProjection * vec4(WorldPos, 1.0);
+}
@@ -0,0 +1,15 @@
+// The LOD/impostor crossfade (impostors.h), shared by 1.model_loading.fs and impostor.fs
+// through `#include "dither.glsl"`: both sides test the same 4x4 ordered dither against
+// the instance's fade, the mesh keeping the pixels at or above it and the impostor
+// exactly the ones below, so together they cover every pixel once.
+
+// (0, 1) per pixel of a 4x4 tile.
+float ditherThreshold()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[p.y * 4 + p.x] + 0.5) / 16.0;
+}
+
+bool meshFadedOut(float fade) { return fade > 0.0 && ditherThreshold() < fade; }
+bool impostorFadedOut(float fade) { return fade < 1.0 && ditherThreshold() >= fade; }
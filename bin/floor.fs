@@ -0,0 +1,17 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+in vec3 WorldPos;
+in float ViewDepth;
+
+uniform sampler2D texture1;
+uniform sampler2D texture2;
+
+#include "lighting.glsl"
+
+void main()
+{
+    vec4 albedo = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), 0.2);
+    FragColor = vec4(albedo.rgb * clusteredLight(WorldPos, vec3(0.0, 1.0, 0.0), ViewDepth), albedo.a);
+}
@@ -0,0 +1,29 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 7) in mat4 aInstanceModel; // 7..10, per ground tile when `instanced`
+
+out vec2 TexCoord;
+out vec3 WorldPos;
+out float ViewDepth; // for the light clusters
+
+uniform mat4 model;
+uniform bool instanced = false;
+
+// per-frame camera, shared by every program (uniforms.h FrameData)
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 eye;
+};
+
+void main()
+{
+    mat4 world = instanced ? aInstanceModel : model;
+    WorldPos = vec3(world * vec4(aPos, 1.0));
+    ViewDepth = -(view * vec4(WorldPos, 1.0)).z;
+    gl_Position = viewProjection * vec4(WorldPos, 1.0);
+    TexCoord = aTexCoord;
+}
@@ -0,0 +1,19 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 WorldPos;
+in float ViewDepth;
+flat in int Layer;
+
+// every draw of one multi-draw samples the same array, each its own layer
+uniform sampler2DArray diffuseArray;
+
+#include "lighting.glsl"
+
+void main()
+{
+    vec4 albedo = texture(diffuseArray, vec3(TexCoords, float(Layer)));
+    FragColor = vec4(albedo.rgb * clusteredLight(WorldPos, Normal, ViewDepth), albedo.a);
+}
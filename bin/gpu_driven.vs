@@ -0,0 +1,45 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;        // 0..1 inside the mesh bounds
+layout (location = 1) in vec2 aNormal;     // octahedral
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 11) in uvec2 aRef;      // (matrix, draw), per instance from baseInstance
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 WorldPos;
+out float ViewDepth; // for the light clusters
+flat out int Layer;
+
+// per-frame camera, shared by every program (uniforms.h FrameData)
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 eye;
+};
+
+// gpu_driven.h GpuDrawData
+struct DrawData
+{
+    vec4 posOffset; // w = texture array layer
+    vec4 posScale;  // w = 1 for octahedral normals
+};
+
+layout (std430, binding = 0) readonly buffer Matrices { mat4 matrices[]; };
+layout (std430, binding = 1) readonly buffer Draws { DrawData draws[]; };
+
+#include "octahedral.glsl"
+
+void main()
+{
+    mat4 world = matrices[aRef.x];
+    DrawData draw = draws[aRef.y];
+    vec3 pos = draw.posOffset.xyz + aPos * draw.posScale.xyz;
+    TexCoords = aTexCoords;
+    Normal = mat3(world) * octahedralDecode(aNormal);
+    Layer = int(draw.posOffset.w);
+    WorldPos = vec3(world * vec4(pos, 1.0));
+    ViewDepth = -(view * vec4(WorldPos, 1.0)).z;
+    gl_Position = viewProjection * vec4(WorldPos, 1.0);
+}
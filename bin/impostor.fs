@@ -0,0 +1,22 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec3 Normal;
+in vec3 WorldPos;
+in float ViewDepth;
+flat in float Fade;
+
+uniform sampler2D texture_diffuse1; // the baked atlas
+
+#include "lighting.glsl"
+
+#include "dither.glsl"
+
+void main()
+{
+    if (impostorFadedOut(Fade)) discard;
+    vec4 albedo = texture(texture_diffuse1, TexCoords);
+    if (albedo.a < 0.5) discard;
+    FragColor = vec4(albedo.rgb * clusteredLight(WorldPos, Normal, ViewDepth), 1.0);
+}
@@ -0,0 +1,62 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;           // quad corner, x and y in -1..1
+layout (location = 7) in mat4 aInstanceModel; // 7..10, per instance
+layout (location = 11) in float aInstanceFade; // per instance
+
+out vec2 TexCoords;
+out vec3 Normal;
+out vec3 WorldPos;
+out float ViewDepth; // for the light clusters
+flat out float Fade;
+
+// per-frame camera, shared by every program (uniforms.h FrameData)
+layout (std140) uniform Frame
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 eye;
+};
+
+// the model's bounding sphere (InstanceRenderer passes it as the quad's vertex decode)
+uniform vec3 posOffset = vec3(0.0);
+uniform vec3 posScale = vec3(1.0);
+
+const float GRID = 8.0; // IMPOSTOR_GRID
+
+// impostors.h hemiOctEncode / hemiOctDecode / impostorBasis
+vec2 hemiOctEncode(vec3 d)
+{
+    d.y = max(d.y, 0.0);
+    d /= max(abs(d.x) + d.y + abs(d.z), 1e-6);
+    return vec2(d.x + d.z, d.x - d.z) * 0.5 + 0.5;
+}
+
+vec3 hemiOctDecode(vec2 uv)
+{
+    vec2 p = uv * 2.0 - 1.0;
+    float x = (p.x + p.y) * 0.5, z = (p.x - p.y) * 0.5;
+    return normalize(vec3(x, 1.0 - abs(x) - abs(z), z));
+}
+
+void main()
+{
+    mat4 world = aInstanceModel;
+    Fade = aInstanceFade;
+
+    // the baked frame nearest to where the eye sits in model space
+    vec3 center = vec3(world * vec4(posOffset, 1.0));
+    vec3 toEye = inverse(mat3(world)) * (eye.xyz - center);
+    vec2 cell = min(floor(hemiOctEncode(normalize(toEye)) * GRID), vec2(GRID - 1.0));
+    vec3 dir = hemiOctDecode((cell + 0.5) / GRID);
+    vec3 worldUp = abs(dir.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(-dir, worldUp));
+    vec3 up = cross(right, -dir);
+
+    vec3 pos = posOffset + (right * aPos.x + up * aPos.y) * posScale.x;
+    TexCoords = (cell + aPos.xy * 0.5 + 0.5) / GRID;
+    Normal = mat3(world) * dir;
+    WorldPos = vec3(world * vec4(pos, 1.0));
+    ViewDepth = -(view * vec4(WorldPos, 1.0)).z;
+    gl_Position = viewProjection * vec4(WorldPos, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D texture_diffuse1;
+
+// packed material textures: one layer per texture, -1 = use texture_diffuse1
+uniform sampler2DArray diffuseArray;
+uniform int diffuseLayer = -1;
+
+// Unlit albedo; alpha 1 marks covered texels (the atlas is cleared to 0).
+void main()
+{
+    vec4 albedo;
+    if (diffuseLayer >= 0)
+        albedo = texture(diffuseArray, vec3(TexCoords, float(diffuseLayer)));
+    else
+        albedo = texture(texture_diffuse1, TexCoords);
+    FragColor = vec4(albedo.rgb, 1.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+
+uniform mat4 model;
+uniform mat4 viewProjection; // one impostor frame (impostors.h bakeImpostor)
+
+// compact vertices: aPos is 0..1 inside the mesh bounds
+uniform vec3 posOffset = vec3(0.0);
+uniform vec3 posScale = vec3(1.0);
+
+void main()
+{
+    TexCoords = aTexCoords;
+    gl_Position = viewProjection * model * vec4(posOffset + aPos * posScale, 1.0);
+}
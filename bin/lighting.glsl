@@ -0,0 +1,66 @@
+// Clustered lights and the sun's cascaded shadows, shared by every lit fragment shader
+// through `#include "lighting.glsl"`. LIGHT_MAX and SHADOW_CASCADES are defined by the
+// asset registry when it expands the include, from the C++ defines of the same name.
+
+// clustered_lights.h: LightBlockHeader, GpuLight, LIGHT_MAX
+struct Light
+{
+    vec4 positionRadius;
+    vec4 color;
+    vec4 directionSpot; // w = cosine of the cone's half angle, -1 = point light
+};
+
+layout (std140) uniform Lights
+{
+    vec4 clusterScale;   // x, y: clusters per pixel; z, w: slice = log(depth) * z + w
+    ivec4 clusterCounts; // x, y, z clusters, w = lights
+    vec4 ambient;
+    Light lights[LIGHT_MAX];
+};
+
+// per cluster (offset << 8 | count), then the light indices the offsets point at
+uniform usamplerBuffer lightClusters;
+
+// shadows.h ShadowData, SHADOW_CASCADES
+layout (std140) uniform Shadows
+{
+    mat4 lightSpace[SHADOW_CASCADES];
+    vec4 cascadeEnds;   // view depth where each cascade ends
+    vec4 normalOffsets; // per cascade, along the normal against acne
+    vec4 sun;           // xyz towards the sun, w = darkness of full shadow, 0 = no shadows
+};
+
+uniform sampler2DArrayShadow shadowMap;
+
+// 1 in sunlight, 1 - sun.w in full shadow.
+float sunVisibility(vec3 worldPos, vec3 normal, float viewDepth)
+{
+    if (sun.w == 0.0 || viewDepth >= cascadeEnds[SHADOW_CASCADES - 1]) return 1.0;
+    int cascade = 0;
+    while (viewDepth >= cascadeEnds[cascade]) ++cascade;
+    vec4 p = lightSpace[cascade] * vec4(worldPos + normalize(normal) * normalOffsets[cascade], 1.0);
+    vec3 uvz = p.xyz * 0.5 + 0.5;
+    return 1.0 - sun.w * (1.0 - texture(shadowMap, vec4(uvz.xy, float(cascade), uvz.z)));
+}
+
+// Ambient (in the sun's shadow or not) plus the lights of this fragment's cluster.
+vec3 clusteredLight(vec3 worldPos, vec3 normal, float viewDepth)
+{
+    vec3 result = ambient.rgb * sunVisibility(worldPos, normal, viewDepth);
+    if (clusterCounts.w == 0) return result;
+    ivec3 c = ivec3(gl_FragCoord.xy * clusterScale.xy, log(max(viewDepth, 1e-4)) * clusterScale.z + clusterScale.w);
+    c = clamp(c, ivec3(0), clusterCounts.xyz - 1);
+    uint cell = texelFetch(lightClusters, (c.z * clusterCounts.y + c.y) * clusterCounts.x + c.x).r;
+    vec3 n = normalize(normal);
+    for (uint i = 0u; i < (cell & 255u); ++i) {
+        Light l = lights[texelFetch(lightClusters, int((cell >> 8) + i)).r];
+        vec3 toLight = l.positionRadius.xyz - worldPos;
+        float dist = length(toLight);
+        vec3 dir = toLight / max(dist, 1e-4);
+        float falloff = clamp(1.0 - dist * dist / (l.positionRadius.w * l.positionRadius.w), 0.0, 1.0);
+        float spot = l.directionSpot.w > -1.0
+            ? smoothstep(l.directionSpot.w, mix(l.directionSpot.w, 1.0, 0.25), dot(-dir, l.directionSpot.xyz)) : 1.0;
+        result += l.color.rgb * max(dot(n, dir), 0.0) * falloff * falloff * spot;
+    }
+    return result;
+}
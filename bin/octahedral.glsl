@@ -0,0 +1,9 @@
+// Octahedral normal decode, the inverse of vertex_quantize.h's octahedralEncode; shared
+// by the vertex shaders that read compact vertices through `#include "octahedral.glsl"`.
+vec3 octahedralDecode(vec2 p)
+{
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D accumTexture;  // rgb: sum of weighted premultiplied color, a: revealage
+uniform sampler2D weightTexture; // r: sum of weighted alpha
+
+// Weighted average of the transparent layers; blended over the frame with
+// (ONE_MINUS_SRC_ALPHA, SRC_ALPHA), so alpha carries the revealage. Fetched by pixel:
+// the frame may cover only part of the targets (dynamic_resolution.h).
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumTexture, p, 0);
+    float revealage = accum.a;
+    if (revealage >= 1.0) discard; // nothing transparent here
+    FragColor = vec4(accum.rgb / max(texelFetch(weightTexture, p, 0).r, 1e-5), revealage);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 7) in mat4 aInstanceModel; // 7..10, per instance when `instanced`
+
+uniform mat4 model;
+uniform bool instanced = false;
+uniform mat4 lightSpace; // the cascade being drawn (shadows.h)
+
+// compact vertices: aPos is 0..1 inside the mesh bounds
+uniform vec3 posOffset = vec3(0.0);
+uniform vec3 posScale = vec3(1.0);
+
+void main()
+{
+    mat4 world = instanced ? aInstanceModel : model;
+    gl_Position = lightSpace * world * vec4(posOffset + aPos * posScale, 1.0);
+}
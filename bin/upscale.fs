@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D sceneTexture; // window-sized, the frame in its lower-left part
+uniform vec2 uvScale;           // that part's share of the texture
+uniform vec2 uvMax;             // its last texel centers, so filtering stays inside
+
+// Bilinear stretch of the dynamic-resolution part over the window.
+void main()
+{
+    FragColor = vec4(texture(sceneTexture, min(TexCoords * uvScale, uvMax)).rgb, 1.0);
+}
@@ -0,0 +1,314 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "job_pool.h"
+#include "ring_buffer.h"
+#include "uniforms.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// --------- Clustered lights ---------
+// Point and spot lights are binned on the CPU into a froxel grid: LIGHT_CLUSTERS_X x
+// LIGHT_CLUSTERS_Y screen tiles, each cut into LIGHT_CLUSTERS_Z depth slices that grow
+// exponentially from the near to the far plane. A fragment finds its cluster from
+// gl_FragCoord and its view depth and shades only the lights listed there, so the cost
+// per fragment follows the lights that reach it, not the number in the scene.
+//
+// Binning runs on the job pool, one depth slice per chunk; every light is first reduced
+// to the range of clusters its bounding sphere can touch, then tested against each of
+// their view-space boxes. Lights keep their submission order inside a cluster, so the
+// result does not depend on the number of threads. The lights go to the shaders' Lights
+// uniform block through the stream ring; the cluster table (per cluster offset << 8 |
+// count, followed by the light indices) is a texture buffer, since it has no fixed size
+// and GL 3.3 can only point a buffer texture at a whole buffer.
+#define LIGHT_MAX 256                // lights per frame, the size of the shaders' Lights array
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+#define LIGHT_CLUSTER_MAX_LIGHTS 64  // per cluster; further lights there are dropped and counted
+#define LIGHT_CLUSTER_UNIT 9         // texture unit of `lightClusters`
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z)
+
+static_assert(LIGHT_CLUSTER_MAX_LIGHTS < 256, "the cluster count has 8 bits");
+
+struct Light {
+    glm::vec3 position;
+    float radius = 1.0f;        // no light beyond
+    glm::vec3 color;            // times intensity
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f); // spot lights
+    float spotCos = -1.0f;      // cosine of the cone's half angle, -1 = point light
+};
+
+// std140 mirror of the shaders' Lights block: a header, then LIGHT_MAX lights.
+struct LightBlockHeader {
+    glm::vec4 clusterScale;   // x, y: clusters per pixel; z, w: slice = log(depth) * z + w
+    glm::ivec4 clusterCounts; // x, y, z clusters, w = lights
+    glm::vec4 ambient;        // w unused
+};
+
+struct GpuLight {
+    glm::vec4 positionRadius;
+    glm::vec4 color;          // w unused
+    glm::vec4 directionSpot;  // w = spotCos
+};
+static_assert(sizeof(LightBlockHeader) == 48 && sizeof(GpuLight) == 48, "must match the std140 Lights block");
+static_assert(sizeof(LightBlockHeader) + LIGHT_MAX * sizeof(GpuLight) <= 16384, "GL's minimum uniform block size");
+
+struct LightStats {
+    size_t lights = 0;
+    size_t clusters = 0;   // with at least one light
+    size_t indices = 0;
+    size_t overflowed = 0; // light/cluster pairs over LIGHT_CLUSTER_MAX_LIGHTS
+    double binMs = 0.0;
+};
+
+class LightClusters {
+public:
+    LightClusters() {}
+    ~LightClusters() { release(); }
+
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // Frees the buffer texture; must run while the context is current.
+    void release()
+    {
+        if (texture) glDeleteTextures(1, &texture);
+        if (buffer) {
+            glDeleteBuffers(1, &buffer);
+            glState().forgetBuffer(buffer);
+        }
+        texture = buffer = 0;
+        capacity = 0;
+    }
+
+    // Bins the first LIGHT_MAX of `lights` for a camera at `view` with a perspective
+    // projection of (fovY, aspect, zNear, zFar); CPU only, on `pool`.
+    void bin(JobPool& pool, const std::vector<Light>& lights, const glm::mat4& view, float fovY, float aspect,
+             float zNear, float zFar, LightStats& stats)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        setProjection(fovY, aspect, zNear, zFar);
+        count = std::min<size_t>(lights.size(), LIGHT_MAX);
+        ranges.resize(count);
+        pool.parallelFor(count, 64, [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) ranges[i] = clusterRange(lights[i], view);
+        });
+
+        slots.resize((size_t)LIGHT_CLUSTER_COUNT * LIGHT_CLUSTER_MAX_LIGHTS);
+        slotCounts.assign(LIGHT_CLUSTER_COUNT, 0);
+        sliceOverflow.assign(LIGHT_CLUSTERS_Z, 0);
+        pool.parallelFor(LIGHT_CLUSTERS_Z, 1, [&](size_t first, size_t last) {
+            for (size_t z = first; z < last; ++z) binSlice((int)z);
+        });
+
+        // compact: the table, then every cluster's indices behind it
+        table.resize(LIGHT_CLUSTER_COUNT);
+        for (size_t c = 0; c < LIGHT_CLUSTER_COUNT; ++c) {
+            uint32_t n = slotCounts[c];
+            table[c] = (uint32_t)table.size() << 8 | n;
+            table.insert(table.end(), slots.begin() + c * LIGHT_CLUSTER_MAX_LIGHTS,
+                         slots.begin() + c * LIGHT_CLUSTER_MAX_LIGHTS + n);
+            if (n) ++stats.clusters;
+        }
+        for (size_t overflow : sliceOverflow) stats.overflowed += overflow;
+        stats.lights += count;
+        stats.indices += table.size() - LIGHT_CLUSTER_COUNT;
+        stats.binMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // Writes the lights binned last into `ring` and the cluster table into the buffer
+    // texture, and binds both. With no lights the shaders only apply `ambient`.
+    void upload(StreamRing& ring, const std::vector<Light>& lights, const glm::vec3& ambient, int viewportWidth, int viewportHeight)
+    {
+        if (!texture) create();
+        size_t lightCount = std::min(count, lights.size());
+        LightBlockHeader header;
+        header.clusterScale = glm::vec4((float)LIGHT_CLUSTERS_X / std::max(viewportWidth, 1),
+                                        (float)LIGHT_CLUSTERS_Y / std::max(viewportHeight, 1), sliceScale, sliceBias);
+        header.clusterCounts = glm::ivec4(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z, (int)lightCount);
+        header.ambient = glm::vec4(ambient, 1.0f);
+        // the whole block, so the binding covers everything the shader declares
+        size_t bytes = sizeof(LightBlockHeader) + LIGHT_MAX * sizeof(GpuLight);
+        RingAllocation slice = ring.allocate(bytes, ring.uniformAlignment());
+        memcpy(slice.data, &header, sizeof(header));
+        GpuLight* out = (GpuLight*)((char*)slice.data + sizeof(header));
+        for (size_t i = 0; i < lightCount; ++i) {
+            const Light& l = lights[i];
+            out[i].positionRadius = glm::vec4(l.position, l.radius);
+            out[i].color = glm::vec4(l.color, 0.0f);
+            out[i].directionSpot = glm::vec4(glm::normalize(l.direction), l.spotCos);
+        }
+        ring.flush();
+        glState().bindBufferRange(GL_UNIFORM_BUFFER, LIGHT_UNIFORM_BINDING, slice.buffer, slice.offset, bytes);
+
+        if (lightCount && !table.empty()) {
+            // orphaned every frame, the driver hands out a fresh store while the GPU reads the old one
+            size_t tableBytes = table.size() * sizeof(uint32_t);
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            capacity = std::max(capacity, tableBytes);
+            glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, tableBytes, table.data());
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+        glState().bindTexture(LIGHT_CLUSTER_UNIT, GL_TEXTURE_BUFFER, texture);
+    }
+
+    // The last bin's table: LIGHT_CLUSTER_COUNT entries of offset << 8 | count, then the
+    // light indices; clusters are x fastest, then y, then depth slice.
+    const std::vector<uint32_t>& clusterTable() const { return table; }
+
+    // View-space box of cluster `c` of the last bin.
+    void clusterBounds(size_t c, glm::vec3& boxMin, glm::vec3& boxMax) const
+    {
+        boxMin = bounds[c * 2];
+        boxMax = bounds[c * 2 + 1];
+    }
+
+    // Whether light `l` of the last bin reaches cluster `c`'s box (bounding sphere test).
+    bool touches(const Light& l, const glm::mat4& view, size_t c) const
+    {
+        glm::vec3 center = glm::vec3(view * glm::vec4(l.position, 1.0f));
+        return sphereTouchesBox(center, l.radius, bounds[c * 2], bounds[c * 2 + 1]);
+    }
+
+private:
+    struct Range {
+        int x0, x1, y0, y1, z0, z1; // inclusive; z0 > z1 = off screen
+        glm::vec3 center;           // view space
+        float radius;
+    };
+
+    unsigned int texture = 0, buffer = 0;
+    size_t capacity = 0;
+    size_t count = 0;
+    std::vector<Range> ranges;
+    std::vector<uint16_t> slots;      // LIGHT_CLUSTER_MAX_LIGHTS per cluster
+    std::vector<uint8_t> slotCounts;
+    std::vector<size_t> sliceOverflow;
+    std::vector<uint32_t> table;
+    std::vector<glm::vec3> bounds;    // min, max per cluster, view space
+    float fovYValue = 0.0f, aspectValue = 0.0f, nearValue = 0.0f, farValue = 0.0f;
+    float tanX = 0.0f, tanY = 0.0f;   // half extents of the view at depth 1
+    float sliceScale = 0.0f, sliceBias = 0.0f;
+
+    void create()
+    {
+        glGenBuffers(1, &buffer);
+        glGenTextures(1, &texture);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(uint32_t), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glState().bindTexture(LIGHT_CLUSTER_UNIT, GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, buffer);
+    }
+
+    // Recomputes the cluster boxes when the projection changed.
+    void setProjection(float fovY, float aspect, float zNear, float zFar)
+    {
+        if (fovY == fovYValue && aspect == aspectValue && zNear == nearValue && zFar == farValue && !bounds.empty()) return;
+        fovYValue = fovY;
+        aspectValue = aspect;
+        nearValue = zNear;
+        farValue = zFar;
+        tanY = std::tan(fovY * 0.5f);
+        tanX = tanY * aspect;
+        sliceScale = LIGHT_CLUSTERS_Z / std::log(zFar / zNear);
+        sliceBias = -std::log(zNear) * sliceScale;
+        bounds.resize((size_t)LIGHT_CLUSTER_COUNT * 2);
+        for (int z = 0; z < LIGHT_CLUSTERS_Z; ++z) {
+            float d0 = sliceDepth(z), d1 = sliceDepth(z + 1);
+            for (int y = 0; y < LIGHT_CLUSTERS_Y; ++y)
+                for (int x = 0; x < LIGHT_CLUSTERS_X; ++x) {
+                    float nx0 = -1.0f + 2.0f * x / LIGHT_CLUSTERS_X, nx1 = -1.0f + 2.0f * (x + 1) / LIGHT_CLUSTERS_X;
+                    float ny0 = -1.0f + 2.0f * y / LIGHT_CLUSTERS_Y, ny1 = -1.0f + 2.0f * (y + 1) / LIGHT_CLUSTERS_Y;
+                    // the tile's edges are lines through the eye, so the box spans both depths
+                    glm::vec3 lo(std::min(nx0 * tanX * d0, nx0 * tanX * d1), std::min(ny0 * tanY * d0, ny0 * tanY * d1), -d1);
+                    glm::vec3 hi(std::max(nx1 * tanX * d0, nx1 * tanX * d1), std::max(ny1 * tanY * d0, ny1 * tanY * d1), -d0);
+                    size_t c = clusterIndex(x, y, z);
+                    bounds[c * 2] = lo;
+                    bounds[c * 2 + 1] = hi;
+                }
+        }
+    }
+
+    float sliceDepth(int z) const { return nearValue * std::pow(farValue / nearValue, (float)z / LIGHT_CLUSTERS_Z); }
+
+    int sliceOf(float depth) const
+    {
+        return std::max(0, std::min(LIGHT_CLUSTERS_Z - 1, (int)std::floor(std::log(depth) * sliceScale + sliceBias)));
+    }
+
+    static size_t clusterIndex(int x, int y, int z)
+    {
+        return ((size_t)z * LIGHT_CLUSTERS_Y + y) * LIGHT_CLUSTERS_X + x;
+    }
+
+    static int tileOf(float ndc, int tiles)
+    {
+        return std::max(0, std::min(tiles - 1, (int)std::floor((ndc * 0.5f + 0.5f) * tiles)));
+    }
+
+    static bool sphereTouchesBox(const glm::vec3& center, float radius, const glm::vec3& lo, const glm::vec3& hi)
+    {
+        glm::vec3 d = glm::max(lo - center, glm::vec3(0.0f)) + glm::max(center - hi, glm::vec3(0.0f));
+        return glm::dot(d, d) <= radius * radius;
+    }
+
+    // Clusters the view-space box around the light's bounding sphere can project into;
+    // a spot light is binned by the sphere of its reach.
+    Range clusterRange(const Light& light, const glm::mat4& view) const
+    {
+        Range r;
+        r.center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+        r.radius = light.radius;
+        float depth = -r.center.z;
+        float dNear = std::max(depth - r.radius, nearValue), dFar = std::min(depth + r.radius, farValue);
+        if (dNear > dFar) {
+            r.z0 = 1;
+            r.z1 = 0;
+            return r;
+        }
+        r.z0 = sliceOf(dNear);
+        r.z1 = sliceOf(dFar);
+        // x / (depth * tan) is extreme at one of the box's corners
+        float xLo = r.center.x - r.radius, xHi = r.center.x + r.radius;
+        float yLo = r.center.y - r.radius, yHi = r.center.y + r.radius;
+        r.x0 = tileOf(std::min(xLo / (dNear * tanX), xLo / (dFar * tanX)), LIGHT_CLUSTERS_X);
+        r.x1 = tileOf(std::max(xHi / (dNear * tanX), xHi / (dFar * tanX)), LIGHT_CLUSTERS_X);
+        r.y0 = tileOf(std::min(yLo / (dNear * tanY), yLo / (dFar * tanY)), LIGHT_CLUSTERS_Y);
+        r.y1 = tileOf(std::max(yHi / (dNear * tanY), yHi / (dFar * tanY)), LIGHT_CLUSTERS_Y);
+        return r;
+    }
+
+    // Only this slice's clusters are written, by the one chunk that owns it.
+    void binSlice(int z)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            const Range& r = ranges[i];
+            if (z < r.z0 || z > r.z1) continue;
+            for (int y = r.y0; y <= r.y1; ++y)
+                for (int x = r.x0; x <= r.x1; ++x) {
+                    size_t c = clusterIndex(x, y, z);
+                    if (!sphereTouchesBox(r.center, r.radius, bounds[c * 2], bounds[c * 2 + 1])) continue;
+                    if (slotCounts[c] == LIGHT_CLUSTER_MAX_LIGHTS) {
+                        ++sliceOverflow[z];
+                        continue;
+                    }
+                    slots[c * LIGHT_CLUSTER_MAX_LIGHTS + slotCounts[c]++] = (uint16_t)i;
+                }
+        }
+    }
+};
+
+#endif
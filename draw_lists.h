@@ -0,0 +1,119 @@
+#ifndef DRAW_LISTS_H
+#define DRAW_LISTS_H
+
+#include <glm/glm.hpp>
+
+#include "frustum_culling.h"
+#include "gpu_driven.h"
+#include "instancing.h"
+#include "job_pool.h"
+#include "meshlets.h"
+#include "render_queue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// --------- Parallel draw lists ---------
+// LOD selection and batching are per-object CPU work, so for a big city they run on the
+// job pool. Objects are visited in spatial order (regions of DRAW_LIST_REGION on the
+// ground plane, see spatialOrder) and every run of DRAW_LIST_CHUNK of them gets its own
+// lane: a RenderQueue, an InstanceRenderer and a GpuScene::Lane that only the worker on
+// that run writes. The GL thread then merges the lanes in run order, so the result does
+// not depend on the number of threads. Nothing a lane does touches GL.
+#define DRAW_LIST_CHUNK 2048    // objects per lane
+#define DRAW_LIST_REGION 64.0f  // side of a spatial region, world units
+
+struct DrawLane {
+    RenderQueue queue;           // per-object packets (--no-instancing)
+    InstanceRenderer instances;
+    GpuScene::Lane gpu;
+    MeshletCullStats clusterStats;
+    size_t gpuFallbacks = 0;     // objects GpuScene left to the instanced path
+
+    void begin(const glm::vec3& eye, float fovYRadians)
+    {
+        queue.begin();
+        instances.begin(eye, fovYRadians);
+        gpu.clear();
+        clusterStats = MeshletCullStats();
+        gpuFallbacks = 0;
+    }
+};
+
+struct DrawListStats {
+    size_t lanes = 0;
+    double buildMs = 0.0; // workers filling lanes
+    double mergeMs = 0.0; // GL thread merging them
+};
+
+// Object ids of `set` sorted by the region their center falls in (row by row), so each
+// lane covers a compact patch of the city.
+inline void spatialOrder(const CullSet& set, std::vector<uint32_t>& order)
+{
+    std::vector<uint64_t> keys(set.size());
+    for (size_t i = 0; i < set.size(); ++i) {
+        int32_t x = (int32_t)std::floor(set.cx[i] / DRAW_LIST_REGION);
+        int32_t z = (int32_t)std::floor(set.cz[i] / DRAW_LIST_REGION);
+        keys[i] = (uint64_t)((uint32_t)z ^ 0x80000000u) << 32 | ((uint32_t)x ^ 0x80000000u);
+    }
+    order.resize(set.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = (uint32_t)i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+}
+
+class DrawLists {
+public:
+    // Calls fill(begin, end, lane) for every run of [0, count) on `pool`; each lane is
+    // begun with this frame's eye first.
+    void build(JobPool& pool, size_t count, const glm::vec3& eye, float fovYRadians,
+               const std::function<void(size_t, size_t, DrawLane&)>& fill, DrawListStats& stats)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        used = (count + DRAW_LIST_CHUNK - 1) / DRAW_LIST_CHUNK;
+        while (lanes.size() < used) lanes.emplace_back(new DrawLane());
+        // without workers parallelFor hands over [0, count) in one call
+        pool.parallelFor(count, DRAW_LIST_CHUNK, [&](size_t first, size_t last) {
+            for (size_t run = first; run < last; run += DRAW_LIST_CHUNK) {
+                DrawLane& lane = *lanes[run / DRAW_LIST_CHUNK];
+                lane.begin(eye, fovYRadians);
+                fill(run, std::min(run + DRAW_LIST_CHUNK, last), lane);
+            }
+        });
+        stats.lanes += used;
+        stats.buildMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // Hands every lane's work to the frame's queue, instance renderer and (when drawing
+    // GPU-driven) scene, in lane order; GL thread.
+    void merge(RenderQueue& queue, InstanceRenderer& instances, GpuScene* gpu, MeshletCullStats& clusterStats,
+               GpuDrivenStats& gpuStats, DrawListStats& stats)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < used; ++i) {
+            DrawLane& lane = *lanes[i];
+            queue.append(lane.queue);
+            instances.merge(lane.instances);
+            if (gpu) gpu->merge(lane.gpu);
+            clusterStats.clusters += lane.clusterStats.clusters;
+            clusterStats.frustumCulled += lane.clusterStats.frustumCulled;
+            clusterStats.backfaceCulled += lane.clusterStats.backfaceCulled;
+            clusterStats.trianglesDrawn += lane.clusterStats.trianglesDrawn;
+            clusterStats.triangles += lane.clusterStats.triangles;
+            gpuStats.fallbacks += lane.gpuFallbacks;
+        }
+        if (gpu) gpu->uploadMissing();
+        stats.mergeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+private:
+    std::vector<std::unique_ptr<DrawLane>> lanes; // kept across frames
+    size_t used = 0;
+};
+
+#endif
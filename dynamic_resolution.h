@@ -0,0 +1,230 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include "gl_state.h"
+#include "uniforms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+// --------- Dynamic resolution ---------
+// The scene is drawn into an offscreen target the size of the window, but only into
+// its lower-left scale x scale part; upscale() then stretches that part over the
+// window with bilinear filtering. The target is never reallocated when the scale
+// moves, only when the window does. Every DYNAMIC_RESOLUTION_WINDOW frames the median
+// frame time (GPU time from GL_TIME_ELAPSED queries when the driver counts it, CPU
+// time up to the buffer swap otherwise, so vsync waits don't count; the median so a
+// streaming hitch moves nothing) is compared with the target: over it the scale drops
+// at once in proportion (pixels cost ~scale^2), under DYNAMIC_RESOLUTION_HEADROOM of
+// it the scale climbs back by DYNAMIC_RESOLUTION_STEP, in between it stays. Query
+// results are picked up once they are done, up to DYNAMIC_RESOLUTION_QUERIES frames
+// later, so nothing stalls.
+#define DYNAMIC_RESOLUTION true             // default; --no-dynamic-resolution draws straight to the window
+#define DYNAMIC_RESOLUTION_TARGET_MS 16.7f  // --target-fps
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f   // --resolution-scale <min> <max>
+#define DYNAMIC_RESOLUTION_MAX_SCALE 1.0f
+#define DYNAMIC_RESOLUTION_WINDOW 9         // frames per adjustment, odd for the median
+#define DYNAMIC_RESOLUTION_HEADROOM 0.8f    // grow only below 80% of the target
+#define DYNAMIC_RESOLUTION_STEP 0.05f       // growth per adjustment
+#define DYNAMIC_RESOLUTION_QUERIES 4        // timer queries in flight
+#define DYNAMIC_RESOLUTION_UNIT 0           // texture unit of upscale.fs's sampler
+
+struct DynamicResolutionStats {
+    double scale = 0.0; // summed per frame like the rest
+    double gpuMs = 0.0;
+    size_t gpuFrames = 0;
+    double cpuMs = 0.0;
+    size_t adjustments = 0;
+};
+
+// GL_TIME_ELAPSED queries: core since 3.3, and the counter may still have no bits.
+inline bool timerQueriesSupported()
+{
+    if (!(GLVersion.major > 3 || (GLVersion.major == 3 && GLVersion.minor >= 3) || GLAD_GL_ARB_timer_query)) return false;
+    GLint bits = 0;
+    glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+    return bits > 0;
+}
+
+class DynamicResolution {
+public:
+    DynamicResolution() {}
+    ~DynamicResolution() { release(); }
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    float targetMs = DYNAMIC_RESOLUTION_TARGET_MS;
+    float minScale = DYNAMIC_RESOLUTION_MIN_SCALE;
+    float maxScale = DYNAMIC_RESOLUTION_MAX_SCALE;
+
+    // Frees the target and queries; must run while the context is current.
+    void release()
+    {
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        if (color) glDeleteTextures(1, &color);
+        if (depth) glDeleteRenderbuffers(1, &depth);
+        if (vao) glDeleteVertexArrays(1, &vao);
+        if (queries[0]) glDeleteQueries(DYNAMIC_RESOLUTION_QUERIES, queries);
+        fbo = color = depth = vao = 0;
+        for (unsigned int& q : queries) q = 0;
+        for (bool& p : pending) p = false;
+        width = height = 0;
+    }
+
+    // Binds the target for a frame on a width x height window, sets the viewport to the
+    // scaled part and starts timing. `output` is the framebuffer the finished frame goes
+    // to (the window's, or --headless's). False when the target can't be made: `output`
+    // is bound at full size then and upscale() does nothing.
+    bool begin(int width, int height, unsigned int output = 0)
+    {
+        this->output = output;
+        if (width != this->width || height != this->height) create(width, height);
+        if (queries[0]) {
+            glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+            timing = true;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo ? fbo : output);
+        if (!fbo) {
+            glViewport(0, 0, width, height);
+            return false;
+        }
+        glViewport(0, 0, scaledWidth(), scaledHeight());
+        return true;
+    }
+
+    // Size of the part the frame is drawn into; the window's without a target.
+    int scaledWidth() const { return fbo ? std::max(1, (int)std::lround(width * scale)) : width; }
+    int scaledHeight() const { return fbo ? std::max(1, (int)std::lround(height * scale)) : height; }
+    unsigned int target() const { return fbo; }
+
+    // Stretches the drawn part over the output with `shader` (upscale.vs/fs), leaves the
+    // output bound at full size and stops timing.
+    void upscale(Shader& shader)
+    {
+        if (fbo) {
+            glBindFramebuffer(GL_FRAMEBUFFER, output);
+            glViewport(0, 0, width, height);
+            glState().enable(GL_DEPTH_TEST, false);
+            glState().enable(GL_BLEND, false);
+            glState().useProgram(shader.ID);
+            // the part's share of the texture, and its last texel centers against bleeding
+            glm::vec2 size((float)width, (float)height);
+            glm::vec2 part((float)scaledWidth(), (float)scaledHeight());
+            const ProgramUniforms& uniforms = uniformsOf(shader);
+            setUniform(uniforms[UNIFORM_UV_SCALE], part / size);
+            setUniform(uniforms[UNIFORM_UV_MAX], (part - glm::vec2(0.5f)) / size);
+            glState().bindTexture(DYNAMIC_RESOLUTION_UNIT, GL_TEXTURE_2D, color);
+            glState().bindVertexArray(vao);
+            glDrawArrays(GL_TRIANGLES, 0, 3); // one triangle over the screen, from gl_VertexID
+            glState().enable(GL_DEPTH_TEST, true);
+        }
+        if (timing) {
+            glEndQuery(GL_TIME_ELAPSED);
+            pending[current] = true;
+            current = (current + 1) % DYNAMIC_RESOLUTION_QUERIES;
+            timing = false;
+        }
+    }
+
+    // Feeds one frame's CPU time (seconds, up to the swap) and whatever timer results
+    // are ready, and moves the scale once a window of frames is in.
+    void update(float cpuSeconds, DynamicResolutionStats& stats)
+    {
+        float cpuMs = cpuSeconds * 1000.0f;
+        stats.scale += currentScale();
+        stats.cpuMs += cpuMs;
+        // GPU time when the queries deliver it, CPU time otherwise
+        if (!queries[0]) {
+            feed(cpuMs, stats);
+            return;
+        }
+        for (int i = 0; i < DYNAMIC_RESOLUTION_QUERIES; ++i) {
+            if (!pending[i]) continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &ns);
+            pending[i] = false;
+            stats.gpuMs += ns / 1.0e6;
+            ++stats.gpuFrames;
+            feed((float)(ns / 1.0e6), stats);
+        }
+    }
+
+    float currentScale() const { return fbo ? scale : 1.0f; }
+    bool gpuTimed() const { return queries[0] != 0; }
+
+private:
+    unsigned int fbo = 0, color = 0, depth = 0, vao = 0;
+    unsigned int output = 0;
+    unsigned int queries[DYNAMIC_RESOLUTION_QUERIES] = {};
+    bool pending[DYNAMIC_RESOLUTION_QUERIES] = {};
+    int current = 0;
+    bool timing = false;
+    int width = 0, height = 0;
+    float scale = DYNAMIC_RESOLUTION_MAX_SCALE;
+    float window[DYNAMIC_RESOLUTION_WINDOW] = {};
+    int windowFrames = 0;
+
+    void feed(float ms, DynamicResolutionStats& stats)
+    {
+        if (!fbo) return;
+        window[windowFrames] = ms;
+        if (++windowFrames < DYNAMIC_RESOLUTION_WINDOW) return;
+        windowFrames = 0;
+        std::nth_element(window, window + DYNAMIC_RESOLUTION_WINDOW / 2, window + DYNAMIC_RESOLUTION_WINDOW);
+        float median = window[DYNAMIC_RESOLUTION_WINDOW / 2];
+        float next = scale;
+        if (median > targetMs) next = scale * std::sqrt(targetMs / median);
+        else if (median < targetMs * DYNAMIC_RESOLUTION_HEADROOM) next = scale + DYNAMIC_RESOLUTION_STEP;
+        next = glm::clamp(next, minScale, maxScale);
+        if (next != scale) {
+            scale = next;
+            ++stats.adjustments;
+        }
+    }
+
+    void create(int width, int height)
+    {
+        float keep = scale;
+        release();
+        scale = glm::clamp(keep, minScale, maxScale);
+        this->width = width;
+        this->height = height;
+        if (timerQueriesSupported()) glGenQueries(DYNAMIC_RESOLUTION_QUERIES, queries);
+        glGenTextures(1, &color);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().invalidate(); // texture and renderbuffer binds above went around the cache
+        glGenVertexArrays(1, &vao);
+        if (!complete) {
+            std::cout << "Dynamic resolution: Failed to create the render target, drawing at window size" << std::endl;
+            glDeleteFramebuffers(1, &fbo);
+            fbo = 0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef FRUSTUM_CULLING_H
+#define FRUSTUM_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include "job_pool.h"
+#include "meshlets.h"
+#include "model_asset.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRUSTUM_SIMD 1
+#else
+#define FRUSTUM_SIMD 0
+#endif
+
+// --------- Frustum culling ---------
+// World-space boxes kept as structure-of-arrays (centers and half extents), so four
+// boxes are tested against a plane with a handful of SSE instructions. A box is
+// outside when, for some plane, its center lies further behind it than the box's
+// extent projected on the plane normal. Large sets are split into chunks that run on
+// a JobPool. Conservative like every plane test: boxes near a frustum corner can be
+// kept although they are outside.
+#define FRUSTUM_CULL_CHUNK 4096
+
+struct Frustum {
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4& viewProjection) { extractFrustumPlanes(viewProjection, planes); }
+
+    bool boxVisible(const glm::vec3& center, const glm::vec3& extent) const
+    {
+        for (const auto& p : planes) {
+            glm::vec3 n(p);
+            float reach = std::fabs(n.x) * extent.x + std::fabs(n.y) * extent.y + std::fabs(n.z) * extent.z;
+            if (glm::dot(n, center) + p.w < -reach) return false;
+        }
+        return true;
+    }
+};
+
+struct CullStats {
+    size_t tested = 0;
+    size_t visible = 0;
+    double ms = 0.0;
+};
+
+// World box of `bounds` under `transform`: the center moves, the half extents go
+// through the absolute value of the 3x3 part (exact for rotations and scales).
+inline void worldBox(const glm::mat4& transform, const ModelBounds& bounds, glm::vec3& center, glm::vec3& extent)
+{
+    glm::vec3 half = (bounds.max - bounds.min) * 0.5f;
+    center = glm::vec3(transform * glm::vec4((bounds.min + bounds.max) * 0.5f, 1.0f));
+    extent = glm::vec3(0.0f);
+    for (int c = 0; c < 3; ++c)
+        extent += glm::abs(glm::vec3(transform[c])) * half[c];
+}
+
+class CullSet {
+public:
+    std::vector<float> cx, cy, cz; // centers
+    std::vector<float> ex, ey, ez; // half extents
+
+    size_t size() const { return cx.size(); }
+
+    void resize(size_t n)
+    {
+        cx.resize(n); cy.resize(n); cz.resize(n);
+        ex.resize(n); ey.resize(n); ez.resize(n);
+    }
+
+    void set(size_t i, const glm::vec3& center, const glm::vec3& extent)
+    {
+        if (i >= size()) resize(i + 1);
+        cx[i] = center.x; cy[i] = center.y; cz[i] = center.z;
+        ex[i] = extent.x; ey[i] = extent.y; ez[i] = extent.z;
+    }
+
+    void clear() { resize(0); }
+};
+
+// Writes 1 (visible) or 0 to visible[begin, end); returns how many are visible.
+inline size_t cullBoxes(const Frustum& frustum, const CullSet& set, size_t begin, size_t end, uint8_t* visible)
+{
+    size_t count = 0;
+    size_t i = begin;
+#if FRUSTUM_SIMD
+    const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+    for (int p = 0; p < 6; ++p) {
+        nx[p] = _mm_set1_ps(frustum.planes[p].x);
+        ny[p] = _mm_set1_ps(frustum.planes[p].y);
+        nz[p] = _mm_set1_ps(frustum.planes[p].z);
+        nw[p] = _mm_set1_ps(frustum.planes[p].w);
+        ax[p] = _mm_and_ps(nx[p], signMask);
+        ay[p] = _mm_and_ps(ny[p], signMask);
+        az[p] = _mm_and_ps(nz[p], signMask);
+    }
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(&set.cx[i]), y = _mm_loadu_ps(&set.cy[i]), z = _mm_loadu_ps(&set.cz[i]);
+        __m128 hx = _mm_loadu_ps(&set.ex[i]), hy = _mm_loadu_ps(&set.ey[i]), hz = _mm_loadu_ps(&set.ez[i]);
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; ++p) {
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(ny[p], y)),
+                                     _mm_add_ps(_mm_mul_ps(nz[p], z), nw[p]));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], hx), _mm_mul_ps(ay[p], hy)), _mm_mul_ps(az[p], hz));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, reach), _mm_setzero_ps()));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; ++k) {
+            uint8_t v = (mask >> k & 1) ? 0 : 1;
+            visible[i + k] = v;
+            count += v;
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        uint8_t v = frustum.boxVisible(glm::vec3(set.cx[i], set.cy[i], set.cz[i]), glm::vec3(set.ex[i], set.ey[i], set.ez[i])) ? 1 : 0;
+        visible[i] = v;
+        count += v;
+    }
+    return count;
+}
+
+// Culls the whole set in FRUSTUM_CULL_CHUNK chunks on `pool`; `visible` is resized
+// to the set. Adds to `stats`.
+inline void cullBoxesParallel(JobPool& pool, const Frustum& frustum, const CullSet& set,
+                              std::vector<uint8_t>& visible, CullStats& stats)
+{
+    visible.resize(set.size());
+    std::atomic<size_t> count{0};
+    pool.parallelFor(set.size(), FRUSTUM_CULL_CHUNK, [&](size_t begin, size_t end) {
+        count += cullBoxes(frustum, set, begin, end, visible.data());
+    });
+    stats.tested += set.size();
+    stats.visible += count;
+}
+
+#endif
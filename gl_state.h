@@ -0,0 +1,233 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// --------- GL state cache ---------
+// Shadows the bindings and fixed-function state the draw paths touch (program, VAO,
+// buffer targets, indexed uniform/storage ranges, texture units, samplers, depth and
+// blend state) and only calls GL when a value actually changes. Upload and setup code
+// (asset streaming, texture packing, the geometry pool, learnopengl's Mesh) still binds
+// GL directly; invalidate() forgets every binding after such code ran, so the cache
+// never skips a call it needs. Fixed-function state is only ever set through here and
+// is kept across invalidate().
+#define GL_STATE_TEXTURE_UNITS 16
+#define GL_STATE_BUFFER_INDICES 8 // binding points tracked per indexed target
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu
+
+struct GLStateStats {
+    size_t issued = 0;
+    size_t elided = 0;
+};
+
+class GLStateCache {
+public:
+    GLStateCache()
+    {
+        invalidate();
+        for (int& cap : caps) cap = -1;
+        depthFuncValue = GL_STATE_UNKNOWN;
+        for (GLenum& factor : blendFactors) factor = GL_STATE_UNKNOWN;
+        depthMaskValue = -1;
+    }
+
+    GLStateStats stats;
+
+    // Forgets all bindings; call after code that bound GL behind the cache's back.
+    void invalidate()
+    {
+        program = vao = activeUnit = GL_STATE_UNKNOWN;
+        for (unsigned int& b : buffers) b = GL_STATE_UNKNOWN;
+        for (auto& target : ranges)
+            for (Range& r : target) r.buffer = GL_STATE_UNKNOWN;
+        for (auto& unit : textures)
+            for (unsigned int& t : unit) t = GL_STATE_UNKNOWN;
+        for (unsigned int& s : samplers) s = GL_STATE_UNKNOWN;
+    }
+
+    // GL drops deleted names from every binding, so must the cache; call after
+    // glDeleteBuffers of a buffer that went through it.
+    void forgetBuffer(unsigned int buffer)
+    {
+        for (unsigned int& b : buffers)
+            if (b == buffer) b = 0;
+        for (auto& target : ranges)
+            for (Range& r : target)
+                if (r.buffer == buffer) r.buffer = GL_STATE_UNKNOWN;
+    }
+
+    void useProgram(unsigned int id)
+    {
+        if (!changed(program, id)) return;
+        glUseProgram(id);
+    }
+
+    void bindVertexArray(unsigned int id)
+    {
+        if (!changed(vao, id)) return;
+        glBindVertexArray(id);
+    }
+
+    // GL_ELEMENT_ARRAY_BUFFER is VAO state and other targets are rare; both go straight
+    // to GL.
+    void bindBuffer(GLenum target, unsigned int id)
+    {
+        int slot = bufferSlot(target);
+        if (slot >= 0 && !changed(buffers[slot], id)) return;
+        if (slot < 0) ++stats.issued;
+        glBindBuffer(target, id);
+    }
+
+    // glBindBufferRange also binds the generic target.
+    void bindBufferRange(GLenum target, unsigned int index, unsigned int id, size_t offset, size_t size)
+    {
+        int slot = rangeSlot(target);
+        if (slot < 0 || index >= GL_STATE_BUFFER_INDICES) {
+            ++stats.issued;
+            glBindBufferRange(target, index, id, offset, size);
+            if (bufferSlot(target) >= 0) buffers[bufferSlot(target)] = id;
+            return;
+        }
+        Range& r = ranges[slot][index];
+        if (r.buffer == id && r.offset == offset && r.size == size) {
+            ++stats.elided;
+            return;
+        }
+        ++stats.issued;
+        glBindBufferRange(target, index, id, offset, size);
+        r.buffer = id;
+        r.offset = offset;
+        r.size = size;
+        buffers[bufferSlot(target)] = id;
+    }
+
+    // Only GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY are tracked; the active unit is left
+    // wherever the last bind needed it.
+    void bindTexture(unsigned int unit, GLenum target, unsigned int id)
+    {
+        int slot = target == GL_TEXTURE_2D ? 0 : target == GL_TEXTURE_2D_ARRAY ? 1 : -1;
+        if (slot >= 0 && unit < GL_STATE_TEXTURE_UNITS && !changed(textures[unit][slot], id)) return;
+        if (slot < 0 || unit >= GL_STATE_TEXTURE_UNITS) ++stats.issued;
+        activeTexture(unit);
+        glBindTexture(target, id);
+    }
+
+    void bindSampler(unsigned int unit, unsigned int id)
+    {
+        if (unit < GL_STATE_TEXTURE_UNITS && !changed(samplers[unit], id)) return;
+        if (unit >= GL_STATE_TEXTURE_UNITS) ++stats.issued;
+        glBindSampler(unit, id);
+    }
+
+    // GL_DEPTH_TEST, GL_BLEND and GL_CULL_FACE; anything else goes straight to GL.
+    void enable(GLenum cap, bool on)
+    {
+        int slot = cap == GL_DEPTH_TEST ? 0 : cap == GL_BLEND ? 1 : cap == GL_CULL_FACE ? 2 : -1;
+        if (slot >= 0) {
+            if (caps[slot] == (int)on) {
+                ++stats.elided;
+                return;
+            }
+            caps[slot] = on;
+        }
+        ++stats.issued;
+        if (on) glEnable(cap);
+        else glDisable(cap);
+    }
+
+    void depthFunc(GLenum func)
+    {
+        if (!changed(depthFuncValue, func)) return;
+        glDepthFunc(func);
+    }
+
+    void depthMask(bool write)
+    {
+        if (depthMaskValue == (int)write) {
+            ++stats.elided;
+            return;
+        }
+        ++stats.issued;
+        depthMaskValue = write;
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void blendFunc(GLenum src, GLenum dst) { blendFuncSeparate(src, dst, src, dst); }
+
+    void blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha)
+    {
+        if (blendFactors[0] == srcRGB && blendFactors[1] == dstRGB && blendFactors[2] == srcAlpha && blendFactors[3] == dstAlpha) {
+            ++stats.elided;
+            return;
+        }
+        ++stats.issued;
+        blendFactors[0] = srcRGB;
+        blendFactors[1] = dstRGB;
+        blendFactors[2] = srcAlpha;
+        blendFactors[3] = dstAlpha;
+        glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+    }
+
+private:
+    struct Range {
+        unsigned int buffer;
+        size_t offset, size;
+    };
+
+    unsigned int program, vao, activeUnit;
+    unsigned int buffers[6];   // bufferSlot() order
+    Range ranges[2][GL_STATE_BUFFER_INDICES]; // uniform, shader storage
+    unsigned int textures[GL_STATE_TEXTURE_UNITS][2]; // 2D, 2D array
+    unsigned int samplers[GL_STATE_TEXTURE_UNITS];
+    int caps[3];               // -1 unknown
+    GLenum depthFuncValue, blendFactors[4]; // src, dst RGB, then alpha
+    int depthMaskValue;
+
+    // Records `value` and says whether GL needs the call.
+    bool changed(unsigned int& current, unsigned int value)
+    {
+        if (current == value) {
+            ++stats.elided;
+            return false;
+        }
+        ++stats.issued;
+        current = value;
+        return true;
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if (activeUnit == unit) return; // not counted: part of the bind it serves
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+
+    static int bufferSlot(GLenum target)
+    {
+        switch (target) {
+        case GL_ARRAY_BUFFER: return 0;
+        case GL_COPY_READ_BUFFER: return 1;
+        case GL_COPY_WRITE_BUFFER: return 2;
+        case GL_DRAW_INDIRECT_BUFFER: return 3;
+        case GL_UNIFORM_BUFFER: return 4;
+        case GL_SHADER_STORAGE_BUFFER: return 5;
+        default: return -1;
+        }
+    }
+
+    static int rangeSlot(GLenum target)
+    {
+        return target == GL_UNIFORM_BUFFER ? 0 : target == GL_SHADER_STORAGE_BUFFER ? 1 : -1;
+    }
+};
+
+// The one context's cache.
+inline GLStateCache& glState()
+{
+    static GLStateCache cache;
+    return cache;
+}
+
+#endif
@@ -0,0 +1,527 @@
+#ifndef GPU_DRIVEN_H
+#define GPU_DRIVEN_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader_m.h>
+
+#include "lod.h"
+#include "model_asset.h"
+#include "gl_state.h"
+#include "render_queue.h"
+#include "ring_buffer.h"
+#include "vertex_quantize.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// --------- GPU-driven rendering ---------
+// Every model drawn this way lives in one shared geometry pool: one vertex buffer
+// (CompactVertex, re-quantized per mesh) and one index buffer, suballocated per model.
+// A frame is one command per (model, LOD, mesh) with all its instances, and
+// glMultiDrawElementsIndirect issues every command that samples the same texture array
+// in a single call. Per-draw data (vertex decode, array layer) and the instance
+// matrices are shader storage ranges of the stream ring (ring_buffer.h); each instance
+// carries (matrix, draw) indices in an instanced vertex attribute that the command's
+// baseInstance offsets, so no draw-parameters extension is needed. Needs GL 4.3
+// (llvmpipe has it); a model that is not resident or has a mesh whose diffuse texture
+// is not in an array yet is left to the caller (InstanceRenderer) that frame.
+// Objects are queued on worker threads into lanes (draw_lists.h) that only read the
+// pool; merge() adds them on the GL thread, and models the lanes found missing from the
+// pool are uploaded by uploadMissing() and drawn this way from the next frame on.
+#define GPU_DRIVEN true
+#define GEOMETRY_POOL_VERTICES (1 << 20) // initial capacities, doubled when full
+#define GEOMETRY_POOL_INDICES (1 << 22)
+#define GPU_REF_ATTRIB 11       // aRef in gpu_driven.vs
+#define GPU_MATRIX_BINDING 0    // shader storage binding of the instance matrices
+#define GPU_DRAW_BINDING 1      // shader storage binding of GpuDrawData
+#define GPU_POOL_EVICT_FRAMES 600 // pool space of models not drawn for this long is reused
+
+inline bool gpuDrivenSupported()
+{
+    return GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3);
+}
+
+// Layout fixed by glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// std430 `DrawData` of gpu_driven.vs.
+struct GpuDrawData {
+    glm::vec4 posOffset; // w = texture array layer
+    glm::vec4 posScale;  // w = 1 for octahedral normals
+};
+
+struct GpuDrivenStats {
+    size_t instances = 0;
+    size_t commands = 0;
+    size_t multiDraws = 0;
+    size_t fallbacks = 0; // objects left to the instanced path
+    double ms = 0.0;      // CPU time building and uploading the command list
+};
+
+// First-fit free list over [0, capacity) of one buffer.
+class RangeAllocator {
+public:
+    size_t capacity = 0;
+
+    bool allocate(size_t count, size_t& first)
+    {
+        for (size_t i = 0; i < free.size(); ++i)
+            if (free[i].second >= count) {
+                first = free[i].first;
+                free[i].first += count;
+                free[i].second -= count;
+                if (free[i].second == 0) free.erase(free.begin() + i);
+                return true;
+            }
+        return false;
+    }
+
+    void release(size_t first, size_t count)
+    {
+        if (count == 0) return;
+        auto it = std::lower_bound(free.begin(), free.end(), std::make_pair(first, (size_t)0));
+        it = free.insert(it, std::make_pair(first, count));
+        if (it + 1 != free.end() && it->first + it->second == (it + 1)->first) { // merge with the next range
+            it->second += (it + 1)->second;
+            free.erase(it + 1);
+        }
+        if (it != free.begin() && (it - 1)->first + (it - 1)->second == it->first) { // and the previous one
+            (it - 1)->second += it->second;
+            free.erase(it);
+        }
+    }
+
+    void grow(size_t newCapacity)
+    {
+        release(capacity, newCapacity - capacity);
+        capacity = newCapacity;
+    }
+
+private:
+    std::vector<std::pair<size_t, size_t>> free; // (first, count), sorted, never adjacent
+};
+
+class GeometryPool {
+public:
+    unsigned int vao = 0;
+
+    GeometryPool() {}
+    ~GeometryPool() { release(); }
+
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    // Frees the buffers; must run while the context is current.
+    void release()
+    {
+        if (vao) glDeleteVertexArrays(1, &vao);
+        if (vbo) glDeleteBuffers(1, &vbo);
+        if (ebo) glDeleteBuffers(1, &ebo);
+        glState().invalidate(); // any of them may still be bound
+        vao = vbo = ebo = 0;
+        vertexSpace = RangeAllocator();
+        indexSpace = RangeAllocator();
+    }
+
+    // Room for `vertices` and `indices`, growing the buffers if needed.
+    void allocate(size_t vertices, size_t indices, size_t& firstVertex, size_t& firstIndex)
+    {
+        if (!vao) create();
+        while (!vertexSpace.allocate(vertices, firstVertex))
+            growBuffer(vbo, GL_ARRAY_BUFFER, sizeof(CompactVertex), vertexSpace);
+        while (!indexSpace.allocate(indices, firstIndex))
+            growBuffer(ebo, GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int), indexSpace);
+    }
+
+    void free(size_t firstVertex, size_t vertices, size_t firstIndex, size_t indices)
+    {
+        vertexSpace.release(firstVertex, vertices);
+        indexSpace.release(firstIndex, indices);
+    }
+
+    void upload(size_t firstVertex, const std::vector<CompactVertex>& vertices, size_t firstIndex, const std::vector<unsigned int>& indices)
+    {
+        glState().bindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, firstVertex * sizeof(CompactVertex), vertices.size() * sizeof(CompactVertex), vertices.data());
+        glState().bindBuffer(GL_COPY_WRITE_BUFFER, ebo); // the element binding belongs to whatever VAO is bound
+        glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
+    }
+
+    size_t gpuBytes() const
+    {
+        return vertexSpace.capacity * sizeof(CompactVertex) + indexSpace.capacity * sizeof(unsigned int);
+    }
+
+private:
+    unsigned int vbo = 0, ebo = 0;
+    RangeAllocator vertexSpace, indexSpace;
+
+    void create()
+    {
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glState().bindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, GEOMETRY_POOL_VERTICES * sizeof(CompactVertex), NULL, GL_STATIC_DRAW);
+        glState().bindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        glBufferData(GL_COPY_WRITE_BUFFER, GEOMETRY_POOL_INDICES * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+        vertexSpace.grow(GEOMETRY_POOL_VERTICES);
+        indexSpace.grow(GEOMETRY_POOL_INDICES);
+        bindAttributes();
+    }
+
+    // Same attribute layout as makeCompactMesh (vertex_quantize.h).
+    void bindAttributes()
+    {
+        glState().bindVertexArray(vao);
+        glState().bindBuffer(GL_ARRAY_BUFFER, vbo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoords));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    }
+
+    // Doubles `buffer`, keeping its contents; the VAO is re-pointed at the new one.
+    void growBuffer(unsigned int& buffer, GLenum target, size_t elementSize, RangeAllocator& space)
+    {
+        size_t newCapacity = space.capacity * 2;
+        unsigned int bigger;
+        glGenBuffers(1, &bigger);
+        glState().bindBuffer(GL_COPY_WRITE_BUFFER, bigger);
+        glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * elementSize, NULL, GL_STATIC_DRAW);
+        glState().bindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, space.capacity * elementSize);
+        glDeleteBuffers(1, &buffer);
+        glState().forgetBuffer(buffer);
+        buffer = bigger;
+        space.grow(newCapacity);
+        bindAttributes();
+        std::cout << "Geometry pool: " << (target == GL_ARRAY_BUFFER ? "vertices" : "indices") << " grown to " << newCapacity << std::endl;
+    }
+};
+
+class GpuScene {
+    struct Entry;
+
+public:
+    // One worker's share of a frame, filled by add() and emptied by merge().
+    class Lane {
+    public:
+        void clear()
+        {
+            batches.clear();
+            index.clear();
+            missing.clear();
+        }
+
+    private:
+        friend class GpuScene;
+        std::vector<std::pair<std::pair<const Entry*, int>, std::vector<glm::mat4>>> batches;
+        std::map<std::pair<const Entry*, int>, size_t> index; // (entry, level) -> index into `batches`
+        std::vector<ModelAsset*> missing; // resident models not in the pool yet
+
+        std::vector<glm::mat4>& batchFor(const Entry* entry, int level)
+        {
+            auto key = std::make_pair(entry, level);
+            auto it = index.find(key);
+            if (it != index.end()) return batches[it->second].second;
+            index[key] = batches.size();
+            batches.push_back(std::make_pair(key, std::vector<glm::mat4>()));
+            return batches.back().second;
+        }
+    };
+
+    GpuScene() {}
+    ~GpuScene() { release(); }
+
+    GpuScene(const GpuScene&) = delete;
+    GpuScene& operator=(const GpuScene&) = delete;
+
+    // Frees the pool; must run while the context is current.
+    void release()
+    {
+        pool.release();
+        entries.clear();
+    }
+
+    // Starts a frame: empty batches, this frame's eye for LOD selection.
+    void begin(const glm::vec3& eye, float fovYRadians)
+    {
+        this->eye = eye;
+        this->fovY = fovYRadians;
+        ++frame;
+        for (auto& batch : batches) batch.matrices.clear();
+    }
+
+    // Queues one object into `lane`; false when it can't be drawn this way this frame
+    // (the caller draws it). `lodLevel` keeps its hysteresis state like submitModelLod's.
+    // Only reads the scene, so workers may call it concurrently with their own lanes.
+    bool add(Lane& lane, ModelAsset& model, const glm::mat4& transform, float maxScale, int& lodLevel) const
+    {
+        if (!model.resident || model.hasTransparentMeshes()) return false; // glass needs the transparent pass
+        auto it = entries.find(model.id);
+        if (it == entries.end() || it->second.version != model.version) {
+            if (lane.missing.empty() || lane.missing.back() != &model) lane.missing.push_back(&model);
+            return false;
+        }
+        const Entry& entry = it->second;
+        glm::vec3 center = glm::vec3(transform * glm::vec4(model.bounds.center, 1.0f));
+        float fraction = projectedScreenFraction(center, model.bounds.radius * maxScale, eye, fovY);
+        lodLevel = selectLod(model, fraction, lodLevel);
+        int level = std::min(lodLevel, (int)model.lodLevels.size());
+        for (const MeshSlot& slot : entry.levels[level])
+            if (!slot.diffuse || !slot.diffuse->arrayId) return false;
+        lane.batchFor(&entry, level).push_back(transform);
+        return true;
+    }
+
+    // Takes over what a lane queued; GL thread, lanes in a fixed order.
+    void merge(Lane& lane)
+    {
+        for (auto& batch : lane.batches) {
+            Entry* entry = const_cast<Entry*>(batch.first.first);
+            entry->lastFrame = frame;
+            std::vector<glm::mat4>& matrices = batchFor(entry, batch.first.second).matrices;
+            matrices.insert(matrices.end(), batch.second.begin(), batch.second.end());
+        }
+        missing.insert(missing.end(), lane.missing.begin(), lane.missing.end());
+        lane.clear();
+    }
+
+    // Uploads the models lanes found missing; after every lane of the frame is merged,
+    // since an upload may evict entries nobody has drawn this frame.
+    void uploadMissing()
+    {
+        for (ModelAsset* model : missing) resident(*model);
+        missing.clear();
+    }
+
+    // Streams this frame's instances and commands through `ring` and draws them with
+    // `shader` (gpu_driven.vs/fs), one multi-draw per texture array.
+    void draw(Shader& shader, StreamRing& ring, GpuDrivenStats& stats)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        matrices.clear();
+        refs.clear();
+        draws.clear();
+        std::map<unsigned int, std::vector<DrawElementsIndirectCommand>> byArray;
+        for (const auto& batch : batches) {
+            if (batch.matrices.empty()) continue;
+            GLuint firstMatrix = (GLuint)matrices.size();
+            matrices.insert(matrices.end(), batch.matrices.begin(), batch.matrices.end());
+            for (const MeshSlot& slot : batch.entry->levels[batch.level]) {
+                GLuint drawIndex = (GLuint)draws.size();
+                GpuDrawData data;
+                data.posOffset = glm::vec4(slot.decode.offset, (float)slot.diffuse->arrayLayer);
+                data.posScale = glm::vec4(slot.decode.scale, slot.decode.octahedralNormals ? 1.0f : 0.0f);
+                draws.push_back(data);
+                DrawElementsIndirectCommand command;
+                command.count = slot.indexCount;
+                command.instanceCount = (GLuint)batch.matrices.size();
+                command.firstIndex = slot.firstIndex;
+                command.baseVertex = slot.baseVertex;
+                command.baseInstance = (GLuint)refs.size();
+                for (GLuint i = 0; i < command.instanceCount; ++i)
+                    refs.push_back(glm::uvec2(firstMatrix + i, drawIndex));
+                byArray[slot.diffuse->arrayId].push_back(command);
+            }
+        }
+        if (draws.empty()) return;
+
+        commands.clear();
+        std::vector<std::pair<unsigned int, size_t>> groups; // texture array, command count
+        for (const auto& group : byArray) {
+            commands.insert(commands.end(), group.second.begin(), group.second.end());
+            groups.push_back(std::make_pair(group.first, group.second.size()));
+        }
+        RingAllocation refSlice = stream(ring, refs.data(), refs.size() * sizeof(glm::uvec2), sizeof(glm::uvec2));
+        RingAllocation matrixSlice = stream(ring, matrices.data(), matrices.size() * sizeof(glm::mat4), ring.storageAlignment());
+        RingAllocation drawSlice = stream(ring, draws.data(), draws.size() * sizeof(GpuDrawData), ring.storageAlignment());
+        RingAllocation commandSlice = stream(ring, commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint));
+        ring.flush();
+        bindRefs(refSlice);
+        stats.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+        GLStateCache& gl = glState();
+        gl.useProgram(shader.ID);
+        gl.bindBufferRange(GL_SHADER_STORAGE_BUFFER, GPU_MATRIX_BINDING, matrixSlice.buffer, matrixSlice.offset, matrices.size() * sizeof(glm::mat4));
+        gl.bindBufferRange(GL_SHADER_STORAGE_BUFFER, GPU_DRAW_BINDING, drawSlice.buffer, drawSlice.offset, draws.size() * sizeof(GpuDrawData));
+        gl.bindVertexArray(pool.vao);
+        gl.bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandSlice.buffer);
+        size_t offset = commandSlice.offset;
+        for (const auto& group : groups) {
+            bindTextureArray(group.first);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offset, (GLsizei)group.second, 0);
+            offset += group.second * sizeof(DrawElementsIndirectCommand);
+        }
+
+        stats.instances += matrices.size();
+        stats.commands += commands.size();
+        stats.multiDraws += groups.size();
+    }
+
+    size_t gpuBytes() const { return pool.gpuBytes(); }
+
+private:
+    struct MeshSlot {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+        VertexDecode decode;
+        const TextureAsset* diffuse; // its arrayId/layer are read every frame; arrays get rebuilt
+    };
+
+    // One model's meshes in the pool: one vertex and one index range for all its levels.
+    struct Entry {
+        unsigned int version = 0;
+        size_t firstVertex = 0, vertexCount = 0, firstIndex = 0, indexCount = 0;
+        std::vector<std::vector<MeshSlot>> levels; // [LOD][mesh]
+        unsigned int lastFrame = 0;
+    };
+
+    struct Batch {
+        Entry* entry;
+        int level;
+        std::vector<glm::mat4> matrices;
+    };
+
+    GeometryPool pool;
+    std::unordered_map<uint64_t, Entry> entries; // by ModelAsset::id, which (unlike its address) is never reused
+    std::vector<Batch> batches; // kept across frames, only the matrices reset
+    std::map<std::pair<const Entry*, int>, size_t> batchIndex;
+    std::vector<ModelAsset*> missing; // merged from lanes, for uploadMissing()
+    glm::vec3 eye = glm::vec3(0.0f);
+    float fovY = 1.0f;
+    unsigned int frame = 0;
+
+    std::vector<glm::mat4> matrices;
+    std::vector<glm::uvec2> refs;
+    std::vector<GpuDrawData> draws;
+    std::vector<DrawElementsIndirectCommand> commands;
+
+    // The pool entry of `model`, (re)built when the model was (re)loaded since.
+    Entry* resident(ModelAsset& model)
+    {
+        auto it = entries.find(model.id);
+        if (it != entries.end() && it->second.version == model.version) return &it->second;
+        if (it != entries.end()) evict(it);
+        Entry& entry = entries[model.id];
+        entry.version = model.version;
+        entry.lastFrame = frame;
+
+        std::vector<CompactVertex> vertices;
+        std::vector<unsigned int> indices;
+        std::vector<std::vector<MeshSlot>> levels(model.lodCount());
+        for (int lod = 0; lod < model.lodCount(); ++lod) {
+            const std::vector<int>& diffuse = lod == 0 ? model.meshDiffuse : model.lodDiffuse[lod - 1];
+            std::vector<Mesh>& meshes = model.level(lod);
+            for (size_t i = 0; i < meshes.size(); ++i) {
+                CompactMeshData compact = quantizeVertices(meshes[i].vertices);
+                MeshSlot slot;
+                slot.firstIndex = (GLuint)indices.size();
+                slot.indexCount = (GLuint)meshes[i].indices.size();
+                slot.baseVertex = (GLint)vertices.size();
+                slot.decode = compact.decode;
+                int ref = i < diffuse.size() ? diffuse[i] : -1;
+                slot.diffuse = ref >= 0 ? model.textureRefs[ref].get() : nullptr;
+                vertices.insert(vertices.end(), compact.vertices.begin(), compact.vertices.end());
+                indices.insert(indices.end(), meshes[i].indices.begin(), meshes[i].indices.end());
+                levels[lod].push_back(slot);
+            }
+        }
+        entry.vertexCount = vertices.size();
+        entry.indexCount = indices.size();
+        pool.allocate(entry.vertexCount, entry.indexCount, entry.firstVertex, entry.firstIndex);
+        pool.upload(entry.firstVertex, vertices, entry.firstIndex, indices);
+        for (auto& level : levels)
+            for (auto& slot : level) {
+                slot.firstIndex += (GLuint)entry.firstIndex;
+                slot.baseVertex += (GLint)entry.firstVertex;
+            }
+        entry.levels = std::move(levels);
+        evictStale();
+        return &entry;
+    }
+
+    // Models nobody drew for a while (unloaded, or replaced by a reload) give back
+    // their pool space; their ModelAsset may be gone, so only the key is compared.
+    void evictStale()
+    {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (frame - it->second.lastFrame > GPU_POOL_EVICT_FRAMES)
+                it = evict(it);
+            else
+                ++it;
+        }
+    }
+
+    std::unordered_map<uint64_t, Entry>::iterator evict(std::unordered_map<uint64_t, Entry>::iterator it)
+    {
+        Entry& entry = it->second;
+        pool.free(entry.firstVertex, entry.vertexCount, entry.firstIndex, entry.indexCount);
+        for (auto b = batchIndex.begin(); b != batchIndex.end();) { // batches point at the entry
+            if (b->first.first == &entry) {
+                batches[b->second].entry = nullptr;
+                batches[b->second].matrices.clear();
+                b = batchIndex.erase(b);
+            } else {
+                ++b;
+            }
+        }
+        return entries.erase(it);
+    }
+
+    Batch& batchFor(Entry* entry, int level)
+    {
+        auto it = batchIndex.find(std::make_pair(entry, level));
+        if (it != batchIndex.end()) return batches[it->second];
+        size_t index = batches.size();
+        for (size_t i = 0; i < batches.size(); ++i) // reuse a slot an evicted entry left
+            if (!batches[i].entry) { index = i; break; }
+        if (index == batches.size()) batches.push_back(Batch());
+        batches[index] = { entry, level, {} };
+        batchIndex[std::make_pair(entry, level)] = index;
+        return batches[index];
+    }
+
+    static RingAllocation stream(StreamRing& ring, const void* data, size_t bytes, size_t alignment)
+    {
+        RingAllocation slice = ring.allocate(bytes, alignment);
+        memcpy(slice.data, data, bytes);
+        return slice;
+    }
+
+    // (matrix, draw) per instance: an integer attribute stepped once per instance, so
+    // the command's baseInstance selects where each draw's run starts. The refs move
+    // through the ring every frame, so the attribute is re-pointed each time.
+    void bindRefs(const RingAllocation& refs)
+    {
+        glState().bindVertexArray(pool.vao);
+        glState().bindBuffer(GL_ARRAY_BUFFER, refs.buffer);
+        glEnableVertexAttribArray(GPU_REF_ATTRIB);
+        glVertexAttribIPointer(GPU_REF_ATTRIB, 2, GL_UNSIGNED_INT, sizeof(glm::uvec2), (void*)refs.offset);
+        glVertexAttribDivisor(GPU_REF_ATTRIB, 1);
+    }
+};
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef GROUND_H
+#define GROUND_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader_m.h>
+
+#include "frustum_culling.h"
+#include "gl_state.h"
+#include "render_queue.h"
+#include "ring_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+// --------- Tiled ground ---------
+// The ground is a window of square tiles around a focus point (the car) instead of one
+// scaled box: tiles within GROUND_RADIUS tiles are streamed in nearest first, at most
+// GROUND_LOADS_PER_FRAME per frame, and dropped once they are GROUND_UNLOAD_MARGIN tiles
+// beyond that, so the world has no edge and the ground costs the same every frame. All
+// tiles share one quad; the visible ones are a single instanced packet whose matrices
+// go through the stream ring. Texture coordinates repeat GROUND_TEXTURE_REPEAT times
+// per tile, independent of how far the ground reaches.
+#define GROUND_TILE_SIZE 16.0f
+#define GROUND_RADIUS 7            // tiles from the focus tile to the window's edge
+#define GROUND_UNLOAD_MARGIN 1
+#define GROUND_LOADS_PER_FRAME 16
+#define GROUND_HEIGHT -1.5f        // top of the old floor box
+#define GROUND_TEXTURE_REPEAT 4.0f
+
+struct GroundStats {
+    size_t resident = 0; // summed per frame like the rest
+    size_t drawn = 0;
+    size_t loaded = 0;
+    size_t unloaded = 0;
+};
+
+class GroundTiles {
+public:
+    GroundTiles() {}
+    ~GroundTiles() { release(); }
+
+    GroundTiles(const GroundTiles&) = delete;
+    GroundTiles& operator=(const GroundTiles&) = delete;
+
+    // Frees the quad; must run while the context is current.
+    void release()
+    {
+        if (vao) glDeleteVertexArrays(1, &vao);
+        if (vbo) glDeleteBuffers(1, &vbo);
+        if (ebo) glDeleteBuffers(1, &ebo);
+        vao = vbo = ebo = 0;
+        tiles.clear();
+    }
+
+    // Moves the window to `focus`: loads missing tiles nearest first, drops far ones.
+    void update(const glm::vec3& focus, GroundStats& stats)
+    {
+        int cx = (int)std::floor(focus.x / GROUND_TILE_SIZE);
+        int cz = (int)std::floor(focus.z / GROUND_TILE_SIZE);
+        for (auto it = tiles.begin(); it != tiles.end();) {
+            int d = std::max(std::abs(it->second.x - cx), std::abs(it->second.z - cz));
+            if (d > GROUND_RADIUS + GROUND_UNLOAD_MARGIN) {
+                it = tiles.erase(it);
+                ++stats.unloaded;
+            } else {
+                ++it;
+            }
+        }
+        int budget = GROUND_LOADS_PER_FRAME;
+        for (int ring = 0; ring <= GROUND_RADIUS && budget > 0; ++ring)
+            for (int z = cz - ring; z <= cz + ring && budget > 0; ++z)
+                for (int x = cx - ring; x <= cx + ring && budget > 0; ++x) {
+                    if (std::max(std::abs(x - cx), std::abs(z - cz)) != ring) continue; // the ring's border only
+                    if (tiles.count(key(x, z))) continue;
+                    tiles[key(x, z)] = makeTile(x, z);
+                    ++stats.loaded;
+                    --budget;
+                }
+        stats.resident += tiles.size();
+    }
+
+    // Queues the tiles inside `frustum` as one instanced packet with `shader` (floor.vs/fs)
+    // and `textures`.
+    void submit(RenderQueue& queue, Shader& shader, const std::vector<Texture>& textures, StreamRing& ring,
+                const Frustum& frustum, const glm::vec3& eye, GroundStats& stats)
+    {
+        if (!vao) create();
+        visible.clear();
+        float nearest = RENDER_QUEUE_FAR;
+        for (const auto& t : tiles) {
+            if (!frustum.boxVisible(t.second.center, t.second.extent)) continue;
+            visible.push_back(t.second.transform);
+            nearest = std::min(nearest, glm::length(t.second.center - eye));
+        }
+        if (visible.empty()) return;
+        RingAllocation slice = ring.allocate(visible.size() * sizeof(glm::mat4), sizeof(glm::mat4));
+        std::copy(visible.begin(), visible.end(), (glm::mat4*)slice.data);
+        ring.flush();
+
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.vao = vao;
+        packet.count = 6;
+        packet.textures = &textures;
+        packet.instanceBuffer = slice.buffer;
+        packet.instanceFirst = slice.offset / sizeof(glm::mat4);
+        packet.instances = (GLsizei)visible.size();
+        queue.submit(packet, RENDER_PASS_OPAQUE, nearest);
+        stats.drawn += visible.size();
+    }
+
+private:
+    struct Tile {
+        int x, z;
+        glm::mat4 transform;
+        glm::vec3 center, extent; // culling box
+    };
+
+    unsigned int vao = 0, vbo = 0, ebo = 0;
+    std::unordered_map<uint64_t, Tile> tiles;
+    std::vector<glm::mat4> visible;
+
+    static uint64_t key(int x, int z) { return (uint64_t)(uint32_t)x << 32 | (uint32_t)z; }
+
+    static Tile makeTile(int x, int z)
+    {
+        Tile tile;
+        tile.x = x;
+        tile.z = z;
+        glm::vec3 corner(x * GROUND_TILE_SIZE, GROUND_HEIGHT, z * GROUND_TILE_SIZE);
+        tile.transform = glm::scale(glm::translate(glm::mat4(1.0f), corner), glm::vec3(GROUND_TILE_SIZE, 1.0f, GROUND_TILE_SIZE));
+        tile.center = corner + glm::vec3(GROUND_TILE_SIZE * 0.5f, 0.0f, GROUND_TILE_SIZE * 0.5f);
+        tile.extent = glm::vec3(GROUND_TILE_SIZE * 0.5f, 0.01f, GROUND_TILE_SIZE * 0.5f);
+        return tile;
+    }
+
+    // Unit quad on y = 0 from (0, 0) to (1, 1), facing up; position then uv, like the
+    // old floor box, so floor.vs reads it unchanged.
+    void create()
+    {
+        const float r = GROUND_TEXTURE_REPEAT;
+        const float vertices[] = {
+            0.0f, 0.0f, 0.0f,  0.0f, 0.0f,
+            1.0f, 0.0f, 0.0f,  r,    0.0f,
+            1.0f, 0.0f, 1.0f,  r,    r,
+            0.0f, 0.0f, 1.0f,  0.0f, r,
+        };
+        const unsigned int indices[] = { 0, 2, 1, 0, 3, 2 };
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glState().bindVertexArray(vao);
+        glState().bindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    }
+};
+
+#endif
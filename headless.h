@@ -0,0 +1,314 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <dlfcn.h>
+#endif
+
+// --------- Headless rendering ---------
+// --headless runs the normal render loop without a window, for render benchmarks on
+// machines with no display or GPU (Mesa's llvmpipe). The context comes from EGL on
+// Mesa's surfaceless platform. libEGL is opened at run time, so the windowed build
+// neither links it nor needs its headers. The frame goes into an offscreen
+// framebuffer (HeadlessTarget) in place of the window's. Once everything has streamed
+// in, HEADLESS_WARMUP_FRAMES frames are skipped, then --frames N are timed to
+// glFinish. HeadlessRun prints their statistics and can write the last one as a PNG
+// (--capture out.png) for golden-image comparison. OSMesa isn't used: recent Mesa has
+// dropped it, and surfaceless EGL drives the same llvmpipe.
+#define HEADLESS_FRAMES 300        // timed frames, --frames
+#define HEADLESS_WARMUP_FRAMES 30  // after streaming, not timed
+
+// --------- EGL context ---------
+// The few EGL entry points and enums needed, declared here instead of <EGL/egl.h>.
+class HeadlessContext {
+public:
+    HeadlessContext() {}
+    ~HeadlessContext() { destroy(); }
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    // Makes a core `major`.`minor` context current with no surface; false (and a
+    // message) when EGL, the surfaceless platform or that version isn't there.
+    bool create(int major, int minor)
+    {
+#ifdef __linux__
+        if (!library && !load()) return false;
+        if (!display) {
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+            if (!display || !initialize(display, nullptr, nullptr)) {
+                std::cout << "Headless: Failed to open the EGL surfaceless platform" << std::endl;
+                display = nullptr;
+                return false;
+            }
+            bindAPI(EGL_OPENGL_API);
+        }
+        const int attributes[] = { EGL_CONTEXT_MAJOR_VERSION, major, EGL_CONTEXT_MINOR_VERSION, minor,
+                                   EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+        context = createContext(display, nullptr, nullptr, attributes); // no config (EGL_KHR_no_config_context)
+        if (!context || !makeCurrent(display, nullptr, nullptr, context)) {
+            if (context) destroyContext(display, context);
+            context = nullptr;
+            return false;
+        }
+        return true;
+#else
+        (void)major;
+        (void)minor;
+        std::cout << "Headless: Failed, needs EGL (Linux)" << std::endl;
+        return false;
+#endif
+    }
+
+    // For gladLoadGLLoader; Mesa hands out core GL functions here too.
+    static void* procAddress(const char* name) { return current ? current->getProcAddress(name) : nullptr; }
+
+    // Drops the context; every GL object should be freed before.
+    void destroy()
+    {
+#ifdef __linux__
+        if (context) {
+            makeCurrent(display, nullptr, nullptr, nullptr);
+            destroyContext(display, context);
+        }
+        if (display) terminate(display);
+        if (library) dlclose(library);
+#endif
+        if (current == this) current = nullptr;
+        library = display = context = nullptr;
+    }
+
+private:
+    enum {
+        EGL_NONE = 0x3038,
+        EGL_OPENGL_API = 0x30A2,
+        EGL_CONTEXT_MAJOR_VERSION = 0x3098,
+        EGL_CONTEXT_MINOR_VERSION = 0x30FB,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK = 0x30FD,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT = 0x0001,
+        EGL_PLATFORM_SURFACELESS_MESA = 0x31DD
+    };
+
+    typedef void* (*GetProcAddressFn)(const char*);
+    typedef void* (*GetPlatformDisplayFn)(unsigned int, void*, const intptr_t*);
+    typedef unsigned int (*InitializeFn)(void*, int*, int*);
+    typedef unsigned int (*TerminateFn)(void*);
+    typedef unsigned int (*BindAPIFn)(unsigned int);
+    typedef void* (*CreateContextFn)(void*, void*, void*, const int*);
+    typedef unsigned int (*DestroyContextFn)(void*, void*);
+    typedef unsigned int (*MakeCurrentFn)(void*, void*, void*, void*);
+
+    static inline HeadlessContext* current = nullptr;
+    void* library = nullptr;
+    void* display = nullptr;
+    void* context = nullptr;
+    GetProcAddressFn getProcAddress = nullptr;
+    GetPlatformDisplayFn getPlatformDisplay = nullptr;
+    InitializeFn initialize = nullptr;
+    TerminateFn terminate = nullptr;
+    BindAPIFn bindAPI = nullptr;
+    CreateContextFn createContext = nullptr;
+    DestroyContextFn destroyContext = nullptr;
+    MakeCurrentFn makeCurrent = nullptr;
+
+#ifdef __linux__
+    bool load()
+    {
+        library = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+        if (!library) {
+            std::cout << "Headless: Failed to load libEGL.so.1" << std::endl;
+            return false;
+        }
+        getProcAddress = (GetProcAddressFn)dlsym(library, "eglGetProcAddress");
+        getPlatformDisplay = (GetPlatformDisplayFn)dlsym(library, "eglGetPlatformDisplay"); // EGL 1.5
+        initialize = (InitializeFn)dlsym(library, "eglInitialize");
+        terminate = (TerminateFn)dlsym(library, "eglTerminate");
+        bindAPI = (BindAPIFn)dlsym(library, "eglBindAPI");
+        createContext = (CreateContextFn)dlsym(library, "eglCreateContext");
+        destroyContext = (DestroyContextFn)dlsym(library, "eglDestroyContext");
+        makeCurrent = (MakeCurrentFn)dlsym(library, "eglMakeCurrent");
+        if (!getProcAddress || !getPlatformDisplay || !initialize || !terminate || !bindAPI || !createContext
+            || !destroyContext || !makeCurrent) {
+            std::cout << "Headless: Failed, libEGL.so.1 lacks EGL 1.5" << std::endl;
+            dlclose(library);
+            library = nullptr;
+            return false;
+        }
+        current = this;
+        return true;
+    }
+#endif
+};
+
+// --------- Offscreen target ---------
+// What the window's framebuffer is to the windowed loop: color + depth/stencil, read back
+// for captures.
+class HeadlessTarget {
+public:
+    HeadlessTarget() {}
+    ~HeadlessTarget() { release(); }
+
+    HeadlessTarget(const HeadlessTarget&) = delete;
+    HeadlessTarget& operator=(const HeadlessTarget&) = delete;
+
+    int width = 0, height = 0;
+
+    // False when the framebuffer can't be made.
+    bool create(int width, int height)
+    {
+        release();
+        this->width = width;
+        this->height = height;
+        glGenRenderbuffers(2, buffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, buffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, buffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, buffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, buffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Headless: Failed to create the offscreen framebuffer" << std::endl;
+            release();
+            return false;
+        }
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    unsigned int framebuffer() const { return fbo; }
+
+    // Frees the framebuffer; must run while the context is current.
+    void release()
+    {
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        if (buffers[0]) glDeleteRenderbuffers(2, buffers);
+        fbo = buffers[0] = buffers[1] = 0;
+    }
+
+private:
+    unsigned int fbo = 0, buffers[2] = { 0, 0 };
+};
+
+// --------- PNG ---------
+// RGBA8 rows bottom-up as glReadPixels returns them -> 8-bit RGB PNG. The zlib stream
+// uses stored (uncompressed) blocks: no compressor to carry, and golden-image tools
+// only care about the pixels.
+inline uint32_t pngCrc(uint32_t crc, const uint8_t* data, size_t size)
+{
+    static uint32_t table[256];
+    if (!table[1])
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+inline bool writePng(const std::string& path, const std::vector<unsigned char>& rgba, int width, int height)
+{
+    // filter byte 0 + RGB per row, top row first
+    std::vector<uint8_t> raw;
+    raw.reserve((size_t)height * (width * 3 + 1));
+    for (int y = height - 1; y >= 0; --y) {
+        raw.push_back(0);
+        for (int x = 0; x < width; ++x) {
+            const unsigned char* p = &rgba[((size_t)y * width + x) * 4];
+            raw.insert(raw.end(), p, p + 3);
+        }
+    }
+    std::vector<uint8_t> z = { 0x78, 0x01 };
+    uint32_t a = 1, b = 0; // Adler-32
+    for (size_t offset = 0; offset < raw.size(); offset += 65535) {
+        size_t n = std::min<size_t>(65535, raw.size() - offset);
+        z.push_back(offset + n == raw.size() ? 1 : 0); // last block
+        z.push_back((uint8_t)n);
+        z.push_back((uint8_t)(n >> 8));
+        z.push_back((uint8_t)~n);
+        z.push_back((uint8_t)(~n >> 8));
+        z.insert(z.end(), raw.begin() + offset, raw.begin() + offset + n);
+        for (size_t i = offset; i < offset + n; ++i) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    uint32_t adler = b << 16 | a;
+    for (int s = 24; s >= 0; s -= 8) z.push_back((uint8_t)(adler >> s));
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Headless: Failed to write " << path << std::endl;
+        return false;
+    }
+    auto chunk = [&](const char* type, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> bytes(type, type + 4);
+        bytes.insert(bytes.end(), data.begin(), data.end());
+        uint32_t size = (uint32_t)data.size(), crc = pngCrc(0, bytes.data(), bytes.size());
+        const uint8_t sizeBytes[4] = { (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size };
+        const uint8_t crcBytes[4] = { (uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc };
+        file.write((const char*)sizeBytes, 4);
+        file.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+        file.write((const char*)crcBytes, 4);
+    };
+    file.write("\x89PNG\r\n\x1a\n", 8);
+    std::vector<uint8_t> header = { (uint8_t)(width >> 24), (uint8_t)(width >> 16), (uint8_t)(width >> 8), (uint8_t)width,
+                                    (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+                                    8, 2, 0, 0, 0 }; // 8 bits, RGB, deflate, no filter, no interlace
+    chunk("IHDR", header);
+    chunk("IDAT", z);
+    chunk("IEND", {});
+    return file.good();
+}
+
+// --------- Frame statistics ---------
+class HeadlessRun {
+public:
+    int frames = HEADLESS_FRAMES;
+    std::string capturePath; // empty: no capture
+
+    // Called after every frame once everything has streamed in, with the frame's wall
+    // time to glFinish; true once the timed frames are in.
+    bool frameDone(double ms)
+    {
+        if (warmup < HEADLESS_WARMUP_FRAMES) {
+            ++warmup;
+            return false;
+        }
+        times.push_back(ms);
+        return (int)times.size() >= frames;
+    }
+
+    void report(std::ostream& out, int width, int height) const
+    {
+        if (times.empty()) return;
+        std::vector<double> sorted = times;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (double t : sorted) sum += t;
+        auto percentile = [&](double p) { return sorted[std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5))]; };
+        double average = sum / sorted.size();
+        out << "Headless: " << sorted.size() << " frames at " << width << "x" << height << ", " << average << " ms average ("
+            << 1000.0 / average << " fps), " << percentile(0.5) << " median, " << percentile(0.95) << " p95, "
+            << percentile(0.99) << " p99, " << sorted.front() << " min, " << sorted.back() << " max" << std::endl;
+    }
+
+private:
+    int warmup = 0;
+    std::vector<double> times;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef HOT_RELOAD_H
+#define HOT_RELOAD_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "asset_loader.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// --------- Tunables ---------
+#define HOT_RELOAD_SETTLE_MS 250.0 // exporters write files in several passes; wait for quiet
+
+// --------- File watcher ---------
+// Watches a directory tree (inotify on Linux, a no-op elsewhere). poll() is cheap and
+// non-blocking; it returns each changed file once writes to it have settled.
+class FileWatcher {
+public:
+    explicit FileWatcher(const std::string& root)
+    {
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            std::cout << "Hot reload: inotify unavailable" << std::endl;
+            return;
+        }
+        addTree(root);
+        std::cout << "Hot reload: watching " << dirs.size() << " directories under " << root << std::endl;
+#else
+        (void)root;
+#endif
+    }
+
+    ~FileWatcher()
+    {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    std::vector<std::string> poll()
+    {
+        std::vector<std::string> settled;
+#ifdef __linux__
+        if (fd < 0) return settled;
+        double now = assetClockMs();
+
+        alignas(struct inotify_event) char buffer[4096];
+        while (true) {
+            ssize_t len = read(fd, buffer, sizeof(buffer));
+            if (len <= 0) break;
+            for (char* p = buffer; p < buffer + len;) {
+                const struct inotify_event* event = (const struct inotify_event*)p;
+                p += sizeof(struct inotify_event) + event->len;
+                auto dir = dirs.find(event->wd);
+                if (dir == dirs.end() || event->len == 0) continue;
+                std::string path = dir->second + "/" + event->name;
+                if (event->mask & IN_ISDIR) {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO)) addTree(path);
+                    continue;
+                }
+                pending[path] = now;
+            }
+        }
+
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (now - it->second >= HOT_RELOAD_SETTLE_MS) {
+                settled.push_back(it->first);
+                it = pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+#endif
+        return settled;
+    }
+
+private:
+#ifdef __linux__
+    int fd = -1;
+    std::unordered_map<int, std::string> dirs;      // watch descriptor -> directory
+    std::unordered_map<std::string, double> pending; // path -> time of last write
+
+    void addTree(const std::string& dir)
+    {
+        int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0) return;
+        dirs[wd] = dir;
+
+        DIR* d = opendir(dir.c_str());
+        if (!d) return;
+        while (struct dirent* entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") continue;
+            std::string child = dir + "/" + name;
+            struct stat st;
+            if (stat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) addTree(child);
+        }
+        closedir(d);
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef IMPOSTORS_H
+#define IMPOSTORS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader_m.h>
+
+#include "gl_state.h"
+#include "model_asset.h"
+#include "render_queue.h"
+#include "texture_baker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// --------- Octahedral impostors ---------
+// A building that covers only a few pixels is drawn as one textured quad. Offline
+// (--bake-impostors) every model is rendered from IMPOSTOR_GRID x IMPOSTOR_GRID view
+// directions over the upper hemisphere into an atlas, one IMPOSTOR_FRAME_SIZE frame per
+// direction, and written next to the model as <model>.impostor.dds, which the registry
+// streams like any baked texture. The directions are laid out hemi-octahedrally: a
+// direction maps to the cell it falls in, so the runtime (impostor.vs) finds the frame
+// nearest to its view direction with one encode and a floor. Below
+// IMPOSTOR_SCREEN_FRACTION instances switch from their coarsest LOD to the impostor;
+// within IMPOSTOR_FADE_BAND of it both are drawn, each dithering away the pixels the
+// other keeps (the fade is a per-instance attribute, INSTANCE_FADE_ATTRIB).
+#define IMPOSTORS true                  // default; --no-impostors turns them off
+#define IMPOSTOR_EXT ".impostor"        // the atlas is <model>.impostor.dds
+#define IMPOSTOR_GRID 8                 // frames per side of the atlas, as in impostor.vs
+#define IMPOSTOR_FRAME_SIZE 64          // pixels per frame side
+#define IMPOSTOR_SCREEN_FRACTION 0.03f  // below the coarsest LOD's switch (lod.h)
+#define IMPOSTOR_FADE_BAND 0.25f        // +-25% around the switch draws both
+#define IMPOSTOR_DILATE_PASSES 4        // empty texels take their neighbours' color, against dark mip edges
+
+// Upper hemisphere direction -> [0, 1]^2 (directions below the horizon clamp to it).
+inline glm::vec2 hemiOctEncode(glm::vec3 d)
+{
+    d.y = std::max(d.y, 0.0f);
+    d /= std::max(std::fabs(d.x) + d.y + std::fabs(d.z), 1e-6f);
+    return glm::vec2(d.x + d.z, d.x - d.z) * 0.5f + glm::vec2(0.5f);
+}
+
+inline glm::vec3 hemiOctDecode(const glm::vec2& uv)
+{
+    float u = uv.x * 2.0f - 1.0f, v = uv.y * 2.0f - 1.0f;
+    float x = (u + v) * 0.5f, z = (u - v) * 0.5f;
+    return glm::normalize(glm::vec3(x, 1.0f - std::fabs(x) - std::fabs(z), z));
+}
+
+// Direction frame (x, y) was baked from: the center of its cell, towards the viewer.
+inline glm::vec3 impostorFrameDirection(int x, int y)
+{
+    return hemiOctDecode(glm::vec2((x + 0.5f) / IMPOSTOR_GRID, (y + 0.5f) / IMPOSTOR_GRID));
+}
+
+// Image axes of the frame seen from `dir`, the same ones glm::lookAt picks for them.
+inline void impostorBasis(const glm::vec3& dir, glm::vec3& right, glm::vec3& up)
+{
+    glm::vec3 worldUp = std::fabs(dir.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    right = glm::normalize(glm::cross(-dir, worldUp));
+    up = glm::cross(right, -dir);
+}
+
+// 0 = mesh only, 1 = impostor only, in between both dither.
+inline float impostorFade(float screenFraction)
+{
+    float band = IMPOSTOR_SCREEN_FRACTION * IMPOSTOR_FADE_BAND;
+    return glm::clamp((IMPOSTOR_SCREEN_FRACTION + band - screenFraction) / (2.0f * band), 0.0f, 1.0f);
+}
+
+inline bool hasImpostor(const ModelAsset& model)
+{
+    return model.resident && model.impostor && model.impostor->resident;
+}
+
+// The quad every impostor draws: x, y in -1..1, placed in its frame's plane by impostor.vs.
+inline Mesh makeImpostorQuad()
+{
+    std::vector<Vertex> vertices(4);
+    const float corners[4][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+    for (int i = 0; i < 4; ++i) {
+        Vertex v = {};
+        v.Position = glm::vec3(corners[i][0], corners[i][1], 0.0f);
+        v.Normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        v.TexCoords = glm::vec2(corners[i][0] * 0.5f + 0.5f, corners[i][1] * 0.5f + 0.5f);
+        vertices[i] = v;
+    }
+    return Mesh(vertices, { 0, 1, 2, 0, 2, 3 }, {});
+}
+
+// --------- Bake ---------
+// Empty (alpha 0) texels take the average color of their covered neighbours, a ring
+// per pass, so mips and filtering do not pull the background into the silhouette.
+inline void dilateImpostorColors(std::vector<uint8_t>& rgba, int size)
+{
+    std::vector<uint8_t> covered(rgba.size() / 4);
+    for (size_t i = 0; i < covered.size(); ++i) covered[i] = rgba[i * 4 + 3] != 0;
+    for (int pass = 0; pass < IMPOSTOR_DILATE_PASSES; ++pass) {
+        std::vector<uint8_t> next = covered;
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x) {
+                size_t i = (size_t)y * size + x;
+                if (covered[i]) continue;
+                int sum[3] = {}, count = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int nx = x + dx, ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= size || ny >= size) continue;
+                        size_t n = (size_t)ny * size + nx;
+                        if (!covered[n]) continue;
+                        for (int c = 0; c < 3; ++c) sum[c] += rgba[n * 4 + c];
+                        ++count;
+                    }
+                if (!count) continue;
+                for (int c = 0; c < 3; ++c) rgba[i * 4 + c] = (uint8_t)(sum[c] / count);
+                next[i] = 1;
+            }
+        covered.swap(next);
+    }
+}
+
+// Renders `model` (resident, and its textures too) with `shader` (impostor_bake.vs/fs)
+// into an atlas, frame (x, y) from impostorFrameDirection(x, y) with an orthographic
+// view around the bounding sphere, and writes model.path + IMPOSTOR_EXT's baked image.
+// GL thread; leaves framebuffer 0 bound, the caller restores its viewport.
+inline bool bakeImpostor(ModelAsset& model, Shader& shader, bool compress = true)
+{
+    const int size = IMPOSTOR_GRID * IMPOSTOR_FRAME_SIZE;
+    GLuint fbo = 0, buffers[2] = { 0, 0 };
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(2, buffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, buffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+    glBindRenderbuffer(GL_RENDERBUFFER, buffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, buffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, buffers[1]);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    std::vector<uint8_t> pixels((size_t)size * size * 4);
+    if (complete) {
+        glState().depthMask(true);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        float r = model.bounds.radius;
+        glm::vec3 center = model.bounds.center;
+        glm::mat4 projection = glm::ortho(-r, r, -r, r, 0.0f, 2.0f * r);
+        RenderQueue queue;
+        RenderQueueStats stats;
+        for (int y = 0; y < IMPOSTOR_GRID; ++y)
+            for (int x = 0; x < IMPOSTOR_GRID; ++x) {
+                glm::vec3 dir = impostorFrameDirection(x, y), right, up;
+                impostorBasis(dir, right, up);
+                glm::mat4 view = glm::lookAt(center + dir * r, center, up);
+                glViewport(x * IMPOSTOR_FRAME_SIZE, y * IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE);
+                queue.begin();
+                model.submitLevel(0, queue, shader, queue.matrix(glm::mat4(1.0f)), 0.0f);
+                glState().useProgram(shader.ID);
+                shader.setMat4("viewProjection", projection * view);
+                queue.execute(stats);
+            }
+        glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    } else {
+        std::cout << "Impostor bake: framebuffer incomplete for " << model.path << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(2, buffers);
+    if (!complete) return false;
+
+    dilateImpostorColors(pixels, size);
+    return writeBakedImage(model.path + IMPOSTOR_EXT + BAKED_TEXTURE_EXT, pixels, size, size, compress);
+}
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader_m.h>
+
+#include "impostors.h"
+#include "lod.h"
+#include "model_asset.h"
+#include "ring_buffer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+// --------- Instanced rendering ---------
+// Objects that share a ModelAsset are collected per frame into batches keyed by
+// (model, LOD); every batch writes its model matrices into this frame's slice of the
+// stream ring (ring_buffer.h) and each mesh of the batch becomes one instanced packet in
+// the render queue. Draw calls scale with models x LODs x meshes, not with the number of
+// objects. GL 3.3 has no base instance, so the queue re-points the mat4 attribute
+// (INSTANCE_MATRIX_ATTRIB) at the batch's matrices before each draw. Callers only add
+// what survived frustum culling (frustum_culling.h); per-meshlet culling stays with the
+// non-instanced path (the car). Far objects may draw as impostors (impostors.h), a batch
+// of their own that shares one quad; while they fade, each instance's fade streams
+// next to the matrices, at INSTANCE_FADE_ATTRIB.
+#define INSTANCE_PLACEHOLDER_LEVEL -1
+#define INSTANCE_IMPOSTOR_LEVEL -2
+
+struct InstanceStats {
+    size_t instances = 0;
+    size_t batches = 0;
+    size_t drawCalls = 0;
+    size_t impostors = 0; // instances drawn as impostors, fading ones included
+};
+
+class InstanceRenderer {
+public:
+    InstanceRenderer() {}
+
+    InstanceRenderer(const InstanceRenderer&) = delete;
+    InstanceRenderer& operator=(const InstanceRenderer&) = delete;
+
+    // Starts a frame: empty batches, this frame's eye for LOD selection.
+    void begin(const glm::vec3& eye, float fovYRadians)
+    {
+        this->eye = eye;
+        this->fovY = fovYRadians;
+        for (auto& batch : batches) {
+            batch.matrices.clear();
+            batch.fades.clear();
+            batch.nearest = FLT_MAX;
+        }
+        frame = InstanceStats();
+    }
+
+    // Queues one object. `lodLevel` keeps its hysteresis state like submitModelLod's.
+    // With `impostors` a far object with a baked atlas draws as (or fades into) its
+    // impostor; only for renderers submitted with an impostor shader.
+    void add(ModelAsset& model, const glm::mat4& transform, float maxScale, int& lodLevel, bool impostors = false)
+    {
+        ++frame.instances;
+        glm::vec3 center = glm::vec3(transform * glm::vec4(model.bounds.center, 1.0f));
+        float radius = model.bounds.radius * maxScale;
+        float distance = std::max(0.0f, glm::length(center - eye) - radius);
+        if (!model.resident) {
+            glm::mat4 box = glm::translate(transform, model.bounds.center);
+            Batch& batch = batchFor(&model, INSTANCE_PLACEHOLDER_LEVEL);
+            batch.matrices.push_back(glm::scale(box, model.bounds.max - model.bounds.min));
+            batch.fades.push_back(0.0f);
+            batch.nearest = std::min(batch.nearest, distance);
+            return;
+        }
+        float fraction = projectedScreenFraction(center, radius, eye, fovY);
+        float fade = impostors && hasImpostor(model) ? impostorFade(fraction) : 0.0f;
+        if (fade > 0.0f) {
+            ++frame.impostors;
+            Batch& batch = batchFor(&model, INSTANCE_IMPOSTOR_LEVEL);
+            batch.matrices.push_back(transform);
+            batch.fades.push_back(fade);
+            batch.nearest = std::min(batch.nearest, distance);
+            if (fade >= 1.0f) return;
+        }
+        lodLevel = selectLod(model, fraction, lodLevel);
+        Batch& batch = batchFor(&model, std::min(lodLevel, (int)model.lodLevels.size()));
+        batch.matrices.push_back(transform);
+        batch.fades.push_back(fade);
+        batch.nearest = std::min(batch.nearest, distance);
+    }
+
+    // Whether add(..., true) would draw any of this object as an impostor.
+    bool impostorRange(const ModelAsset& model, const glm::mat4& transform, float maxScale) const
+    {
+        if (!hasImpostor(model)) return false;
+        glm::vec3 center = glm::vec3(transform * glm::vec4(model.bounds.center, 1.0f));
+        return impostorFade(projectedScreenFraction(center, model.bounds.radius * maxScale, eye, fovY)) > 0.0f;
+    }
+
+    // Takes over what `lane`, another renderer begun with the same eye (filled on a
+    // worker thread, see draw_lists.h), queued.
+    void merge(const InstanceRenderer& lane)
+    {
+        for (const auto& batch : lane.batches) {
+            if (batch.matrices.empty()) continue;
+            Batch& into = batchFor(batch.model, batch.level);
+            into.matrices.insert(into.matrices.end(), batch.matrices.begin(), batch.matrices.end());
+            into.fades.insert(into.fades.end(), batch.fades.begin(), batch.fades.end());
+            into.nearest = std::min(into.nearest, batch.nearest);
+        }
+        frame.instances += lane.frame.instances;
+        frame.impostors += lane.frame.impostors;
+    }
+
+    // Objects queued this frame.
+    size_t queued() const { return frame.instances; }
+
+    // Streams every queued matrix (and fade, if anything is fading) and queues one
+    // instanced packet per batch and mesh.
+    // `placeholder` is the unit box used for models that are still streaming in;
+    // impostor batches draw `impostorQuad` (makeImpostorQuad) with `impostorShader`.
+    void submit(RenderQueue& queue, Shader& shader, Mesh& placeholder, StreamRing& ring, InstanceStats& stats,
+                Shader* impostorShader = nullptr, Mesh* impostorQuad = nullptr)
+    {
+        size_t total = 0;
+        for (const auto& batch : batches) total += batch.matrices.size();
+        if (!total) return;
+        RingAllocation slice = ring.allocate(total * sizeof(glm::mat4), sizeof(glm::mat4));
+        glm::mat4* out = (glm::mat4*)slice.data;
+        for (const auto& batch : batches) out = std::copy(batch.matrices.begin(), batch.matrices.end(), out);
+        RingAllocation fadeSlice = {};
+        if (frame.impostors) {
+            fadeSlice = ring.allocate(total * sizeof(float), sizeof(float));
+            float* fadeOut = (float*)fadeSlice.data;
+            for (const auto& batch : batches) fadeOut = std::copy(batch.fades.begin(), batch.fades.end(), fadeOut);
+        }
+        ring.flush();
+        size_t first = 0; // instances into both slices
+        for (auto& batch : batches) {
+            if (batch.matrices.empty()) continue;
+            if (batch.level == INSTANCE_IMPOSTOR_LEVEL && (!impostorShader || !impostorQuad)) {
+                first += batch.matrices.size();
+                continue;
+            }
+            ++frame.batches;
+            bool single = batch.level == INSTANCE_PLACEHOLDER_LEVEL || batch.level == INSTANCE_IMPOSTOR_LEVEL;
+            size_t meshCount = single ? 1 : batch.model->level(batch.level).size();
+            for (size_t i = 0; i < meshCount; ++i) {
+                DrawPacket packet;
+                if (batch.level == INSTANCE_PLACEHOLDER_LEVEL) {
+                    packet.shader = &shader;
+                    packet.vao = placeholder.VAO;
+                    packet.count = (GLsizei)placeholder.indices.size();
+                    packet.textures = &placeholder.textures;
+                } else if (batch.level == INSTANCE_IMPOSTOR_LEVEL) {
+                    // the quad's "vertex decode" scales it to the bounding sphere
+                    batch.impostorTextures = { { batch.model->impostor->id, "texture_diffuse", "" } };
+                    batch.impostorDecode.offset = batch.model->bounds.center;
+                    batch.impostorDecode.scale = glm::vec3(batch.model->bounds.radius);
+                    packet.shader = impostorShader;
+                    packet.vao = impostorQuad->VAO;
+                    packet.count = (GLsizei)impostorQuad->indices.size();
+                    packet.textures = &batch.impostorTextures;
+                    packet.decode = &batch.impostorDecode;
+                } else {
+                    packet = batch.model->meshPacket(batch.level, i, shader);
+                }
+                packet.instanceBuffer = slice.buffer;
+                packet.instanceFirst = slice.offset / sizeof(glm::mat4) + first;
+                packet.fadeBuffer = fadeSlice.buffer;
+                packet.fadeFirst = fadeSlice.offset / sizeof(float) + first;
+                packet.instances = (GLsizei)batch.matrices.size();
+                queue.submit(packet, RENDER_PASS_OPAQUE, batch.nearest);
+                ++frame.drawCalls;
+            }
+            first += batch.matrices.size();
+        }
+        stats.instances += frame.instances;
+        stats.batches += frame.batches;
+        stats.drawCalls += frame.drawCalls;
+        stats.impostors += frame.impostors;
+    }
+
+private:
+    struct Batch {
+        ModelAsset* model;
+        int level;
+        std::vector<glm::mat4> matrices;
+        std::vector<float> fades; // per matrix, impostors.h
+        float nearest; // distance of the closest instance, for the sort key
+        std::vector<Texture> impostorTextures; // INSTANCE_IMPOSTOR_LEVEL: the atlas
+        VertexDecode impostorDecode;            // and the bounding sphere
+    };
+
+    std::vector<Batch> batches; // kept across frames, only the matrices reset
+    std::map<std::pair<const ModelAsset*, int>, size_t> batchIndex; // (model, level) -> index into `batches`
+    glm::vec3 eye = glm::vec3(0.0f);
+    float fovY = 1.0f;
+    InstanceStats frame;
+
+    Batch& batchFor(ModelAsset* model, int level)
+    {
+        auto it = batchIndex.find(std::make_pair(model, level));
+        if (it != batchIndex.end()) return batches[it->second];
+        batchIndex[std::make_pair(model, level)] = batches.size();
+        batches.push_back({ model, level, {}, {}, FLT_MAX, {}, VertexDecode() });
+        return batches.back();
+    }
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------- Job pool ---------
+// A few persistent threads for short per-frame work (culling, draw lists). The
+// calling thread takes chunks too, so parallelFor also works with zero workers.
+// Jobs must not start other jobs on the same pool.
+#define JOB_POOL_MAX_WORKERS 7
+
+class JobPool {
+public:
+    explicit JobPool(int workers = -1)
+    {
+        if (workers < 0)
+            workers = std::max(0, std::min(JOB_POOL_MAX_WORKERS, (int)std::thread::hardware_concurrency() - 1));
+        for (int i = 0; i < workers; ++i)
+            threads.emplace_back(&JobPool::workerLoop, this);
+    }
+
+    ~JobPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    JobPool(const JobPool&) = delete;
+    JobPool& operator=(const JobPool&) = delete;
+
+    // Threads that take chunks, the caller included.
+    int threadCount() const { return (int)threads.size() + 1; }
+
+    // Calls fn(begin, end) over [0, count) in chunks of `chunk`; returns when all ran.
+    void parallelFor(size_t count, size_t chunk, const std::function<void(size_t, size_t)>& fn)
+    {
+        if (count == 0) return;
+        chunk = std::max<size_t>(chunk, 1);
+        if (threads.empty() || count <= chunk) {
+            fn(0, count);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobCount = count;
+            jobChunk = chunk;
+            next = 0;
+            busy = (int)threads.size();
+            ++generation;
+        }
+        wake.notify_all();
+        runChunks();
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+        job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool quit = false;
+    unsigned int generation = 0; // bumped per parallelFor, under `mutex`
+    int busy = 0;                // workers still in the current job, under `mutex`
+
+    const std::function<void(size_t, size_t)>* job = nullptr;
+    size_t jobCount = 0;
+    size_t jobChunk = 0;
+    std::atomic<size_t> next{0};
+
+    void runChunks()
+    {
+        while (true) {
+            size_t begin = next.fetch_add(jobChunk);
+            if (begin >= jobCount) return;
+            (*job)(begin, std::min(begin + jobChunk, jobCount));
+        }
+    }
+
+    void workerLoop()
+    {
+        unsigned int seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return quit || generation != seen; });
+                if (quit) return;
+                seen = generation;
+            }
+            runChunks();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) done.notify_one();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,413 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "model_asset.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// --------- Tunables ---------
+#define LOD_HYSTERESIS 0.15f      // +-15% band around each switch threshold
+#define LOD_BORDER_WEIGHT 10.0f   // keeps open edges (windows, car underside) from caving in
+
+// Fraction of the original triangle count kept at each level.
+static const float kLodTriangleRatios[LOD_MAX_LEVELS] = { 1.0f, 0.5f, 0.25f, 0.1f };
+
+// Switch to level i+1 once the object covers less than this fraction of the screen height.
+static const float kLodScreenFractions[LOD_MAX_LEVELS - 1] = { 0.30f, 0.15f, 0.06f };
+
+// --------- Quadric error metric simplification ---------
+// Garland & Heckbert edge collapse. Vertices are welded by position first (the OBJ
+// exports split every UV/normal seam), collapses move one endpoint onto the other so
+// surviving vertices keep their original attributes, and a collapse is rejected if
+// it would flip any surrounding triangle. Each triangle corner keeps a vertex of its
+// own attribute chart (same normal and UV as the corner had): a collapse is only taken
+// if every chart around the moving vertex finds its vertex at the target across the
+// collapsed edge, so seams and hard edges only ever collapse along themselves, and
+// their edges get the same weighted planes as open borders.
+struct QemQuadric {
+    double a[10]; // upper triangle of the symmetric 4x4: xx xy xz xw yy yz yw zz zw ww
+
+    QemQuadric() { memset(a, 0, sizeof(a)); }
+
+    void addPlane(const glm::vec3& n, float d, float weight)
+    {
+        double x = n.x, y = n.y, z = n.z, w = d;
+        a[0] += weight * x * x; a[1] += weight * x * y; a[2] += weight * x * z; a[3] += weight * x * w;
+        a[4] += weight * y * y; a[5] += weight * y * z; a[6] += weight * y * w;
+        a[7] += weight * z * z; a[8] += weight * z * w;
+        a[9] += weight * w * w;
+    }
+
+    void add(const QemQuadric& o)
+    {
+        for (int i = 0; i < 10; ++i) a[i] += o.a[i];
+    }
+
+    double error(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+                 + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+                 + a[7] * z * z + 2.0 * a[8] * z
+                 + a[9];
+        return e > 0.0 ? e : 0.0;
+    }
+};
+
+struct QemCollapse {
+    double cost;
+    unsigned int from, to;          // welded vertex ids, `from` collapses onto `to`
+    unsigned int stampFrom, stampTo;
+    bool operator>(const QemCollapse& o) const { return cost > o.cost; }
+};
+
+struct PositionKeyHash {
+    size_t operator()(const glm::vec3& p) const
+    {
+        uint32_t h[3];
+        memcpy(h, &p.x, sizeof(h));
+        return (size_t)h[0] * 73856093u ^ (size_t)h[1] * 19349663u ^ (size_t)h[2] * 83492791u;
+    }
+};
+
+// Position, normal and UV of a vertex: equal keys are the same point of the same chart.
+struct AttributeKey {
+    float v[8];
+
+    explicit AttributeKey(const Vertex& vertex)
+    {
+        memcpy(v, &vertex.Position, sizeof(float) * 3);
+        memcpy(v + 3, &vertex.Normal, sizeof(float) * 3);
+        memcpy(v + 6, &vertex.TexCoords, sizeof(float) * 2);
+    }
+    bool operator==(const AttributeKey& o) const { return memcmp(v, o.v, sizeof(v)) == 0; }
+};
+
+struct AttributeKeyHash {
+    size_t operator()(const AttributeKey& k) const
+    {
+        uint32_t h[8];
+        memcpy(h, k.v, sizeof(h));
+        size_t hash = 0;
+        for (uint32_t x : h) hash = hash * 1000003u ^ x;
+        return hash;
+    }
+};
+
+// Returns a new index buffer (into the same vertex array) with at most
+// `targetTriangles` triangles, or fewer collapses if the mesh runs out of legal ones.
+inline std::vector<unsigned int> simplifyIndicesQEM(const std::vector<Vertex>& vertices,
+                                                   const std::vector<unsigned int>& indices,
+                                                   size_t targetTriangles)
+{
+    const size_t triCount = indices.size() / 3;
+
+    // weld by exact position, and by position + normal + UV for the charts
+    std::unordered_map<glm::vec3, unsigned int, PositionKeyHash> weldLookup;
+    std::unordered_map<AttributeKey, unsigned int, AttributeKeyHash> attributeLookup;
+    std::vector<unsigned int> weld(vertices.size());
+    std::vector<unsigned int> attribute(vertices.size());
+    std::vector<glm::vec3> pos;
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        auto it = weldLookup.find(vertices[i].Position);
+        if (it == weldLookup.end()) {
+            unsigned int id = (unsigned int)pos.size();
+            weldLookup.emplace(vertices[i].Position, id);
+            pos.push_back(vertices[i].Position);
+            weld[i] = id;
+        } else {
+            weld[i] = it->second;
+        }
+        attribute[i] = attributeLookup.emplace(AttributeKey(vertices[i]), (unsigned int)attributeLookup.size()).first->second;
+    }
+    const size_t weldCount = pos.size();
+
+    // the original vertex each corner currently draws; collapses rewrite it within its chart
+    std::vector<unsigned int> cornerVertex(indices.begin(), indices.begin() + triCount * 3);
+
+    std::vector<unsigned int> parent(weldCount);
+    for (size_t i = 0; i < weldCount; ++i) parent[i] = (unsigned int)i;
+    auto find = [&parent](unsigned int w) {
+        while (parent[w] != w) {
+            parent[w] = parent[parent[w]];
+            w = parent[w];
+        }
+        return w;
+    };
+    auto corner = [&](size_t t, int k) { return find(weld[indices[t * 3 + k]]); };
+
+    // face quadrics + per-vertex triangle lists
+    std::vector<QemQuadric> quadrics(weldCount);
+    std::vector<std::vector<unsigned int>> vertexTris(weldCount);
+    std::vector<char> triDead(triCount, 0);
+    std::unordered_map<uint64_t, int> edgeUse;
+    auto edgeKey = [](unsigned int a, unsigned int b) {
+        if (a > b) std::swap(a, b);
+        return ((uint64_t)a << 32) | b;
+    };
+    size_t liveTris = 0;
+    for (size_t t = 0; t < triCount; ++t) {
+        unsigned int w0 = corner(t, 0), w1 = corner(t, 1), w2 = corner(t, 2);
+        glm::vec3 n = glm::cross(pos[w1] - pos[w0], pos[w2] - pos[w0]);
+        float area = glm::length(n);
+        if (w0 == w1 || w1 == w2 || w0 == w2 || area <= 0.0f) {
+            triDead[t] = 1;
+            continue;
+        }
+        n = n / area;
+        float d = -glm::dot(n, pos[w0]);
+        quadrics[w0].addPlane(n, d, area);
+        quadrics[w1].addPlane(n, d, area);
+        quadrics[w2].addPlane(n, d, area);
+        vertexTris[w0].push_back((unsigned int)t);
+        vertexTris[w1].push_back((unsigned int)t);
+        vertexTris[w2].push_back((unsigned int)t);
+        edgeUse[edgeKey(w0, w1)]++;
+        edgeUse[edgeKey(w1, w2)]++;
+        edgeUse[edgeKey(w2, w0)]++;
+        ++liveTris;
+    }
+
+    // seam edges: the triangles on either side disagree on an endpoint's attributes
+    std::unordered_map<uint64_t, uint64_t> edgeCharts; // edge -> attributes of its lower, higher end
+    std::unordered_map<uint64_t, bool> seams;
+    for (size_t t = 0; t < triCount; ++t) {
+        if (triDead[t]) continue;
+        for (int k = 0; k < 3; ++k) {
+            unsigned int a = corner(t, k), b = corner(t, (k + 1) % 3);
+            uint64_t ia = attribute[indices[t * 3 + k]], ib = attribute[indices[t * 3 + (k + 1) % 3]];
+            uint64_t charts = a < b ? ia << 32 | ib : ib << 32 | ia;
+            auto it = edgeCharts.emplace(edgeKey(a, b), charts).first;
+            if (it->second != charts) seams[edgeKey(a, b)] = true;
+        }
+    }
+
+    // border and seam edges get a heavily weighted plane perpendicular to the face
+    for (size_t t = 0; t < triCount; ++t) {
+        if (triDead[t]) continue;
+        unsigned int w[3] = { corner(t, 0), corner(t, 1), corner(t, 2) };
+        glm::vec3 n = glm::normalize(glm::cross(pos[w[1]] - pos[w[0]], pos[w[2]] - pos[w[0]]));
+        for (int k = 0; k < 3; ++k) {
+            unsigned int a = w[k], b = w[(k + 1) % 3];
+            if (edgeUse[edgeKey(a, b)] != 1 && !seams.count(edgeKey(a, b))) continue;
+            glm::vec3 e = pos[b] - pos[a];
+            float len = glm::length(e);
+            if (len <= 0.0f) continue;
+            glm::vec3 bn = glm::normalize(glm::cross(e, n));
+            float d = -glm::dot(bn, pos[a]);
+            quadrics[a].addPlane(bn, d, LOD_BORDER_WEIGHT * len * len);
+            quadrics[b].addPlane(bn, d, LOD_BORDER_WEIGHT * len * len);
+        }
+    }
+
+    std::vector<unsigned int> stamp(weldCount, 0);
+    std::priority_queue<QemCollapse, std::vector<QemCollapse>, std::greater<QemCollapse>> heap;
+    auto pushEdge = [&](unsigned int a, unsigned int b) {
+        QemQuadric q = quadrics[a];
+        q.add(quadrics[b]);
+        double ea = q.error(pos[a]); // b collapses onto a
+        double eb = q.error(pos[b]); // a collapses onto b
+        if (ea <= eb) heap.push({ ea, b, a, stamp[b], stamp[a] });
+        else          heap.push({ eb, a, b, stamp[a], stamp[b] });
+    };
+    for (const auto& e : edgeUse)
+        pushEdge((unsigned int)(e.first >> 32), (unsigned int)(e.first & 0xffffffffu));
+
+    std::vector<unsigned int> neighbours;
+    std::vector<std::pair<unsigned int, unsigned int>> chartTargets; // attribute at u -> vertex at v
+    auto cornerOf = [&](size_t t, unsigned int w) {
+        for (int k = 0; k < 3; ++k)
+            if (corner(t, k) == w) return k;
+        return -1;
+    };
+    auto chartTarget = [&chartTargets](unsigned int chart) {
+        for (const auto& c : chartTargets)
+            if (c.first == chart) return (int)c.second;
+        return -1;
+    };
+    while (liveTris > targetTriangles && !heap.empty()) {
+        QemCollapse c = heap.top();
+        heap.pop();
+        unsigned int u = c.from, v = c.to;
+        if (find(u) != u || find(v) != v) continue;
+        if (stamp[u] != c.stampFrom || stamp[v] != c.stampTo) continue;
+
+        // reject collapses that flip a surviving triangle
+        bool flips = false;
+        for (unsigned int t : vertexTris[u]) {
+            if (triDead[t]) continue;
+            unsigned int w[3] = { corner(t, 0), corner(t, 1), corner(t, 2) };
+            if (w[0] == v || w[1] == v || w[2] == v) continue;
+            glm::vec3 p[3] = { pos[w[0]], pos[w[1]], pos[w[2]] };
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            for (int k = 0; k < 3; ++k)
+                if (w[k] == u) p[k] = pos[v];
+            glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if (glm::dot(before, after) <= 0.0f) {
+                flips = true;
+                break;
+            }
+        }
+        if (flips) continue;
+
+        // every chart at u takes the vertex its own side of the edge has at v
+        chartTargets.clear();
+        bool torn = false;
+        for (unsigned int t : vertexTris[u]) {
+            int kv = triDead[t] ? -1 : cornerOf(t, v);
+            if (kv < 0) continue;
+            unsigned int chart = attribute[cornerVertex[t * 3 + cornerOf(t, u)]];
+            unsigned int target = cornerVertex[t * 3 + kv];
+            int known = chartTarget(chart);
+            if (known < 0) chartTargets.push_back({ chart, target });
+            else if (attribute[known] != attribute[target]) torn = true; // v is split inside u's chart
+        }
+        for (unsigned int t : vertexTris[u])
+            if (!triDead[t] && chartTarget(attribute[cornerVertex[t * 3 + cornerOf(t, u)]]) < 0) torn = true;
+        if (torn) continue;
+
+        for (unsigned int t : vertexTris[u]) {
+            if (triDead[t]) continue;
+            int ku = cornerOf(t, u);
+            cornerVertex[t * 3 + ku] = (unsigned int)chartTarget(attribute[cornerVertex[t * 3 + ku]]);
+        }
+        parent[u] = v;
+        quadrics[v].add(quadrics[u]);
+        ++stamp[u];
+        ++stamp[v];
+        for (unsigned int t : vertexTris[u]) {
+            if (triDead[t]) continue;
+            unsigned int w0 = corner(t, 0), w1 = corner(t, 1), w2 = corner(t, 2);
+            if (w0 == w1 || w1 == w2 || w0 == w2) {
+                triDead[t] = 1;
+                --liveTris;
+            } else {
+                vertexTris[v].push_back(t);
+            }
+        }
+        vertexTris[u].clear();
+        vertexTris[u].shrink_to_fit();
+
+        // drop dead triangles from v's list and requeue its edges
+        std::vector<unsigned int>& vt = vertexTris[v];
+        size_t keep = 0;
+        neighbours.clear();
+        for (unsigned int t : vt) {
+            if (triDead[t]) continue;
+            vt[keep++] = t;
+            for (int k = 0; k < 3; ++k) {
+                unsigned int w = corner(t, k);
+                if (w != v && std::find(neighbours.begin(), neighbours.end(), w) == neighbours.end())
+                    neighbours.push_back(w);
+            }
+        }
+        vt.resize(keep);
+        for (unsigned int n : neighbours) pushEdge(v, n);
+    }
+
+    std::vector<unsigned int> out;
+    out.reserve(liveTris * 3);
+    for (size_t t = 0; t < triCount; ++t) {
+        if (triDead[t]) continue;
+        for (int k = 0; k < 3; ++k) out.push_back(cornerVertex[t * 3 + k]);
+    }
+    return out;
+}
+
+// Drops vertices no longer referenced by `indices` and rewrites the indices to match.
+inline void compactVertices(const std::vector<Vertex>& inVertices, std::vector<unsigned int>& indices,
+                            std::vector<Vertex>& outVertices)
+{
+    std::vector<unsigned int> remap(inVertices.size(), UINT32_MAX);
+    outVertices.clear();
+    for (auto& i : indices) {
+        if (remap[i] == UINT32_MAX) {
+            remap[i] = (unsigned int)outVertices.size();
+            outVertices.push_back(inVertices[i]);
+        }
+        i = remap[i];
+    }
+}
+
+// --------- LOD levels ---------
+// Vertex/index data for one mesh of one level; `sourceMesh` is the LOD 0 mesh it came
+// from (and whose textures it shares).
+struct LodMeshData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    size_t sourceMesh;
+};
+
+// CPU half of the bake, safe on a worker thread: levels 1..LOD_MAX_LEVELS-1 for every
+// mesh in `base`. Result [l - 1] holds the meshes of LOD l.
+inline std::vector<std::vector<LodMeshData>> simplifyLodLevels(const std::vector<LodMeshData>& base)
+{
+    std::vector<std::vector<LodMeshData>> levels;
+    for (int level = 1; level < LOD_MAX_LEVELS; ++level) {
+        std::vector<LodMeshData> meshes;
+        for (const auto& mesh : base) {
+            size_t target = (size_t)(mesh.indices.size() / 3 * kLodTriangleRatios[level]);
+            LodMeshData out;
+            out.indices = simplifyIndicesQEM(mesh.vertices, mesh.indices, target);
+            if (out.indices.empty()) continue;
+            compactVertices(mesh.vertices, out.indices, out.vertices);
+            out.sourceMesh = mesh.sourceMesh;
+            meshes.push_back(std::move(out));
+        }
+        levels.push_back(std::move(meshes));
+    }
+    return levels;
+}
+
+inline void logLodLevels(const ModelAsset& model, const std::string& name)
+{
+    std::cout << "LOD " << name << ":";
+    for (int i = 0; i < model.lodCount(); ++i) std::cout << " " << model.lodTriangles[i];
+    std::cout << " tris" << std::endl;
+}
+
+inline void submitLod(ModelAsset& model, int level, RenderQueue& queue, Shader& shader, int matrix, float distance)
+{
+    level = std::max(0, std::min(level, (int)model.lodLevels.size()));
+    model.submitLevel(level, queue, shader, matrix, distance);
+}
+
+// --------- Runtime selection ---------
+// Fraction of the screen height covered by a sphere of `radius` at `center`.
+inline float projectedScreenFraction(const glm::vec3& center, float radius, const glm::vec3& eye, float fovYRadians)
+{
+    float dist = glm::length(center - eye);
+    if (dist <= radius) return 1.0f;
+    return radius / (dist * tanf(fovYRadians * 0.5f));
+}
+
+// Picks a level from the projected size. `current` is the level used last frame;
+// a switch only happens once the size leaves the hysteresis band, so objects sitting
+// right at a threshold don't pop back and forth every frame.
+inline int selectLod(const ModelAsset& model, float screenFraction, int current)
+{
+    int level = 0;
+    while (level < model.lodCount() - 1) {
+        float threshold = kLodScreenFractions[level];
+        if (level < current)      threshold *= 1.0f + LOD_HYSTERESIS; // stay coarse until clearly bigger
+        else                       threshold *= 1.0f - LOD_HYSTERESIS; // stay fine until clearly smaller
+        if (screenFraction >= threshold) break;
+        ++level;
+    }
+    return level;
+}
+
+#endif
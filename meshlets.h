@@ -0,0 +1,305 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include "model_asset.h"
+#include "lod.h"
+
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// --------- Tunables ---------
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+#define MESHLET_CONE_WEIGHT 2.0f  // growth: one extra vertex is worth this much facing agreement
+#define MESHLET_MIN_TRIANGLES 16     // past this size a cluster stops taking
+#define MESHLET_MIN_GROW_DOT 0.5f    // triangles that face more than 60 degrees off its average
+#define MESHLET_MIN_CONE_DOT 0.1f // flatter clusters than this never get back-face culled
+#define MESHLET_CONE_CULLING 0    // only for closed, single-sided meshes; nothing enables GL_CULL_FACE
+
+// --------- Build (worker threads) ---------
+// Splits a mesh into meshlets and reorders `indices` so each meshlet is one contiguous
+// range. Triangles are grown greedily from a seed, taking the neighbour that adds the
+// fewest new vertices and bends the cluster's average normal the least, which keeps
+// clusters compact and their normal cones tight enough to be back-face culled.
+// Vertices are counted by position: assimp hands out three unshared vertices per
+// triangle, so counting indices would cap a meshlet at 21 triangles.
+inline std::vector<Meshlet> buildMeshlets(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    const size_t triCount = indices.size() / 3;
+    std::vector<Meshlet> meshlets;
+    if (triCount == 0) return meshlets;
+
+    std::unordered_map<glm::vec3, unsigned int, PositionKeyHash> weldLookup;
+    std::vector<unsigned int> weld(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        weld[i] = weldLookup.emplace(vertices[i].Position, (unsigned int)weldLookup.size()).first->second;
+
+    std::vector<std::vector<unsigned int>> vertexTris(weldLookup.size());
+    std::vector<glm::vec3> centroids(triCount);
+    std::vector<glm::vec3> faceNormals(triCount, glm::vec3(0.0f));
+    for (size_t t = 0; t < triCount; ++t) {
+        const glm::vec3& a = vertices[indices[t * 3]].Position;
+        const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+        const glm::vec3& c = vertices[indices[t * 3 + 2]].Position;
+        for (int k = 0; k < 3; ++k) vertexTris[weld[indices[t * 3 + k]]].push_back((unsigned int)t);
+        centroids[t] = (a + b + c) / 3.0f;
+        glm::vec3 n = glm::cross(b - a, c - a);
+        if (glm::length(n) > 1e-12f) faceNormals[t] = glm::normalize(n);
+    }
+
+    std::vector<bool> used(triCount, false);
+    std::vector<int> vertexStamp(weldLookup.size(), -1); // meshlet that already holds the vertex
+    std::vector<unsigned int> ordered;
+    ordered.reserve(indices.size());
+    size_t seedCursor = 0;
+
+    auto newVertices = [&](size_t t, int stamp) {
+        int count = 0;
+        for (int k = 0; k < 3; ++k)
+            if (vertexStamp[weld[indices[t * 3 + k]]] != stamp) ++count;
+        return count;
+    };
+
+    while (true) {
+        while (seedCursor < triCount && used[seedCursor]) ++seedCursor;
+        if (seedCursor == triCount) break;
+
+        int stamp = (int)meshlets.size();
+        std::vector<unsigned int> tris;
+        std::vector<unsigned int> candidates;
+        int vertexCount = 0;
+        glm::vec3 centroidSum(0.0f);
+        glm::vec3 normalSum(0.0f);
+        size_t next = seedCursor;
+
+        while (true) {
+            vertexCount += newVertices(next, stamp);
+            used[next] = true;
+            tris.push_back((unsigned int)next);
+            centroidSum += centroids[next];
+            normalSum += faceNormals[next];
+            for (int k = 0; k < 3; ++k) {
+                unsigned int v = weld[indices[next * 3 + k]];
+                if (vertexStamp[v] == stamp) continue;
+                vertexStamp[v] = stamp;
+                for (unsigned int n : vertexTris[v])
+                    if (!used[n]) candidates.push_back(n);
+            }
+            if (tris.size() >= MESHLET_MAX_TRIANGLES) break;
+
+            // best neighbour, or the nearest free triangle if the cluster is an island
+            glm::vec3 axis = glm::length(normalSum) > 1e-6f ? glm::normalize(normalSum) : glm::vec3(0.0f);
+            size_t best = triCount;
+            float bestScore = FLT_MAX;
+            for (unsigned int c : candidates) {
+                if (used[c]) continue;
+                int added = newVertices(c, stamp);
+                if (vertexCount + added > MESHLET_MAX_VERTICES) continue;
+                if (tris.size() >= MESHLET_MIN_TRIANGLES && glm::dot(faceNormals[c], axis) < MESHLET_MIN_GROW_DOT) continue;
+                float score = added + MESHLET_CONE_WEIGHT * (1.0f - glm::dot(faceNormals[c], axis));
+                if (score < bestScore) {
+                    best = c;
+                    bestScore = score;
+                }
+            }
+            if (best == triCount) {
+                glm::vec3 center = centroidSum / (float)tris.size();
+                float bestDist = FLT_MAX;
+                for (size_t t = seedCursor; t < triCount; ++t) {
+                    if (used[t] || vertexCount + newVertices(t, stamp) > MESHLET_MAX_VERTICES) continue;
+                    if (tris.size() >= MESHLET_MIN_TRIANGLES && glm::dot(faceNormals[t], axis) < MESHLET_MIN_GROW_DOT) continue;
+                    glm::vec3 d = centroids[t] - center;
+                    float dist = glm::dot(d, d);
+                    if (dist < bestDist) {
+                        bestDist = dist;
+                        best = t;
+                    }
+                }
+                if (best == triCount) break;
+            }
+            next = best;
+        }
+
+        // bounds and normal cone
+        Meshlet m;
+        m.indexOffset = (unsigned int)ordered.size();
+        m.indexCount = (unsigned int)tris.size() * 3;
+        glm::vec3 mn( FLT_MAX);
+        glm::vec3 mx(-FLT_MAX);
+        for (unsigned int t : tris)
+            for (int k = 0; k < 3; ++k) {
+                mn = glm::min(mn, vertices[indices[t * 3 + k]].Position);
+                mx = glm::max(mx, vertices[indices[t * 3 + k]].Position);
+                ordered.push_back(indices[t * 3 + k]);
+            }
+        m.center = (mn + mx) * 0.5f;
+        m.radius = 0.0f;
+        for (unsigned int t : tris)
+            for (int k = 0; k < 3; ++k)
+                m.radius = glm::max(m.radius, glm::length(vertices[indices[t * 3 + k]].Position - m.center));
+
+        m.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        m.coneCutoff = 1.0f;
+        if (glm::length(normalSum) > 1e-6f) {
+            m.coneAxis = glm::normalize(normalSum);
+            float minDot = 1.0f;
+            for (unsigned int t : tris)
+                if (faceNormals[t] != glm::vec3(0.0f)) minDot = glm::min(minDot, glm::dot(faceNormals[t], m.coneAxis));
+            if (minDot > MESHLET_MIN_CONE_DOT) m.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+        }
+        meshlets.push_back(m);
+    }
+
+    indices.swap(ordered);
+    return meshlets;
+}
+
+inline void logMeshlets(const ModelAsset& model, const std::string& name)
+{
+    size_t count = 0, triangles = 0;
+    for (size_t i = 0; i < model.meshlets.size(); ++i) {
+        count += model.meshlets[i].size();
+        triangles += model.meshes[i].indices.size() / 3;
+    }
+    if (count) std::cout << "Meshlets " << name << ": " << count << " clusters, " << triangles / count << " tris each on average" << std::endl;
+}
+
+// --------- Culling (GL thread or headless) ---------
+struct MeshletCullStats {
+    size_t clusters = 0;
+    size_t frustumCulled = 0;
+    size_t backfaceCulled = 0;
+    size_t trianglesDrawn = 0;
+    size_t triangles = 0;
+};
+
+// The six planes of clip matrix `m` (normals inward, normalized), in the space `m`
+// maps from.
+inline void extractFrustumPlanes(const glm::mat4& m, glm::vec4 planes[6])
+{
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; ++i) row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    for (int i = 0; i < 3; ++i) {
+        planes[i * 2] = row[3] + row[i];
+        planes[i * 2 + 1] = row[3] - row[i];
+    }
+    for (int i = 0; i < 6; ++i) planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+// Everything is tested in model space: the frustum planes come straight from
+// projection * view * model, and back-facing is unchanged by an affine transform as
+// long as the eye is brought into the same space.
+struct ClusterCuller {
+    glm::vec4 planes[6];
+    glm::vec3 eye;
+    bool coneCulling = MESHLET_CONE_CULLING;
+
+    ClusterCuller(const glm::mat4& viewProjection, const glm::mat4& model, const glm::vec3& eyeWorld)
+    {
+        extractFrustumPlanes(viewProjection * model, planes);
+        eye = glm::vec3(glm::inverse(model) * glm::vec4(eyeWorld, 1.0f));
+    }
+
+    bool visible(const Meshlet& m, MeshletCullStats& stats) const
+    {
+        ++stats.clusters;
+        stats.triangles += m.indexCount / 3;
+        for (const auto& p : planes)
+            if (glm::dot(glm::vec3(p), m.center) + p.w < -m.radius) {
+                ++stats.frustumCulled;
+                return false;
+            }
+        if (coneCulling && m.coneCutoff < 1.0f) {
+            glm::vec3 toCenter = m.center - eye;
+            if (glm::dot(toCenter, m.coneAxis) >= m.coneCutoff * glm::length(toCenter) + m.radius) {
+                ++stats.backfaceCulled;
+                return false;
+            }
+        }
+        stats.trianglesDrawn += m.indexCount / 3;
+        return true;
+    }
+};
+
+// Queues the visible meshlets of LOD 0 mesh `index`, merging neighbours into one
+// packet each.
+inline void submitMeshletsCulled(ModelAsset& model, size_t index, const ClusterCuller& culler, RenderQueue& queue,
+                                 Shader& shader, int matrix, float distance, MeshletCullStats& stats)
+{
+    DrawPacket packet = model.meshPacket(0, index, shader);
+    packet.matrix = matrix;
+    ClusterCuller meshCuller = culler;
+    if (packet.opacity >= 0.0f) meshCuller.coneCulling = false; // glass is seen through, from both sides
+    size_t runStart = 0, runEnd = 0;
+    auto flush = [&]() {
+        if (runEnd == runStart) return;
+        packet.first = runStart;
+        packet.count = (GLsizei)(runEnd - runStart);
+        queue.submit(packet, RENDER_PASS_OPAQUE, distance);
+    };
+    for (const auto& m : model.meshlets[index]) {
+        if (!meshCuller.visible(m, stats)) continue;
+        if (m.indexOffset != runEnd) {
+            flush();
+            runStart = m.indexOffset;
+        }
+        runEnd = m.indexOffset + m.indexCount;
+    }
+    flush();
+}
+
+// LOD 0 of `model` with per-meshlet culling; meshes without meshlets go in whole.
+inline void submitModelClusters(ModelAsset& model, const ClusterCuller& culler, RenderQueue& queue, Shader& shader,
+                                int matrix, float distance, MeshletCullStats& stats)
+{
+    for (size_t i = 0; i < model.meshes.size(); ++i) {
+        if (i < model.meshlets.size() && !model.meshlets[i].empty()) {
+            submitMeshletsCulled(model, i, culler, queue, shader, matrix, distance, stats);
+        } else {
+            DrawPacket packet = model.meshPacket(0, i, shader);
+            packet.matrix = matrix;
+            queue.submit(packet, RENDER_PASS_OPAQUE, distance);
+        }
+    }
+}
+
+// --------- Self check ---------
+// Brute-force proof that culling only dropped what it may: every triangle of a culled
+// cluster must be outside the frustum (frustum culled) or face away from the eye
+// (back-face culled). Returns the number of violations.
+inline size_t verifyMeshletCulling(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                                   const std::vector<Meshlet>& meshlets, const ClusterCuller& culler)
+{
+    size_t violations = 0;
+    for (const auto& m : meshlets) {
+        MeshletCullStats one;
+        if (culler.visible(m, one)) continue;
+        for (unsigned int i = m.indexOffset; i < m.indexOffset + m.indexCount; i += 3) {
+            const glm::vec3& a = vertices[indices[i]].Position;
+            const glm::vec3& b = vertices[indices[i + 1]].Position;
+            const glm::vec3& c = vertices[indices[i + 2]].Position;
+            if (one.frustumCulled) {
+                bool outside = false;
+                for (const auto& p : culler.planes)
+                    if (glm::dot(glm::vec3(p), a) + p.w < 0.0f && glm::dot(glm::vec3(p), b) + p.w < 0.0f
+                        && glm::dot(glm::vec3(p), c) + p.w < 0.0f) outside = true;
+                if (!outside) ++violations;
+            } else {
+                glm::vec3 n = glm::cross(b - a, c - a);
+                if (glm::dot(n, a - culler.eye) < -1e-6f * glm::length(n)) ++violations;
+            }
+        }
+    }
+    return violations;
+}
+
+#endif
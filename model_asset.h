@@ -0,0 +1,248 @@
+#ifndef MODEL_ASSET_H
+#define MODEL_ASSET_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include "render_queue.h"
+#include "vertex_quantize.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// --------- Bounds ---------
+struct ModelBounds {
+    glm::vec3 min;
+    glm::vec3 max;
+    glm::vec3 center; // sphere around the box
+    float radius;
+};
+
+inline ModelBounds boundsFromBox(const glm::vec3& mn, const glm::vec3& mx)
+{
+    ModelBounds b;
+    b.min = mn;
+    b.max = mx;
+    b.center = (mn + mx) * 0.5f;
+    b.radius = glm::length(mx - b.center);
+    return b;
+}
+
+inline ModelBounds computeMeshBounds(const std::vector<Mesh>& meshes)
+{
+    glm::vec3 mn( FLT_MAX);
+    glm::vec3 mx(-FLT_MAX);
+    for (const auto& mesh : meshes)
+        for (const auto& v : mesh.vertices) {
+            mn = glm::min(mn, v.Position);
+            mx = glm::max(mx, v.Position);
+        }
+    if (mn.x > mx.x) // empty model
+        mn = mx = glm::vec3(0.0f);
+    return boundsFromBox(mn, mx);
+}
+
+// --------- Occluders ---------
+// Positions-only triangle soup for CPU occlusion culling, built by buildOccluderMesh
+// (occlusion_culling.h) from the coarsest LOD; model space.
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+};
+
+// --------- Meshlets ---------
+// A run of triangles in a mesh's (reordered) index buffer that is culled as a unit.
+// Built by buildMeshlets (meshlets.h); all values are in model space.
+struct Meshlet {
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    glm::vec3 center;       // bounding sphere
+    float radius;
+    glm::vec3 coneAxis;     // average facing of the triangles
+    float coneCutoff;       // sin of the cone's half angle; 1 = never back-face culled
+};
+
+// --------- Texture asset ---------
+// `id` is valid from the moment the asset is handed out (a 1x1 grey texture) and keeps
+// the same name while the real levels stream in. An alias is a different file with the
+// same bytes as `aliasOf`; it shares that texture instead of uploading its own.
+// Material textures are `packable`: once resident they are also copied into a layer of
+// a shared GL_TEXTURE_2D_ARRAY (texture_array.h), which model draws then prefer.
+struct TextureAsset {
+    std::string path;
+    unsigned int id = 0;
+    size_t gpuBytes = 0;
+    uint64_t contentHash = 0;
+    bool resident = false;
+    std::shared_ptr<TextureAsset> aliasOf;
+
+    // set when resident, for packing
+    int width = 0, height = 0, levels = 0;
+    unsigned int glFormat = 0; // GL_RGBA8 or an S3TC format
+    unsigned int version = 0;  // bumped on every (re)load
+
+    bool packable = false;
+    unsigned int arrayId = 0;  // 0 = not packed (yet)
+    int arrayLayer = -1;
+};
+typedef std::shared_ptr<TextureAsset> TextureHandle;
+
+// Meshes don't expose their buffers, but the VAO remembers them.
+inline void releaseMesh(Mesh& mesh)
+{
+    GLint vbo = 0, ebo = 0;
+    glBindVertexArray(mesh.VAO);
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &ebo);
+    glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &vbo);
+    glBindVertexArray(0);
+    GLuint buffers[2] = { (GLuint)vbo, (GLuint)ebo };
+    glDeleteBuffers(2, buffers);
+    glDeleteVertexArrays(1, &mesh.VAO);
+    mesh.VAO = 0;
+}
+
+inline size_t meshBytes(const Mesh& mesh, bool compact = false)
+{
+    size_t vertexSize = compact ? sizeof(CompactVertex) : sizeof(Vertex);
+    return mesh.vertices.size() * vertexSize + mesh.indices.size() * sizeof(unsigned int);
+}
+
+// --------- Model asset ---------
+// Same public shape as learnopengl's Model (meshes, textures_loaded, directory), but it
+// exists before its data does: the async loader hands one out immediately and fills
+// it in on the GL thread. Until `resident` is set it only knows its placeholder bounds.
+#define LOD_MAX_LEVELS 4 // level 0 = the loaded meshes
+
+inline uint64_t nextModelId()
+{
+    static std::atomic<uint64_t> ids{0};
+    return ++ids;
+}
+
+struct ModelAsset {
+    // never reused, unlike the address, so caches keyed by it can't outlive the asset
+    const uint64_t id = nextModelId();
+    std::string path;
+    std::string directory;
+    std::vector<Mesh> meshes;
+    std::vector<Texture> textures_loaded;
+    std::vector<TextureHandle> textureRefs; // keeps the shared textures alive
+
+    // coarser LODs, lodLevels[i] is LOD i+1; they share textures with `meshes`
+    std::vector<std::vector<Mesh>> lodLevels;
+    size_t lodTriangles[LOD_MAX_LEVELS] = {};
+
+    // per mesh, parallel to `meshes` / `lodLevels`; empty when the vertices are floats
+    std::vector<VertexDecode> meshDecode;
+    std::vector<std::vector<VertexDecode>> lodDecode;
+
+    // per mesh, parallel to `meshes` / `lodLevels`: the diffuse texture as an index
+    // into `textureRefs`, -1 if none
+    std::vector<int> meshDiffuse;
+    std::vector<std::vector<int>> lodDiffuse;
+
+    // per mesh, parallel to `meshes` / `lodLevels`: the material's opacity (`d`) when it
+    // is transparent (d < 1 or an alpha map), -1 for opaque meshes. Transparent meshes
+    // draw in the render queue's transparent pass, their alpha being the diffuse
+    // texture's times this.
+    std::vector<float> meshOpacity;
+    std::vector<std::vector<float>> lodOpacity;
+
+    // per LOD 0 mesh; the coarser levels are only used when small on screen
+    std::vector<std::vector<Meshlet>> meshlets;
+
+    OccluderMesh occluder; // empty until resident
+
+    TextureHandle impostor; // baked view atlas (impostors.h), null when there is none
+
+    ModelBounds bounds;   // placeholder box until resident, then the real mesh bounds
+    bool resident = false;
+    unsigned int version = 0; // unique per (re)load across all models, 0 = never resident
+
+    int lodCount() const { return 1 + (int)lodLevels.size(); }
+
+    size_t gpuBytes() const
+    {
+        bool compact = !meshDecode.empty();
+        size_t bytes = 0;
+        for (const auto& mesh : meshes) bytes += meshBytes(mesh, compact);
+        for (const auto& level : lodLevels)
+            for (const auto& mesh : level) bytes += meshBytes(mesh, compact);
+        return bytes;
+    }
+
+    // Frees the GL buffers of every mesh and LOD (textures belong to their own assets).
+    void releaseMeshes()
+    {
+        for (auto& mesh : meshes) releaseMesh(mesh);
+        for (auto& level : lodLevels)
+            for (auto& mesh : level) releaseMesh(mesh);
+        meshes.clear();
+        lodLevels.clear();
+        meshDecode.clear();
+        lodDecode.clear();
+        meshDiffuse.clear();
+        lodDiffuse.clear();
+        meshOpacity.clear();
+        lodOpacity.clear();
+        meshlets.clear();
+        occluder = OccluderMesh();
+    }
+
+    std::vector<Mesh>& level(int lod) { return lod == 0 ? meshes : lodLevels[lod - 1]; }
+
+    bool hasTransparentMeshes() const
+    {
+        return std::any_of(meshOpacity.begin(), meshOpacity.end(), [](float o) { return o >= 0.0f; });
+    }
+
+    // Packet for mesh `index` of LOD `lod`, all of it: vertex decode, opacity, and the packed
+    // array layer when the diffuse texture has one, the mesh's own 2D textures otherwise.
+    DrawPacket meshPacket(int lod, size_t index, Shader& shader)
+    {
+        const std::vector<VertexDecode>* decode = lod == 0 ? &meshDecode
+            : lod <= (int)lodDecode.size() ? &lodDecode[lod - 1] : nullptr;
+        const std::vector<int>* diffuse = lod == 0 ? &meshDiffuse
+            : lod <= (int)lodDiffuse.size() ? &lodDiffuse[lod - 1] : nullptr;
+        const std::vector<float>* opacity = lod == 0 ? &meshOpacity
+            : lod <= (int)lodOpacity.size() ? &lodOpacity[lod - 1] : nullptr;
+        Mesh& mesh = level(lod)[index];
+
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.vao = mesh.VAO;
+        packet.count = (GLsizei)mesh.indices.size();
+        packet.decode = decode && index < decode->size() ? &(*decode)[index] : nullptr;
+        packet.opacity = opacity && index < opacity->size() ? (*opacity)[index] : -1.0f;
+        int ref = diffuse && index < diffuse->size() ? (*diffuse)[index] : -1;
+        const TextureAsset* texture = ref >= 0 ? textureRefs[ref].get() : nullptr;
+        if (texture && texture->arrayId) {
+            packet.textureArray = texture->arrayId;
+            packet.layer = texture->arrayLayer;
+        } else {
+            packet.textures = &mesh.textures;
+        }
+        return packet;
+    }
+
+    // Every mesh of LOD `lod` with model matrix slot `matrix`.
+    void submitLevel(int lod, RenderQueue& queue, Shader& shader, int matrix, float distance)
+    {
+        for (size_t i = 0; i < level(lod).size(); ++i) {
+            DrawPacket packet = meshPacket(lod, i, shader);
+            packet.matrix = matrix;
+            queue.submit(packet, RENDER_PASS_OPAQUE, distance);
+        }
+    }
+};
+
+typedef std::shared_ptr<ModelAsset> ModelHandle;
+
+#endif
@@ -10,6 +10,36 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 
+#include "asset_loader.h"
+#include "asset_registry.h"
+#include "clustered_lights.h"
+#include "draw_lists.h"
+#include "frustum_culling.h"
+#include "gl_state.h"
+#include "gpu_driven.h"
+#include "ground.h"
+#include "headless.h"
+#include "hot_reload.h"
+#include "impostors.h"
+#include "instancing.h"
+#include "job_pool.h"
+#include "lod.h"
+#include "meshlets.h"
+#include "occlusion_culling.h"
+#include "model_asset.h"
+#include "render_queue.h"
+#include "ring_buffer.h"
+#include "scene.h"
+#include "shadows.h"
+#include "spatial_grid.h"
+#include "texture_baker.h"
+#include "transparency.h"
+#include "dynamic_resolution.h"
+#include "uniforms.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -19,6 +49,17 @@
 #define CAR_SPEED_R 2.5f
 #define CAR_SPEED_BOOST_FACTOR 3.0f
 #define ROTATION_SPEED 0.01f
+#define CLUSTER_STATS_INTERVAL 5.0f // seconds between meshlet culling reports
+#define SCENE_APPLY_BUDGET 16384     // scene placements turned into buildings per frame
+#define INSTANCED_BUILDINGS true     // false: one draw per building and mesh (--no-instancing)
+#define POSE_RECORD_INTERVAL 1.0f    // seconds between camera poses written by --record-poses
+#define BENCH_BUILDINGS 100000       // scene size of --bench-draw-lists
+#define BENCH_FRAMES 20              // measured frames per thread count
+#define STREET_LIGHT_SPACING 12.0f   // lamp grid, between the scene's building rows
+#define STREET_LIGHT_REACH 7         // lamps on each side of the car, per axis
+#define STREET_LIGHT_HEIGHT 4.0f
+#define STREET_LIGHT_RADIUS 9.0f
+#define NIGHT_AMBIENT 0.12f          // --night; the day is unlit (ambient 1, no lights)
 
 // screen
 const unsigned int SCR_WIDTH = 800;
@@ -51,10 +92,14 @@ struct AABB {
 };
 
 typedef struct building_t{
-    Model *buildingModel;
+    ModelAsset *buildingModel;
     glm::vec3 buildingPos;
     glm::vec3 buildingScaleFactor; // non-uniform supported
     float buildingRotation;        // ignored by AABB system (use OBB for rotated)
+    int lodLevel = 0;              // LOD picked last frame (for hysteresis)
+    AABB worldBox;                 // collision box, fixed once placed
+    glm::mat4 transform;           // model matrix, fixed once placed
+    float maxScale;                // largest axis of buildingScaleFactor, for LOD and culling
 } BUILDING_T;
 
 // Local-space AABBs (estimate & tweak for your meshes):
@@ -64,15 +109,38 @@ static const AABB kCarLocalAABB = {
     glm::vec3( 0.9f, 1.5f,  1.9f)  // max
 };
 
-// Building mesh base AABB (authoring units, before scene scale)
-// Adjust once to your building.obj bounds.
-static const AABB kBuildingLocalAABB = {
-    glm::vec3(-10.0f, 0.0f, -8.0f),
-    glm::vec3( 10.0f,10.0f,  8.0f)
-};
-
-// All buildings live here
+// All buildings live here, streamed in from the scene file
 std::vector<BUILDING_T> gBuildings;
+SpatialGrid gBuildingGrid; // ids are indices into gBuildings
+CullSet gBuildingBounds;   // world boxes, parallel to gBuildings
+std::vector<uint8_t> gBuildingVisible; // this frame's frustum test, parallel to gBuildings
+std::vector<uint32_t> gBuildingOrder;  // ids in spatial order, for the parallel draw lists
+
+// streams models and textures in the background (created once GL is up)
+AsyncAssetLoader *gAssets = nullptr;
+int carLodLevel = 0;
+
+// this frame's camera, for per-meshlet culling
+glm::mat4 gViewProjection = glm::mat4(1.0f);
+MeshletCullStats gClusterStats;
+bool gInstancedBuildings = INSTANCED_BUILDINGS;
+InstanceStats gInstanceStats;
+CullStats gCullStats;
+bool gOcclusionCulling = OCCLUSION_CULLING;
+OcclusionStats gOcclusionStats;
+RenderQueueStats gQueueStats;
+bool gGpuDriven = GPU_DRIVEN;
+GpuDrivenStats gGpuStats;
+RingStats gRingStats;
+DrawListStats gDrawListStats;
+GroundStats gGroundStats;
+bool gNight = false;
+LightStats gLightStats;
+bool gShadows = SHADOWS;
+ShadowStats gShadowStats;
+bool gDynamicResolution = DYNAMIC_RESOLUTION;
+DynamicResolutionStats gResolutionStats;
+bool gImpostors = IMPOSTORS;
 
 // last safe car position
 glm::vec3 moment_before_collision;
@@ -157,214 +225,937 @@ bool wouldCollideAt(const glm::vec3& proposedCarPos, float proposedYaw)
     AABB carW;
     carWorldAABBAt(proposedCarPos, proposedYaw, carW);
 
-    for (const auto& b : gBuildings) {
-        AABB bW;
-        toWorldAABB_NonRotated(kBuildingLocalAABB, b.buildingPos, b.buildingScaleFactor, bW);
-        if (aabbOverlap(carW, bW)) return true;
-    }
+    static std::vector<uint32_t> nearby;
+    nearby.clear();
+    gBuildingGrid.query(carW.minLocal, carW.maxLocal, nearby);
+    for (uint32_t id : nearby)
+        if (aabbOverlap(carW, gBuildings[id].worldBox)) return true;
     return false;
 }
 
 // --------- Rendering helpers ---------
-void drawBuilding(BUILDING_T *building ,Shader shader){
-    glm::mat4 buildingModel = glm::mat4(1.0f);
-    buildingModel = glm::translate(buildingModel, building->buildingPos);
-    buildingModel = glm::rotate(buildingModel, building->buildingRotation, glm::vec3(0.0f, 1.0f, 0.0f)); // ignored by AABB
-    buildingModel = glm::scale(buildingModel, building->buildingScaleFactor);
-    shader.setMat4("model", buildingModel);
-    building->buildingModel->Draw(shader);
+// Queue `asset` with `model`, picking the LOD from its projected size on screen.
+// Assets still streaming in draw as their placeholder box. Safe on a worker thread with
+// its own queue and stats.
+void submitModelLod(ModelAsset& asset, const glm::mat4& model, float maxScale, int& lodLevel, RenderQueue& queue, Shader& shader,
+                    MeshletCullStats& clusterStats)
+{
+    glm::vec3 center = glm::vec3(model * glm::vec4(asset.bounds.center, 1.0f));
+    float radius = asset.bounds.radius * maxScale;
+    float distance = std::max(0.0f, glm::length(center - camera.Position) - radius);
+    if (!asset.resident) {
+        gAssets->submitPlaceholder(asset, model, queue, shader, distance);
+        return;
+    }
+    float fraction = projectedScreenFraction(center, radius, camera.Position, glm::radians(camera.Zoom));
+    lodLevel = selectLod(asset, fraction, lodLevel);
+    int matrix = queue.matrix(model);
+    if (lodLevel == 0 && !asset.meshlets.empty())
+        submitModelClusters(asset, ClusterCuller(gViewProjection, model, camera.Position), queue, shader, matrix, distance, clusterStats);
+    else
+        submitLod(asset, lodLevel, queue, shader, matrix, distance);
 }
 
-// --------- Main ---------
-int main()
+// Fills in the fields derived from position, rotation and scale.
+void placeBuilding(BUILDING_T& building, const AABB& localBox)
 {
-    // glfw init
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+    building.transform = glm::mat4(1.0f);
+    building.transform = glm::translate(building.transform, building.buildingPos);
+    building.transform = glm::rotate(building.transform, building.buildingRotation, glm::vec3(0.0f, 1.0f, 0.0f)); // ignored by AABB
+    building.transform = glm::scale(building.transform, building.buildingScaleFactor);
+    glm::vec3 s = building.buildingScaleFactor;
+    building.maxScale = std::max(s.x, std::max(s.y, s.z));
+    toWorldAABB_NonRotated(localBox, building.buildingPos, building.buildingScaleFactor, building.worldBox);
+}
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "My Game (AABB collisions w/ rotation check)", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+// Frustum-culling box of building `id` from its model's current bounds.
+void updateBuildingBounds(size_t id)
+{
+    glm::vec3 center, extent;
+    worldBox(gBuildings[id].transform, gBuildings[id].buildingModel->bounds, center, extent);
+    gBuildingBounds.set(id, center, extent);
+}
+
+// Clears gBuildingVisible for buildings hidden behind the nearest ones; runs after
+// the frustum pass with this frame's gViewProjection.
+void occlusionCullBuildings(OcclusionBuffer& buffer, const glm::vec3& eye)
+{
+    occlusionCull(buffer, gViewProjection, eye, gBuildingBounds, gBuildingVisible,
+                  [](uint32_t id, const OccluderMesh*& mesh, const glm::mat4*& transform) {
+                      const BUILDING_T& b = gBuildings[id];
+                      if (!b.buildingModel->resident) return false;
+                      mesh = &b.buildingModel->occluder;
+                      transform = &b.transform;
+                      return true;
+                  },
+                  gOcclusionStats);
+}
+
+void submitBuilding(BUILDING_T *building, RenderQueue& queue, Shader& shader, MeshletCullStats& clusterStats){
+    submitModelLod(*building->buildingModel, building->transform, building->maxScale, building->lodLevel, queue, shader, clusterStats);
+}
+
+// Re-sorts gBuildingOrder once the scene has grown.
+void updateBuildingOrder()
+{
+    if (gBuildingOrder.size() != gBuildings.size()) spatialOrder(gBuildingBounds, gBuildingOrder);
+}
+
+// Worker side of the parallel draw lists: the visible buildings in [begin, end) of
+// gBuildingOrder into `lane`, GPU-driven where possible, else instanced (or one draw
+// per building and mesh with --no-instancing, the only path that needs `shader`).
+void fillBuildingLane(size_t begin, size_t end, DrawLane& lane, const GpuScene* gpuScene, Shader* shader)
+{
+    for (size_t i = begin; i < end; ++i) {
+        uint32_t id = gBuildingOrder[i];
+        if (!gBuildingVisible[id]) continue;
+        BUILDING_T& b = gBuildings[id];
+        // far buildings (and those fading) go to the instanced impostors in either mode
+        bool impostor = gImpostors && lane.instances.impostorRange(*b.buildingModel, b.transform, b.maxScale);
+        if (gpuScene && !impostor) {
+            if (gpuScene->add(lane.gpu, *b.buildingModel, b.transform, b.maxScale, b.lodLevel)) continue;
+            ++lane.gpuFallbacks;
+        }
+        if (gInstancedBuildings || impostor) lane.instances.add(*b.buildingModel, b.transform, b.maxScale, b.lodLevel, gImpostors);
+        else submitBuilding(&b, lane.queue, *shader, lane.clusterStats);
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+}
 
-    // capture mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+// --------- Lights ---------
+// At night a grid of street lamps around the car plus its two headlights, all through
+// the light clusters; (2 * STREET_LIGHT_REACH + 1)^2 + 2 must stay within LIGHT_MAX.
+static_assert((2 * STREET_LIGHT_REACH + 1) * (2 * STREET_LIGHT_REACH + 1) + 2 <= LIGHT_MAX, "too many street lights");
 
-    // glad
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+void gatherLights(std::vector<Light>& lights, const glm::vec3& carPos, float carYaw)
+{
+    lights.clear();
+    if (!gNight) return;
+    int cx = (int)std::floor(carPos.x / STREET_LIGHT_SPACING);
+    int cz = (int)std::floor(carPos.z / STREET_LIGHT_SPACING);
+    for (int z = cz - STREET_LIGHT_REACH; z <= cz + STREET_LIGHT_REACH; ++z)
+        for (int x = cx - STREET_LIGHT_REACH; x <= cx + STREET_LIGHT_REACH; ++x) {
+            Light lamp;
+            lamp.position = glm::vec3((x + 0.5f) * STREET_LIGHT_SPACING, STREET_LIGHT_HEIGHT, (z + 0.5f) * STREET_LIGHT_SPACING);
+            lamp.radius = STREET_LIGHT_RADIUS;
+            lamp.color = glm::vec3(1.0f, 0.8f, 0.55f);
+            lights.push_back(lamp);
+        }
+    // headlights at the front of kCarLocalAABB, pointing along the car and a bit down
+    glm::vec3 forward(sin(carYaw), 0.0f, cos(carYaw));
+    glm::vec3 right(cos(carYaw), 0.0f, -sin(carYaw));
+    for (float side : { -0.6f, 0.6f }) {
+        Light head;
+        head.position = carPos + forward * kCarLocalAABB.maxLocal.z + right * side + glm::vec3(0.0f, 0.7f, 0.0f);
+        head.radius = 18.0f;
+        head.color = glm::vec3(1.4f);
+        head.direction = glm::normalize(forward - glm::vec3(0.0f, 0.15f, 0.0f));
+        head.spotCos = cos(glm::radians(25.0f));
+        lights.push_back(head);
     }
+}
 
-    // images upright
-    stbi_set_flip_vertically_on_load(false);
+// --------- Scene ---------
+// Game side of the scene streamer: models resolve through the registry (and stream in
+// like any other asset), placements become buildings and grid entries. At most
+// SCENE_APPLY_BUDGET placements per call, so a huge scene fills in over a few frames.
+struct SceneState {
+    std::vector<ModelHandle> models; // by scene model index
+    std::vector<AABB> boxes;
+    std::vector<ModelBounds> culledBounds; // per model, the bounds gBuildingBounds was built from
+    size_t chunks = 0;
+    bool reported = false;
+};
 
-    // GL state
-    glEnable(GL_DEPTH_TEST);
+void applySceneChunks(SceneStreamer& streamer, SceneState& scene, AssetRegistry& registry)
+{
+    size_t applied = 0;
+    SceneChunk chunk;
+    while (applied < SCENE_APPLY_BUDGET && streamer.pop(chunk)) {
+        for (const auto& m : chunk.models) {
+            scene.models.push_back(registry.model(m.path, m.boxMin, m.boxMax));
+            scene.boxes.push_back({ m.boxMin, m.boxMax });
+            scene.culledBounds.push_back(scene.models.back()->bounds);
+        }
+        for (const auto& p : chunk.placements) {
+            BUILDING_T b;
+            b.buildingModel = scene.models[p.model].get();
+            b.buildingPos = glm::vec3(p.position[0], p.position[1], p.position[2]);
+            b.buildingScaleFactor = glm::vec3(p.scale[0], p.scale[1], p.scale[2]);
+            b.buildingRotation = p.rotationY;
+            placeBuilding(b, scene.boxes[p.model]);
+            gBuildingGrid.insert((uint32_t)gBuildings.size(), b.worldBox.minLocal, b.worldBox.maxLocal);
+            gBuildings.push_back(b);
+            updateBuildingBounds(gBuildings.size() - 1);
+        }
+        applied += chunk.placements.size();
+        ++scene.chunks;
+    }
+    if (!scene.reported && streamer.done()) {
+        scene.reported = true;
+        std::cout << "Scene: " << gBuildings.size() << " buildings, " << scene.models.size() << " models from "
+                  << (streamer.binary ? "binary" : "text") << " in " << scene.chunks << " chunks, parsed in "
+                  << (int)streamer.parseMs << " ms, " << gBuildingGrid.cellCount() << " grid cells" << std::endl;
+    }
+}
 
-    // shaders
-    Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
+// A model's bounds switch from the scene file's box to the real mesh bounds once it
+// is resident (and again on hot reload); the culling boxes of its buildings follow.
+void refreshBuildingBounds(SceneState& scene)
+{
+    std::vector<const ModelAsset*> changed;
+    for (size_t i = 0; i < scene.models.size(); ++i) {
+        const ModelBounds& now = scene.models[i]->bounds;
+        ModelBounds& seen = scene.culledBounds[i];
+        if (now.min == seen.min && now.max == seen.max) continue;
+        seen = now;
+        changed.push_back(scene.models[i].get());
+    }
+    if (changed.empty()) return;
+    for (size_t id = 0; id < gBuildings.size(); ++id)
+        if (std::find(changed.begin(), changed.end(), gBuildings[id].buildingModel) != changed.end())
+            updateBuildingBounds(id);
+}
 
-    // load models
-    Model carModel(FileSystem::getPath("resources/assignment_3/obj/exported_car/car.obj"));
-    Model *buildingModelPtr = new Model(FileSystem::getPath("resources/assignment_3/obj/exported_building/building.obj"));
+// --------- Offline texture bake ---------
+// Every texture the game loads, with the flip it is loaded with at runtime.
+struct BakeEntry {
+    const char* path;
+    bool flipY;
+};
+static const BakeEntry kBakeTextures[] = {
+    { "resources/assignment_3/obj/exported_building/02_-_Default_baseColor.jpeg", false },
+    { "resources/assignment_3/obj/exported_building/vereda_baseColor.jpeg",       false },
+    { "resources/assignment_3/obj/exported_car/BodyGlass_baseColor.png",          false },
+    { "resources/assignment_3/obj/exported_car/BodyGlossy_baseColor.png",         false },
+    { "resources/textures/container.jpg",                                         true  },
+    { "resources/textures/grass.jpg",                                             true  },
+};
 
-    // add buildings (add as many as you like)
-    gBuildings.push_back({ buildingModelPtr, glm::vec3( 0.0f, 0.0f, -5.0f), glm::vec3(0.04f, 0.04f, 0.04f), glm::radians(180.0f) });
-    gBuildings.push_back({ buildingModelPtr, glm::vec3( 8.0f, 0.0f,-12.0f), glm::vec3(0.05f, 0.05f, 0.05f), 0.0f });
-    gBuildings.push_back({ buildingModelPtr, glm::vec3(-6.0f, 0.0f,  2.0f), glm::vec3(0.035f,0.035f,0.035f), 0.0f });
+// `--bake-textures [--rgba8]`: writes <texture>.dds next to each source, then exits.
+int bakeAllTextures(bool compress)
+{
+    int failed = 0;
+    for (const auto& entry : kBakeTextures)
+        if (!bakeTexture(FileSystem::getPath(entry.path), entry.flipY, compress)) ++failed;
+    return failed == 0 ? 0 : -1;
+}
 
-    moment_before_collision = model_trans_loc;
+// --------- Meshlet self check ---------
+// `--check-meshlets`: bakes car.obj's meshlets on the CPU (no window or GL context) and
+// culls them from fixed camera poses. Fails if a pose culls nothing it should, or if
+// any culled cluster holds a triangle that is on screen and facing the camera.
+int checkMeshlets()
+{
+    CpuModel car;
+    if (!decodeModel(FileSystem::getPath("resources/assignment_3/obj/exported_car/car.obj"), car, false)) return -1;
 
+    struct Pose {
+        const char* name;
+        glm::vec3 eye, target;
+        bool expectVisible, expectBackface;
+    };
+    const Pose poses[] = {
+        { "chase", glm::vec3( 0.0f, 8.0f, -3.0f), glm::vec3(0.0f), true,  true  },
+        { "front", glm::vec3( 0.0f, 0.5f,  5.0f), glm::vec3(0.0f), true,  true  },
+        { "side",  glm::vec3( 5.0f, 0.5f,  0.0f), glm::vec3(0.0f), true,  true  },
+        { "close", glm::vec3( 0.3f, 0.6f,  1.4f), glm::vec3(0.3f, 0.6f, -5.0f), true, false },
+        { "away",  glm::vec3( 0.0f, 0.5f,  5.0f), glm::vec3(0.0f, 0.5f, 10.0f), false, false },
+    };
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+
+    int failed = 0;
+    for (const auto& pose : poses) {
+        ClusterCuller culler(projection * glm::lookAt(pose.eye, pose.target, glm::vec3(0.0f, 1.0f, 0.0f)), glm::mat4(1.0f), pose.eye);
+        culler.coneCulling = true; // checked even while MESHLET_CONE_CULLING is off
+        MeshletCullStats stats;
+        size_t violations = 0;
+        for (size_t i = 0; i < car.meshes.size(); ++i) {
+            for (const auto& m : car.meshlets[i]) culler.visible(m, stats);
+            violations += verifyMeshletCulling(car.meshes[i].vertices, car.meshes[i].indices, car.meshlets[i], culler);
+        }
+        size_t visible = stats.clusters - stats.frustumCulled - stats.backfaceCulled;
+        bool ok = violations == 0 && (visible > 0) == pose.expectVisible && (!pose.expectBackface || stats.backfaceCulled > 0);
+        std::cout << (ok ? "ok   " : "FAIL ") << pose.name << ": " << visible << "/" << stats.clusters << " clusters visible, "
+                  << stats.frustumCulled << " off screen, " << stats.backfaceCulled << " back-facing, "
+                  << stats.trianglesDrawn << "/" << stats.triangles << " tris, " << violations << " wrongly culled tris" << std::endl;
+        if (!ok) ++failed;
+    }
+    return failed == 0 ? 0 : -1;
+}
 
-    Shader FloorShader("7.4.camera.vs", "7.4.camera.fs");
-
-    // set up vertex data (and buffer(s)) and configure vertex attributes
-    // ------------------------------------------------------------------
-    float vertices[] = {
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-         0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-        -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-         0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-         0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
+// --------- LOD self check ---------
+// `--check-lod`: simplifies a seamed test mesh on the CPU through every LOD level. The
+// mesh is a cube of LOD_CHECK_GRID x LOD_CHECK_GRID quads per face, three vertices per
+// triangle like assimp's, with flat normals (hard edges) and each face's UVs split into
+// two charts down the middle (a UV seam). Fails if a simplified corner's normal or UV
+// is not that of its triangle's chart at the corner's position, or if nothing was
+// simplified.
+#define LOD_CHECK_GRID 8
+#define LOD_CHECK_CHART_OFFSET 4.0f // UV offset of each face's second chart
+
+int checkLod()
+{
+    struct Face { glm::vec3 n, u, v; };
+    const Face faces[6] = {
+        { glm::vec3( 1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0) },
+        { glm::vec3(-1, 0, 0), glm::vec3(0, 0,  1), glm::vec3(0, 1, 0) },
+        { glm::vec3( 0, 1, 0), glm::vec3(1, 0,  0), glm::vec3(0, 0, -1) },
+        { glm::vec3( 0,-1, 0), glm::vec3(1, 0,  0), glm::vec3(0, 0,  1) },
+        { glm::vec3( 0, 0, 1), glm::vec3(1, 0,  0), glm::vec3(0, 1, 0) },
+        { glm::vec3( 0, 0,-1), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0) },
     };
+    // the chart a face point is in: x < 0 or x >= 0 along the face's u axis
+    auto chartUv = [](const Face& f, const glm::vec3& p, bool second) {
+        glm::vec2 uv(glm::dot(p, f.u), glm::dot(p, f.v));
+        return second ? uv + glm::vec2(LOD_CHECK_CHART_OFFSET, 0.0f) : uv;
+    };
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    for (const Face& f : faces) {
+        for (int y = 0; y < LOD_CHECK_GRID; ++y)
+            for (int x = 0; x < LOD_CHECK_GRID; ++x) {
+                auto at = [&](int gx, int gy) {
+                    return f.n + f.u * (gx * 2.0f / LOD_CHECK_GRID - 1.0f) + f.v * (gy * 2.0f / LOD_CHECK_GRID - 1.0f);
+                };
+                glm::vec3 quad[6] = { at(x, y), at(x + 1, y), at(x + 1, y + 1), at(x, y), at(x + 1, y + 1), at(x, y + 1) };
+                bool second = x >= LOD_CHECK_GRID / 2;
+                for (const glm::vec3& p : quad) {
+                    Vertex vertex = {};
+                    vertex.Position = p;
+                    vertex.Normal = f.n;
+                    vertex.TexCoords = chartUv(f, p, second);
+                    indices.push_back((unsigned int)vertices.size());
+                    vertices.push_back(vertex);
+                }
+            }
+    }
 
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
+    int failed = 0;
+    for (int level = 1; level < LOD_MAX_LEVELS; ++level) {
+        size_t target = (size_t)(indices.size() / 3 * kLodTriangleRatios[level]);
+        std::vector<unsigned int> simplified = simplifyIndicesQEM(vertices, indices, target);
+        size_t wrong = 0;
+        for (size_t t = 0; t + 2 < simplified.size(); t += 3) {
+            // the chart of the triangle is its first corner's; every corner must agree
+            const Vertex& first = vertices[simplified[t]];
+            const Face* face = nullptr;
+            for (const Face& f : faces)
+                if (f.n == first.Normal) face = &f;
+            bool second = face && first.TexCoords != chartUv(*face, first.Position, false);
+            for (int k = 0; k < 3; ++k) {
+                const Vertex& c = vertices[simplified[t + k]];
+                if (!face || c.Normal != face->n || glm::length(c.TexCoords - chartUv(*face, c.Position, second)) > 1e-5f) {
+                    ++wrong;
+                    break;
+                }
+            }
+        }
+        bool ok = wrong == 0 && simplified.size() < indices.size();
+        std::cout << (ok ? "ok   " : "FAIL ") << "LOD " << level << ": " << simplified.size() / 3 << "/" << indices.size() / 3
+                  << " tris (target " << target << "), " << wrong << " with a corner from another chart" << std::endl;
+        if (!ok) ++failed;
+    }
+    return failed == 0 ? 0 : -1;
+}
 
-    glBindVertexArray(VAO);
+// --------- Occlusion check (headless) ---------
+// Replays camera poses (`x y z frontX frontY frontZ` per line, as written by
+// --record-poses) over a scene, with no window. The culled set is compared against a
+// reference that rasterizes every frustum-visible building at full detail with ids:
+// a building the culler hid but that owns a reference pixel counts as wrongly culled.
+int checkOcclusion(const std::string& scenePath, const char* posesPath)
+{
+    std::vector<std::unique_ptr<ModelAsset>> models;
+    std::vector<OccluderMesh> fullDetail; // per model, LOD 0 for the reference
+    std::vector<AABB> boxes;
+    std::vector<uint32_t> modelOf; // per building
+    SceneStreamer streamer(scenePath);
+    SceneChunk chunk;
+    while (!streamer.done()) {
+        if (!streamer.pop(chunk)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        for (const auto& m : chunk.models) {
+            CpuModel cpu;
+            if (!decodeModel(m.path, cpu, false)) return -1;
+            glm::vec3 mn(FLT_MAX), mx(-FLT_MAX);
+            for (const auto& mesh : cpu.meshes)
+                for (const auto& v : mesh.vertices) {
+                    mn = glm::min(mn, v.Position);
+                    mx = glm::max(mx, v.Position);
+                }
+            models.emplace_back(new ModelAsset());
+            models.back()->bounds = boundsFromBox(mn, mx);
+            models.back()->occluder = std::move(cpu.occluder);
+            models.back()->resident = true;
+            fullDetail.push_back(buildOccluderMesh(cpu.meshes));
+            boxes.push_back({ m.boxMin, m.boxMax });
+        }
+        for (const auto& p : chunk.placements) {
+            BUILDING_T b;
+            b.buildingModel = models[p.model].get();
+            b.buildingPos = glm::vec3(p.position[0], p.position[1], p.position[2]);
+            b.buildingScaleFactor = glm::vec3(p.scale[0], p.scale[1], p.scale[2]);
+            b.buildingRotation = p.rotationY;
+            placeBuilding(b, boxes[p.model]);
+            gBuildings.push_back(b);
+            updateBuildingBounds(gBuildings.size() - 1);
+            modelOf.push_back(p.model);
+        }
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    struct Pose {
+        glm::vec3 eye, front;
+    };
+    std::vector<Pose> poses;
+    if (posesPath) {
+        std::ifstream in(posesPath);
+        Pose pose;
+        while (in >> pose.eye.x >> pose.eye.y >> pose.eye.z >> pose.front.x >> pose.front.y >> pose.front.z)
+            poses.push_back(pose);
+        if (poses.empty()) {
+            std::cout << "Occlusion: Failed to read poses from " << posesPath << std::endl;
+            return -1;
+        }
+    } else {
+        poses = {
+            { glm::vec3(0.0f, 8.0f, -3.0f), glm::vec3(0.0f, -0.87f, 0.5f) }, // chase camera
+            { glm::vec3(0.0f, 1.5f, -2.0f), glm::vec3(0.0f, 0.0f, 1.0f) },   // street level
+            { glm::vec3(0.0f, 1.5f, -2.0f), glm::vec3(0.7f, 0.0f, 0.7f) },
+            { glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(-1.0f, -0.2f, 0.0f) },
+        };
+    }
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // texture coord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    JobPool pool;
+    OcclusionBuffer buffer, reference;
+    reference.writeIds = true;
+    int failed = 0;
+    for (size_t i = 0; i < poses.size(); ++i) {
+        gViewProjection = projection * glm::lookAt(poses[i].eye, poses[i].eye + glm::normalize(poses[i].front), glm::vec3(0.0f, 1.0f, 0.0f));
+        CullStats frustumStats;
+        cullBoxesParallel(pool, Frustum(gViewProjection), gBuildingBounds, gBuildingVisible, frustumStats);
+        std::vector<uint8_t> inFrustum = gBuildingVisible;
+        gOcclusionStats = OcclusionStats();
+        occlusionCullBuildings(buffer, poses[i].eye);
+
+        reference.begin(gViewProjection);
+        for (size_t id = 0; id < gBuildings.size(); ++id)
+            if (inFrustum[id])
+                reference.drawOccluder(fullDetail[modelOf[id]], gBuildings[id].transform, (uint32_t)id + 1);
+        std::vector<uint8_t> seen(gBuildings.size(), 0);
+        for (uint32_t id : reference.ids)
+            if (id) seen[id - 1] = 1;
+        size_t hidden = 0, wrong = 0;
+        for (size_t id = 0; id < gBuildings.size(); ++id) {
+            if (!inFrustum[id]) continue;
+            if (!seen[id]) ++hidden;
+            if (!gBuildingVisible[id] && seen[id]) ++wrong;
+        }
+        bool ok = wrong == 0;
+        std::cout << (ok ? "ok   " : "FAIL ") << "pose " << i << ": " << frustumStats.visible << "/" << gBuildings.size()
+                  << " in frustum, " << gOcclusionStats.occluded << " occluded of " << hidden << " hidden, "
+                  << gOcclusionStats.occluders << " occluders, " << gOcclusionStats.ms << " ms, "
+                  << wrong << " wrongly culled" << std::endl;
+        if (!ok) ++failed;
+    }
+    gBuildings.clear();
+    gBuildingBounds.clear();
+    return failed == 0 ? 0 : -1;
+}
 
+// --------- Draw list benchmark (headless) ---------
+// `--bench-draw-lists [count [threads]]`: generates a `count`-building scene
+// (BENCH_BUILDINGS by default) next to the city scene and times frustum culling plus the
+// parallel draw lists (instanced path, no GL) from an overview camera that sees most of
+// it, for 1..`threads` threads (default: one per core, up to the job pool's maximum).
+// Every thread count must queue the same objects.
+int benchDrawLists(const std::string& templatePath, size_t count, int maxThreads)
+{
+    std::string path = sceneDirectory(templatePath) + "/bench.scene";
+    if (!generateScene(path, templatePath, count)) return -1;
+    std::vector<std::unique_ptr<ModelAsset>> models;
+    std::vector<AABB> boxes;
+    SceneStreamer streamer(path);
+    SceneChunk chunk;
+    while (!streamer.done()) {
+        if (!streamer.pop(chunk)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        for (const auto& m : chunk.models) {
+            models.emplace_back(new ModelAsset());
+            models.back()->bounds = boundsFromBox(m.boxMin, m.boxMax);
+            models.back()->resident = true;
+            boxes.push_back({ m.boxMin, m.boxMax });
+        }
+        for (const auto& p : chunk.placements) {
+            BUILDING_T b;
+            b.buildingModel = models[p.model].get();
+            b.buildingPos = glm::vec3(p.position[0], p.position[1], p.position[2]);
+            b.buildingScaleFactor = glm::vec3(p.scale[0], p.scale[1], p.scale[2]);
+            b.buildingRotation = p.rotationY;
+            placeBuilding(b, boxes[p.model]);
+            gBuildings.push_back(b);
+            updateBuildingBounds(gBuildings.size() - 1);
+        }
+    }
+    updateBuildingOrder();
+
+    glm::vec3 eye(0.0f, 1500.0f, -1500.0f);
+    float fovY = glm::radians(45.0f);
+    glm::mat4 projection = glm::perspective(fovY, (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 5000.0f);
+    gViewProjection = projection * glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum(gViewProjection);
+
+    if (maxThreads <= 0) maxThreads = std::max(1, std::min(JOB_POOL_MAX_WORKERS + 1, (int)std::thread::hardware_concurrency()));
+    double baseline = 0.0;
+    size_t expected = 0;
+    int failed = 0;
+    for (int threads = 1; threads <= maxThreads; ++threads) {
+        JobPool pool(threads - 1);
+        DrawLists lists;
+        InstanceRenderer instances;
+        RenderQueue queue;
+        GpuDrivenStats gpuStats;
+        double cullMs = 0.0, totalMs = 0.0;
+        DrawListStats listStats;
+        size_t queued = 0;
+        for (int frame = -2; frame < BENCH_FRAMES; ++frame) { // two warm-up frames
+            if (frame == 0) {
+                cullMs = totalMs = 0.0;
+                listStats = DrawListStats();
+            }
+            auto begin = std::chrono::steady_clock::now();
+            CullStats cullStats;
+            cullBoxesParallel(pool, frustum, gBuildingBounds, gBuildingVisible, cullStats);
+            cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            queue.begin();
+            instances.begin(eye, fovY);
+            lists.build(pool, gBuildingOrder.size(), eye, fovY,
+                        [&](size_t first, size_t last, DrawLane& lane) { fillBuildingLane(first, last, lane, nullptr, nullptr); },
+                        listStats);
+            lists.merge(queue, instances, nullptr, gClusterStats, gpuStats, listStats);
+            totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            queued = instances.queued();
+        }
+        if (threads == 1) {
+            baseline = totalMs;
+            expected = queued;
+        }
+        bool ok = queued == expected;
+        std::cout << (ok ? "ok   " : "FAIL ") << threads << " threads: " << totalMs / BENCH_FRAMES << " ms per frame (cull "
+                  << cullMs / BENCH_FRAMES << ", build " << listStats.buildMs / BENCH_FRAMES << ", merge "
+                  << listStats.mergeMs / BENCH_FRAMES << "), " << baseline / totalMs << "x, " << queued << "/"
+                  << gBuildings.size() << " buildings queued in " << listStats.lanes / BENCH_FRAMES << " lanes" << std::endl;
+        if (!ok) ++failed;
+    }
+    gBuildings.clear();
+    gBuildingBounds.clear();
+    gBuildingOrder.clear();
+    return failed == 0 ? 0 : -1;
+}
 
-    // load and create a texture 
-    // -------------------------
-    unsigned int texture1, texture2;
-    // texture 1
-    // ---------
-    glGenTextures(1, &texture1);
-    glBindTexture(GL_TEXTURE_2D, texture1);
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-    unsigned char *data = stbi_load(FileSystem::getPath("resources/textures/container.jpg").c_str(), &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+// --------- Light binning benchmark (headless) ---------
+// `--bench-lights [count [threads]]`: bins `count` (up to LIGHT_MAX) random point and
+// spot lights in front of a chase camera like the game's, BENCH_FRAMES times for
+// 1..`threads` threads. Every thread count must produce the same cluster table, and
+// it must list exactly the lights whose sphere reaches each cluster.
+int benchLights(size_t count, int maxThreads)
+{
+    uint32_t seed = 4242u;
+    auto rnd = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) / 16777216.0f; };
+    std::vector<Light> lights(std::min<size_t>(count, LIGHT_MAX));
+    for (size_t i = 0; i < lights.size(); ++i) {
+        Light& l = lights[i];
+        l.position = glm::vec3(-50.0f + 100.0f * rnd(), 0.5f + 4.0f * rnd(), -5.0f + 80.0f * rnd());
+        l.radius = 3.0f + 7.0f * rnd();
+        l.color = glm::vec3(rnd(), rnd(), rnd());
+        if (i % 4 == 3) {
+            l.direction = glm::normalize(glm::vec3(rnd() - 0.5f, -1.0f, rnd() - 0.5f));
+            l.spotCos = cos(glm::radians(20.0f + 30.0f * rnd()));
+        }
     }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
+    float fovY = glm::radians(45.0f), aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 8.0f, -3.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    if (maxThreads <= 0) maxThreads = std::max(1, std::min(JOB_POOL_MAX_WORKERS + 1, (int)std::thread::hardware_concurrency()));
+    std::vector<uint32_t> expected;
+    double baseline = 0.0;
+    int failed = 0;
+    for (int threads = 1; threads <= maxThreads; ++threads) {
+        JobPool pool(threads - 1);
+        LightClusters clusters;
+        LightStats stats;
+        for (int frame = -2; frame < BENCH_FRAMES; ++frame) { // two warm-up frames
+            if (frame == 0) stats = LightStats();
+            clusters.bin(pool, lights, view, fovY, aspect, 0.1f, 100.0f, stats);
+        }
+        const std::vector<uint32_t>& table = clusters.clusterTable();
+        size_t wrong = 0;
+        if (threads == 1) {
+            baseline = stats.binMs;
+            expected = table;
+            for (size_t c = 0; c < LIGHT_CLUSTER_COUNT; ++c) {
+                std::vector<uint32_t> reached;
+                for (size_t i = 0; i < lights.size() && reached.size() < LIGHT_CLUSTER_MAX_LIGHTS; ++i)
+                    if (clusters.touches(lights[i], view, c)) reached.push_back((uint32_t)i);
+                uint32_t offset = table[c] >> 8, n = table[c] & 255u;
+                if (n != reached.size() || !std::equal(reached.begin(), reached.end(), table.begin() + offset)) ++wrong;
+            }
+        } else if (table != expected) {
+            wrong = LIGHT_CLUSTER_COUNT;
+        }
+        bool ok = wrong == 0;
+        std::cout << (ok ? "ok   " : "FAIL ") << threads << " threads: " << stats.binMs / BENCH_FRAMES << " ms per frame, "
+                  << baseline / stats.binMs << "x, " << lights.size() << " lights, " << stats.indices / BENCH_FRAMES
+                  << " indices in " << stats.clusters / BENCH_FRAMES << "/" << LIGHT_CLUSTER_COUNT << " clusters, "
+                  << stats.overflowed / BENCH_FRAMES << " over the cluster limit, " << wrong << " clusters wrong" << std::endl;
+        if (!ok) ++failed;
     }
-    stbi_image_free(data);
-    // texture 2
-    // ---------
-    glGenTextures(1, &texture2);
-    glBindTexture(GL_TEXTURE_2D, texture2);
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load image, create texture and generate mipmaps
-    data = stbi_load(FileSystem::getPath("resources/textures/grass.jpg").c_str(), &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        // note that the awesomeface.png has transparency and thus an alpha channel, so make sure to tell OpenGL the data type is of GL_RGBA
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    return failed == 0 ? 0 : -1;
+}
+
+// --------- GPU-driven check ---------
+// --check-gpu-driven: once everything is streamed in and packed, one frame draws the
+// buildings GPU-driven and the next one through the instanced path; the two read-backs
+// must match. Runs on llvmpipe with --headless, or (LIBGL_ALWAYS_SOFTWARE=1) under a
+// virtual X server.
+#define GPU_CHECK_CHANNEL_TOLERANCE 8  // per channel, texture filtering may differ slightly
+#define GPU_CHECK_PIXEL_TOLERANCE 0.002 // fraction of pixels allowed to differ
+
+// The bound framebuffer's width x height pixels, RGBA8 rows bottom-up.
+std::vector<unsigned char> readFramebuffer(int width, int height)
+{
+    std::vector<unsigned char> pixels((size_t)width * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    return pixels;
+}
+
+bool compareFramebuffers(const std::vector<unsigned char>& gpuDriven, const std::vector<unsigned char>& instanced, size_t gpuInstances)
+{
+    size_t differing = 0, pixels = gpuDriven.size() / 4;
+    for (size_t i = 0; i < pixels; ++i)
+        for (int c = 0; c < 3; ++c)
+            if (std::abs((int)gpuDriven[i * 4 + c] - (int)instanced[i * 4 + c]) > GPU_CHECK_CHANNEL_TOLERANCE) {
+                ++differing;
+                break;
+            }
+    bool ok = gpuInstances > 0 && gpuDriven.size() == instanced.size() && differing <= pixels * GPU_CHECK_PIXEL_TOLERANCE;
+    std::cout << "GPU-driven check: " << gpuInstances << " instances multi-drawn, " << differing << "/" << pixels
+              << " pixels differ from the instanced path: " << (ok ? "OK" : "Failed") << std::endl;
+    return ok;
+}
+
+// --------- Impostor bake ---------
+// `--bake-impostors [--rgba8]`: once every scene model has streamed in, bakes each one's
+// atlas (impostors.h) and exits; the next run picks the .impostor.dds files up.
+int bakeSceneImpostors(const std::vector<ModelHandle>& models, Shader& shader, bool compress)
+{
+    std::vector<ModelAsset*> baked;
+    int failed = 0;
+    for (const auto& model : models) {
+        if (!model || std::find(baked.begin(), baked.end(), model.get()) != baked.end()) continue;
+        baked.push_back(model.get());
+        if (!model->resident || !bakeImpostor(*model, shader, compress)) {
+            std::cout << "Impostor bake: Failed for " << model->path << std::endl;
+            ++failed;
+        }
     }
-    else
+    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    std::cout << "Impostors: " << baked.size() - failed << "/" << baked.size() << " models baked" << std::endl;
+    return failed == 0 ? 0 : -1;
+}
+
+// --------- Main ---------
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--bake-textures") == 0)
+        return bakeAllTextures(!(argc > 2 && strcmp(argv[2], "--rgba8") == 0));
+    if (argc > 1 && strcmp(argv[1], "--check-meshlets") == 0)
+        return checkMeshlets();
+    if (argc > 1 && strcmp(argv[1], "--check-lod") == 0)
+        return checkLod();
+
+    std::string scenePath = FileSystem::getPath("resources/assignment_3/obj/city.scene");
+    if (argc > 1 && strcmp(argv[1], "--compile-scene") == 0)
+        return compileScene(argc > 2 ? argv[2] : scenePath) ? 0 : -1;
+    if (argc > 3 && strcmp(argv[1], "--generate-scene") == 0)
+        return generateScene(argv[2], scenePath, (size_t)atol(argv[3])) ? 0 : -1;
+    if (argc > 1 && strcmp(argv[1], "--check-occlusion") == 0)
+        return checkOcclusion(argc > 2 ? argv[2] : scenePath, argc > 3 ? argv[3] : nullptr);
+    if (argc > 1 && strcmp(argv[1], "--bench-draw-lists") == 0)
+        return benchDrawLists(scenePath, argc > 2 ? (size_t)atol(argv[2]) : BENCH_BUILDINGS, argc > 3 ? atoi(argv[3]) : 0);
+    if (argc > 1 && strcmp(argv[1], "--bench-lights") == 0)
+        return benchLights(argc > 2 ? (size_t)atol(argv[2]) : LIGHT_MAX, argc > 3 ? atoi(argv[3]) : 0);
+    std::ofstream poseLog;
+    bool gpuCheck = false;
+    bool impostorBake = false, impostorCompress = true;
+    bool headless = false;
+    HeadlessRun headlessRun;
+    float targetFps = 1000.0f / DYNAMIC_RESOLUTION_TARGET_MS;
+    float minResolutionScale = DYNAMIC_RESOLUTION_MIN_SCALE, maxResolutionScale = DYNAMIC_RESOLUTION_MAX_SCALE;
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && strcmp(argv[i], "--scene") == 0) scenePath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--record-poses") == 0) poseLog.open(argv[++i]);
+        else if (strcmp(argv[i], "--no-instancing") == 0) gInstancedBuildings = false;
+        else if (strcmp(argv[i], "--no-occlusion") == 0) gOcclusionCulling = false;
+        else if (strcmp(argv[i], "--no-gpu-driven") == 0) gGpuDriven = false;
+        else if (strcmp(argv[i], "--check-gpu-driven") == 0) gpuCheck = true;
+        else if (strcmp(argv[i], "--night") == 0) gNight = true;
+        else if (strcmp(argv[i], "--no-shadows") == 0) gShadows = false;
+        else if (strcmp(argv[i], "--no-impostors") == 0) gImpostors = false;
+        else if (strcmp(argv[i], "--bake-impostors") == 0) impostorBake = true;
+        else if (strcmp(argv[i], "--rgba8") == 0) impostorCompress = false;
+        else if (strcmp(argv[i], "--no-dynamic-resolution") == 0) gDynamicResolution = false;
+        else if (strcmp(argv[i], "--headless") == 0) headless = true;
+        else if (i + 1 < argc && strcmp(argv[i], "--frames") == 0) headlessRun.frames = std::max(atoi(argv[++i]), 1);
+        else if (i + 1 < argc && strcmp(argv[i], "--capture") == 0) headlessRun.capturePath = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--target-fps") == 0) targetFps = (float)atof(argv[++i]);
+        else if (i + 2 < argc && strcmp(argv[i], "--resolution-scale") == 0) {
+            minResolutionScale = (float)atof(argv[++i]);
+            maxResolutionScale = (float)atof(argv[++i]);
+        }
+    }
+
+    // the scene parses on its own thread while the window and GL come up
+    SceneStreamer sceneStreamer(scenePath);
+    SceneState scene;
+
+    auto startupBegin = std::chrono::steady_clock::now();
+
+    // headless: an EGL context without a surface, the frame drawn into an offscreen framebuffer
+    GLFWwindow* window = NULL;
+    HeadlessContext headlessContext;
+    HeadlessTarget headlessTarget;
+    if (headless) {
+        if (!(gGpuDriven && headlessContext.create(4, 3)) && !headlessContext.create(3, 3)) {
+            std::cout << "Failed to create a headless OpenGL context" << std::endl;
+            return -1;
+        }
+    } else {
+        // glfw init: 4.3 core for the GPU-driven path where the driver has it, else 3.3 core
+        glfwInit();
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        if (gpuCheck || impostorBake) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        if (gGpuDriven) {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "My Game (AABB collisions w/ rotation check)", NULL, NULL);
+        }
+        if (window == NULL) {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "My Game (AABB collisions w/ rotation check)", NULL, NULL);
+        }
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        // capture mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
+
+    // glad
+    if (!gladLoadGLLoader(headless ? (GLADloadproc)HeadlessContext::procAddress : (GLADloadproc)glfwGetProcAddress))
     {
-        std::cout << "Failed to load texture" << std::endl;
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
     }
-    stbi_image_free(data);
+
+    gGpuDriven = gGpuDriven && gpuDrivenSupported();
+    std::cout << "OpenGL " << GLVersion.major << "." << GLVersion.minor << ", buildings "
+              << (gGpuDriven ? "GPU-driven (multi-draw indirect)" : "instanced") << std::endl;
+    if (gpuCheck && !gGpuDriven) {
+        std::cout << "GPU-driven check: Failed, needs OpenGL 4.3" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    // GL state
+    glState().enable(GL_DEPTH_TEST, true);
+
+    // where finished frames go: the window's framebuffer, or the offscreen one
+    if (headless && !headlessTarget.create(SCR_WIDTH, SCR_HEIGHT)) return -1;
+    unsigned int outputFramebuffer = headlessTarget.framebuffer();
+
+    // asset streaming + the registry that owns every loaded file
+    AsyncAssetLoader assets;
+    gAssets = &assets;
+    AssetRegistry registry(assets);
+    FileWatcher assetWatcher(FileSystem::getPath("resources/assignment_3/obj"));
+
+    // shaders; lighting.glsl is sized by the C++ side
+    registry.shaderDefines = "#define LIGHT_MAX " + std::to_string(LIGHT_MAX) + "\n"
+                           + "#define SHADOW_CASCADES " + std::to_string(SHADOW_CASCADES) + "\n";
+    ShaderHandle ourShaderHandle = registry.shader("1.model_loading.vs", "1.model_loading.fs");
+    Shader& ourShader = *ourShaderHandle;
+    ourShader.use();
+    ourShader.setInt("diffuseArray", TEXTURE_ARRAY_UNIT);
+    ourShader.setInt("lightClusters", LIGHT_CLUSTER_UNIT);
+    ourShader.setInt("shadowMap", SHADOW_MAP_UNIT);
+    ShaderHandle gpuShaderHandle;
+    if (gGpuDriven) {
+        gpuShaderHandle = registry.shader("gpu_driven.vs", "gpu_driven.fs");
+        gpuShaderHandle->use();
+        gpuShaderHandle->setInt("diffuseArray", TEXTURE_ARRAY_UNIT);
+        gpuShaderHandle->setInt("lightClusters", LIGHT_CLUSTER_UNIT);
+        gpuShaderHandle->setInt("shadowMap", SHADOW_MAP_UNIT);
+    }
+
+    // load models (in the background; placeholders are the collision boxes)
+    ModelHandle carModel = registry.model(FileSystem::getPath("resources/assignment_3/obj/exported_car/car.obj"),
+                                          kCarLocalAABB.minLocal, kCarLocalAABB.maxLocal);
+    ModelAsset *carModelPtr = carModel.get();
+
+    // buildings come from the scene file (see applySceneChunks)
+    applySceneChunks(sceneStreamer, scene, registry);
+
+    moment_before_collision = model_trans_loc;
+
+
+    ShaderHandle floorShaderHandle = registry.shader("floor.vs", "floor.fs");
+    Shader& FloorShader = *floorShaderHandle;
+    ShaderHandle shadowShaderHandle = registry.shader("shadow_depth.vs", "shadow_depth.fs");
+    Shader& ShadowShader = *shadowShaderHandle;
+    const ProgramUniforms& shadowUniforms = uniformsOf(ShadowShader);
+    ShaderHandle impostorShaderHandle = registry.shader("impostor.vs", "impostor.fs");
+    Shader& ImpostorShader = *impostorShaderHandle;
+    ImpostorShader.use();
+    ImpostorShader.setInt("lightClusters", LIGHT_CLUSTER_UNIT);
+    ImpostorShader.setInt("shadowMap", SHADOW_MAP_UNIT);
+    Mesh impostorQuad = makeImpostorQuad();
+    ShaderHandle oitResolveHandle = registry.shader("oit_resolve.vs", "oit_resolve.fs");
+    oitResolveHandle->use();
+    oitResolveHandle->setInt("accumTexture", OIT_ACCUM_UNIT);
+    oitResolveHandle->setInt("weightTexture", OIT_WEIGHT_UNIT);
+    ShaderHandle upscaleHandle = registry.shader("upscale.vs", "upscale.fs");
+    upscaleHandle->use();
+    upscaleHandle->setInt("sceneTexture", DYNAMIC_RESOLUTION_UNIT);
+    ShaderHandle impostorBakeHandle;
+    if (impostorBake) {
+        impostorBakeHandle = registry.shader("impostor_bake.vs", "impostor_bake.fs");
+        impostorBakeHandle->use();
+        impostorBakeHandle->setInt("diffuseArray", TEXTURE_ARRAY_UNIT);
+    }
+
+    // ground tiles stream in around the car (ground.h)
+    GroundTiles ground;
+
+
+    // load and create a texture (streamed; baked .dds with precomputed mips if present)
+    // -------------------------
+    TextureHandle texture1 = registry.texture(FileSystem::getPath("resources/textures/container.jpg"), true);
+    TextureHandle texture2 = registry.texture(FileSystem::getPath("resources/textures/grass.jpg"), true);
 
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
     // -------------------------------------------------------------------------------------------
     FloorShader.use();
     FloorShader.setInt("texture1", 0);
     FloorShader.setInt("texture2", 1);
-
-
-
+    FloorShader.setInt("lightClusters", LIGHT_CLUSTER_UNIT);
+    FloorShader.setInt("shadowMap", SHADOW_MAP_UNIT);
+    std::vector<Texture> floorTextures = { { texture1->id, "texture_diffuse", "" }, { texture2->id, "texture_diffuse", "" } };
+
+    // startup / hitch measurements while assets stream in
+    bool firstFrame = true;
+    bool streaming = true;
+    float worstStreamingFrame = 0.0f;
+    int streamingFrames = 0;
+    float clusterStatsTime = 0.0f;
+    int clusterStatsFrames = 0;
+    InstanceRenderer buildingInstances;
+    GpuScene gpuScene;
+    std::vector<unsigned char> gpuCheckPixels; // the GPU-driven frame of --check-gpu-driven
+    size_t gpuCheckInstances = 0;
+    int exitCode = 0;
+    RenderQueue renderQueue;
+    DrawLists drawLists;
+    LightClusters lightClusters;
+    std::vector<Light> lights;
+    CascadedShadows shadows;
+    WeightedBlendedOIT transparency;
+    DynamicResolution resolution;
+    resolution.targetMs = 1000.0f / std::max(targetFps, 1.0f);
+    resolution.minScale = glm::clamp(std::min(minResolutionScale, maxResolutionScale), 0.1f, 1.0f);
+    resolution.maxScale = glm::clamp(std::max(minResolutionScale, maxResolutionScale), 0.1f, 1.0f);
+    // the GPU-driven check and golden-image captures compare frames pixel by pixel
+    gDynamicResolution = gDynamicResolution && !gpuCheck && headlessRun.capturePath.empty();
+    RenderQueue shadowQueue;
+    InstanceRenderer shadowInstances;
+    std::vector<uint8_t> shadowVisible;
+    size_t shadowBuildings = 0, shadowUploads = 0; // static scene the cached cascades show
+    StreamRing streamRing;
+    JobPool cullPool;
+    OcclusionBuffer occlusion;
+    float poseTime = 0.0f;
 
     // render loop
-    while (!glfwWindowShouldClose(window))
+    while (headless || !glfwWindowShouldClose(window))
     {
         // time
-        float currentFrame = static_cast<float>(glfwGetTime());
+        auto frameBegin = std::chrono::steady_clock::now();
+        float currentFrame = headless ? std::chrono::duration<float>(frameBegin - startupBegin).count()
+                                      : static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         // input
-        processInput(window);
+        if (!headless) processInput(window);
+
+        // hot reload: changed files re-stream in the background and swap in when resident
+        for (const auto& path : assetWatcher.poll())
+            registry.fileChanged(path);
+
+        // scene placements, then streaming uploads, both bounded per frame
+        applySceneChunks(sceneStreamer, scene, registry);
+        assets.update();
+        registry.packTextures();
+        refreshBuildingBounds(scene);
+        if (streaming) {
+            if (!firstFrame) {
+                worstStreamingFrame = std::max(worstStreamingFrame, deltaTime);
+                ++streamingFrames;
+            }
+            if (assets.idle()) {
+                streaming = false;
+                std::cout << "Streaming done " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count()
+                          << " ms after start: " << streamingFrames << " frames, worst frame " << worstStreamingFrame * 1000.0f
+                          << " ms, worst upload " << assets.maxUpdateMs << " ms, " << assets.uploadedBytes / 1024 << " KB" << std::endl;
+                registry.report(std::cout);
+            }
+        }
+        if (impostorBake && !streaming && scene.reported) {
+            exitCode = bakeSceneImpostors(scene.models, *impostorBakeHandle, impostorCompress);
+            break;
+        }
+
+        // the frame goes into the dynamic-resolution target's scaled part, or straight to the window
+        int framebufferWidth = headlessTarget.width, framebufferHeight = headlessTarget.height;
+        if (!headless) glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        unsigned int frameTarget = outputFramebuffer;
+        int frameWidth = framebufferWidth, frameHeight = framebufferHeight;
+        if (gDynamicResolution && resolution.begin(framebufferWidth, framebufferHeight, outputFramebuffer)) {
+            frameTarget = resolution.target();
+            frameWidth = resolution.scaledWidth();
+            frameHeight = resolution.scaledHeight();
+        } else {
+            glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+            glViewport(0, 0, framebufferWidth, framebufferHeight);
+        }
 
         // clear
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -374,52 +1165,129 @@ int main()
         glm::mat4 view = camera.GetViewMatrix();
 
         glm::mat4 model;
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture1);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, texture2);
-
-        // activate shader
-        FloorShader.use();
-
-        // pass projection matrix to shader (note that in this case it could change every frame)
-        FloorShader.setMat4("projection", projection);
-
-        // camera/view transformation
-
-        FloorShader.setMat4("view", view);
-
-        // render boxes
-        glBindVertexArray(VAO);
-        // calculate the model matrix for each object and pass it to shader before drawing
-        model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        model = glm::translate(model, glm::vec3(0.0f,-2.0f,0.0f));
-        model = glm::scale(model,glm::vec3(100.0f,1.0f,100.0f));
-        FloorShader.setMat4("model", model);
-
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-
-
-
-
-
-        // shader
-        ourShader.use();
+        // uploads above bind GL directly; from here on every bind goes through the cache
+        glState().invalidate();
+        streamRing.beginFrame(gRingStats);
+        renderQueue.begin();
+
+        // camera for every program, one write into this frame's slice of the stream ring
+        updateFrameUniforms(streamRing, projection, view, camera.Position);
+
+        // lights binned into the view's clusters on the job pool
+        gatherLights(lights, model_trans_loc, rotation);
+        lightClusters.bin(cullPool, lights, view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f, gLightStats);
+        lightClusters.upload(streamRing, lights, glm::vec3(gNight ? NIGHT_AMBIENT : 1.0f), frameWidth, frameHeight);
+
+        // the meshlet and occlusion culling see the same camera as the draws
+        gViewProjection = projection * view;
+
+        // frustum culling: buildings in parallel chunks, then the car
+        Frustum frustum(gViewProjection);
+        auto cullBegin = std::chrono::steady_clock::now();
+        cullBoxesParallel(cullPool, frustum, gBuildingBounds, gBuildingVisible, gCullStats);
+        gCullStats.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullBegin).count();
+        if (gOcclusionCulling) occlusionCullBuildings(occlusion, camera.Position);
+
+        // ground: the tile window follows the car, visible tiles in one instanced packet
+        ground.update(model_trans_loc, gGroundStats);
+        floorTextures[0].id = texture1->id; // aliasing and hot reloads swap the GL names
+        floorTextures[1].id = texture2->id;
+        ground.submit(renderQueue, FloorShader, floorTextures, streamRing, frustum, camera.Position, gGroundStats);
 
         // car model matrix
         model = glm::mat4(1.0f);
         model = glm::translate(model, model_trans_loc);
         model = glm::rotate(model, rotation, glm::vec3(0.0f, 1.0f, 0.0f));
         model = glm::scale(model, glm::vec3(1.0f));
-        ourShader.setMat4("model", model);
-        carModel.Draw(ourShader);
+        glm::vec3 carCenter, carExtent;
+        worldBox(model, carModelPtr->bounds, carCenter, carExtent);
+        ++gCullStats.tested;
+        if (frustum.boxVisible(carCenter, carExtent)) {
+            ++gCullStats.visible;
+            submitModelLod(*carModelPtr, model, 1.0f, carLodLevel, renderQueue, ourShader, gClusterStats);
+        }
 
-        // buildings
-        for (auto& b : gBuildings) {
-            drawBuilding(&b, ourShader);
+        // buildings: draw lists built on the job pool per spatial run, merged here
+        if (gGpuDriven) gpuScene.begin(camera.Position, glm::radians(camera.Zoom));
+        buildingInstances.begin(camera.Position, glm::radians(camera.Zoom));
+        updateBuildingOrder();
+        const GpuScene* gpuLanes = gGpuDriven ? &gpuScene : nullptr;
+        drawLists.build(cullPool, gBuildingOrder.size(), camera.Position, glm::radians(camera.Zoom),
+                        [&](size_t begin, size_t end, DrawLane& lane) { fillBuildingLane(begin, end, lane, gpuLanes, &ourShader); },
+                        gDrawListStats);
+        drawLists.merge(renderQueue, buildingInstances, gGpuDriven ? &gpuScene : nullptr, gClusterStats, gGpuStats, gDrawListStats);
+        // impostors are instanced even with --no-instancing, otherwise this is empty then
+        buildingInstances.submit(renderQueue, ourShader, assets.placeholderMesh(), streamRing, gInstanceStats,
+                                 &ImpostorShader, &impostorQuad);
+
+        // sun shadows: buildings from the cached cascades, the car drawn on top every frame
+        bool sunShadows = gShadows && !gNight;
+        if (sunShadows) {
+            if (gBuildings.size() != shadowBuildings || assets.uploadedBytes != shadowUploads) {
+                shadows.invalidate();
+                shadowBuildings = gBuildings.size();
+                shadowUploads = assets.uploadedBytes;
+            }
+            glm::mat4 carTransform = model;
+            shadows.render(view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f,
+                           frameTarget, frameWidth, frameHeight,
+                           [&](int, const glm::mat4& lightSpace, bool staticCasters) -> size_t {
+                               shadowQueue.begin();
+                               shadowInstances.begin(camera.Position, glm::radians(camera.Zoom));
+                               size_t casters = 1;
+                               if (staticCasters) {
+                                   CullStats cullStats;
+                                   cullBoxesParallel(cullPool, Frustum(lightSpace), gBuildingBounds, shadowVisible, cullStats);
+                                   for (size_t id = 0; id < gBuildings.size(); ++id) {
+                                       if (!shadowVisible[id]) continue;
+                                       BUILDING_T& b = gBuildings[id];
+                                       int lod = b.lodLevel; // the view's LOD hysteresis stays untouched
+                                       shadowInstances.add(*b.buildingModel, b.transform, b.maxScale, lod);
+                                   }
+                                   casters = cullStats.visible;
+                               } else {
+                                   int lod = carLodLevel;
+                                   shadowInstances.add(*carModelPtr, carTransform, 1.0f, lod);
+                               }
+                               InstanceStats instanceStats;
+                               RenderQueueStats queueStats;
+                               shadowInstances.submit(shadowQueue, ShadowShader, assets.placeholderMesh(), streamRing, instanceStats);
+                               glState().useProgram(ShadowShader.ID);
+                               setUniform(shadowUniforms[UNIFORM_LIGHT_SPACE], lightSpace);
+                               shadowQueue.execute(queueStats);
+                               return casters;
+                           },
+                           gShadowStats);
+        }
+        shadows.upload(streamRing, sunShadows);
+
+        // sort by state and issue everything queued this frame, then the multi-draws
+        renderQueue.execute(gQueueStats);
+        size_t gpuInstancesBefore = gGpuStats.instances;
+        if (gGpuDriven) gpuScene.draw(*gpuShaderHandle, streamRing, gGpuStats);
+
+        // glass: transparent packets blended order-independently over the opaque frame
+        if (renderQueue.hasTransparent() && transparency.begin(frameTarget, framebufferWidth, framebufferHeight)) {
+            renderQueue.executeTransparent();
+            transparency.resolve(*oitResolveHandle);
+        }
+        if (gDynamicResolution) {
+            resolution.upscale(*upscaleHandle);
+            // up to here only: the swap would add the vsync wait, which the scale can't change
+            resolution.update(std::chrono::duration<float>(std::chrono::steady_clock::now() - frameBegin).count(), gResolutionStats);
+        }
+        streamRing.endFrame();
+
+        if (gpuCheck && !streaming && scene.reported) {
+            std::vector<unsigned char> pixels = readFramebuffer(framebufferWidth, framebufferHeight);
+            if (gpuCheckPixels.empty()) {
+                gpuCheckPixels = std::move(pixels);
+                gpuCheckInstances = gGpuStats.instances - gpuInstancesBefore;
+                gGpuDriven = false; // the same view again, instanced
+            } else {
+                exitCode = compareFramebuffers(gpuCheckPixels, pixels, gpuCheckInstances) ? 0 : -1;
+                break;
+            }
         }
 
         // third-person-ish chase camera
@@ -428,19 +1296,148 @@ int main()
         camera.Pitch = -60.0f;
         camera.Position = ourPos;
 
-        // view/projection
+        // camera poses for --check-occlusion
+        if (poseLog.is_open() && currentFrame - poseTime >= POSE_RECORD_INTERVAL) {
+            poseLog << camera.Position.x << " " << camera.Position.y << " " << camera.Position.z << " "
+                    << camera.Front.x << " " << camera.Front.y << " " << camera.Front.z << "\n";
+            poseTime = currentFrame;
+        }
 
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
+        // culling and batching stats, averaged per frame
+        ++clusterStatsFrames;
+        if (currentFrame - clusterStatsTime >= CLUSTER_STATS_INTERVAL) {
+            if (gClusterStats.clusters)
+                std::cout << "Meshlets: " << (gClusterStats.clusters - gClusterStats.frustumCulled - gClusterStats.backfaceCulled) / clusterStatsFrames
+                          << "/" << gClusterStats.clusters / clusterStatsFrames << " visible, "
+                          << gClusterStats.frustumCulled / clusterStatsFrames << " off screen, "
+                          << gClusterStats.backfaceCulled / clusterStatsFrames << " back-facing, "
+                          << gClusterStats.trianglesDrawn / clusterStatsFrames << "/" << gClusterStats.triangles / clusterStatsFrames
+                          << " tris per frame" << std::endl;
+            std::cout << "Draw lists: " << gDrawListStats.lanes / clusterStatsFrames << " lanes on " << cullPool.threadCount()
+                      << " threads, " << gDrawListStats.buildMs / clusterStatsFrames << " ms build, "
+                      << gDrawListStats.mergeMs / clusterStatsFrames << " ms merge per frame" << std::endl;
+            gDrawListStats = DrawListStats();
+            std::cout << "Ground: " << gGroundStats.drawn / clusterStatsFrames << "/" << gGroundStats.resident / clusterStatsFrames
+                      << " tiles drawn, " << gGroundStats.loaded << " loaded, " << gGroundStats.unloaded << " unloaded" << std::endl;
+            gGroundStats = GroundStats();
+            if (gLightStats.lights)
+                std::cout << "Lights: " << gLightStats.lights / clusterStatsFrames << " lights, "
+                          << gLightStats.indices / clusterStatsFrames << " indices in " << gLightStats.clusters / clusterStatsFrames
+                          << "/" << LIGHT_CLUSTER_COUNT << " clusters, " << gLightStats.overflowed / clusterStatsFrames
+                          << " over the cluster limit, " << gLightStats.binMs / clusterStatsFrames << " ms binning per frame" << std::endl;
+            gLightStats = LightStats();
+            if (gShadowStats.dynamicCasters)
+                std::cout << "Shadows: " << gShadowStats.refreshes << " cached cascades redrawn (" << gShadowStats.staticCasters
+                          << " buildings), " << gShadowStats.dynamicCasters / clusterStatsFrames << " moving casters, "
+                          << gShadowStats.ms / clusterStatsFrames << " ms per frame" << std::endl;
+            gShadowStats = ShadowStats();
+            if (gDynamicResolution)
+                std::cout << "Resolution: " << gResolutionStats.scale / clusterStatsFrames << " scale of " << framebufferWidth
+                          << "x" << framebufferHeight << ", " << gResolutionStats.adjustments << " adjustments, "
+                          << (gResolutionStats.gpuFrames ? gResolutionStats.gpuMs / gResolutionStats.gpuFrames : 0.0) << " ms GPU, "
+                          << gResolutionStats.cpuMs / clusterStatsFrames << " ms CPU per frame, target "
+                          << resolution.targetMs << " ms (" << (resolution.gpuTimed() ? "timer queries" : "CPU time") << ")" << std::endl;
+            gResolutionStats = DynamicResolutionStats();
+            std::cout << "Frustum: " << gCullStats.visible / clusterStatsFrames << "/" << gCullStats.tested / clusterStatsFrames
+                      << " objects visible, " << gCullStats.ms / clusterStatsFrames << " ms per frame on "
+                      << cullPool.threadCount() << " threads" << std::endl;
+            if (gOcclusionStats.tested)
+                std::cout << "Occlusion: " << gOcclusionStats.occluded / clusterStatsFrames << "/" << gOcclusionStats.tested / clusterStatsFrames
+                          << " buildings hidden by " << gOcclusionStats.occluders / clusterStatsFrames << " occluders, "
+                          << gOcclusionStats.ms / clusterStatsFrames << " ms per frame" << std::endl;
+            if (gInstanceStats.instances)
+                std::cout << "Instancing: " << gInstanceStats.instances / clusterStatsFrames << " buildings, "
+                          << gInstanceStats.batches / clusterStatsFrames << " batches, "
+                          << gInstanceStats.drawCalls / clusterStatsFrames << " draw calls, "
+                          << gInstanceStats.impostors / clusterStatsFrames << " impostors per frame" << std::endl;
+            std::cout << "Render queue: " << gQueueStats.packets / clusterStatsFrames << " packets ("
+                      << gQueueStats.transparent / clusterStatsFrames << " transparent), programs/textures/VAOs "
+                      << gQueueStats.unsortedPrograms / clusterStatsFrames << "/" << gQueueStats.unsortedTextures / clusterStatsFrames
+                      << "/" << gQueueStats.unsortedVaos / clusterStatsFrames << " unsorted -> "
+                      << gQueueStats.programs / clusterStatsFrames << "/" << gQueueStats.textures / clusterStatsFrames
+                      << "/" << gQueueStats.vaos / clusterStatsFrames << " sorted, " << gQueueStats.sortMs / clusterStatsFrames
+                      << " ms sort per frame" << std::endl;
+            gQueueStats = RenderQueueStats();
+            if (gGpuStats.instances || gGpuStats.fallbacks)
+                std::cout << "GPU-driven: " << gGpuStats.instances / clusterStatsFrames << " instances, "
+                          << gGpuStats.commands / clusterStatsFrames << " commands in " << gGpuStats.multiDraws / clusterStatsFrames
+                          << " multi-draws, " << gGpuStats.fallbacks / clusterStatsFrames << " left to the instanced path, "
+                          << gGpuStats.ms / clusterStatsFrames << " ms per frame, pool " << gpuScene.gpuBytes() / 1024 << " KB" << std::endl;
+            gGpuStats = GpuDrivenStats();
+            std::cout << "Stream ring: " << gRingStats.bytes / 1024 / clusterStatsFrames << " KB per frame, "
+                      << gRingStats.fenceWaits << " fence waits (" << gRingStats.waitMs << " ms), "
+                      << (streamRing.persistent() ? "persistent mapping" : "glBufferSubData") << std::endl;
+            gRingStats = RingStats();
+            GLStateStats& glStats = glState().stats;
+            std::cout << "GL state: " << glStats.issued / clusterStatsFrames << " calls issued, "
+                      << glStats.elided / clusterStatsFrames << " elided per frame" << std::endl;
+            glStats = GLStateStats();
+            gClusterStats = MeshletCullStats();
+            gInstanceStats = InstanceStats();
+            gCullStats = CullStats();
+            gOcclusionStats = OcclusionStats();
+            clusterStatsTime = currentFrame;
+            clusterStatsFrames = 0;
+        }
 
-        // swap/poll
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // swap/poll; headless frames end at glFinish and are timed once everything is in
+        if (headless) {
+            glFinish();
+            double frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameBegin).count();
+            if (!streaming && scene.reported && headlessRun.frameDone(frameMs)) {
+                headlessRun.report(std::cout, framebufferWidth, framebufferHeight);
+                if (!headlessRun.capturePath.empty()) {
+                    glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+                    std::vector<unsigned char> pixels = readFramebuffer(framebufferWidth, framebufferHeight);
+                    if (writePng(headlessRun.capturePath, pixels, framebufferWidth, framebufferHeight))
+                        std::cout << "Captured " << headlessRun.capturePath << std::endl;
+                    else
+                        exitCode = -1;
+                }
+                break;
+            }
+        } else {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+
+        if (firstFrame) {
+            firstFrame = false;
+            std::cout << "First frame: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupBegin).count()
+                      << " ms" << std::endl;
+        }
     }
 
+    // drop every handle while the context is still current so the GL objects are freed
+    gBuildings.clear();
+    gBuildingGrid.clear();
+    gBuildingBounds.clear();
+    registry.releaseTextureArrays();
+    assets.release();
+    gpuScene.release();
+    ground.release();
+    releaseMesh(impostorQuad);
+    lightClusters.release();
+    shadows.release();
+    transparency.release();
+    resolution.release();
+    headlessTarget.release();
+    streamRing.release();
+    scene.models.clear();
+    carModel.reset();
+    texture1.reset();
+    texture2.reset();
+    ourShaderHandle.reset();
+    floorShaderHandle.reset();
+    gpuShaderHandle.reset();
+    impostorShaderHandle.reset();
+    impostorBakeHandle.reset();
+    oitResolveHandle.reset();
+    upscaleHandle.reset();
+    gAssets = nullptr;
+    headlessContext.destroy();
     glfwTerminate();
-    delete buildingModelPtr;
-    return 0;
+    return exitCode;
 }
 
 // --------- Input with rotation-gated collision + axis-wise sliding ---------
@@ -0,0 +1,284 @@
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glm/glm.hpp>
+
+#include "frustum_culling.h"
+#include "lod.h"
+#include "model_asset.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#if FRUSTUM_SIMD
+#include <emmintrin.h>
+#endif
+
+// --------- Occlusion culling ---------
+// Software depth buffer on the CPU. Each frame the nearest frustum-visible objects
+// rasterize their occluder mesh (the coarsest LOD, positions only) into a small depth
+// buffer, four pixels at a time; a max-depth pyramid is built on top, and every other
+// visible object is tested by the nearest depth of its world box against the pyramid
+// level where the box covers at most 4x4 texels. Depth is NDC z, cleared to the far
+// plane. Occluders are sampled at pixel centers, so an object that only shows through
+// a sliver thinner than a pixel can be culled. Width and height must be powers of two.
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_MAX_OCCLUDERS 48
+#define OCCLUSION_CULLING true // default; --no-occlusion turns it off
+
+// Compacted positions of the coarsest LOD. Built on the loader's worker thread.
+template <class MeshList>
+inline OccluderMesh buildOccluderMesh(const MeshList& meshes)
+{
+    OccluderMesh out;
+    for (const auto& mesh : meshes) {
+        std::unordered_map<unsigned int, uint32_t> remap;
+        for (unsigned int index : mesh.indices) {
+            auto it = remap.find(index);
+            if (it == remap.end()) {
+                it = remap.emplace(index, (uint32_t)out.positions.size()).first;
+                out.positions.push_back(mesh.vertices[index].Position);
+            }
+            out.indices.push_back(it->second);
+        }
+    }
+    return out;
+}
+
+struct OcclusionStats {
+    size_t occluders = 0;
+    size_t tested = 0;
+    size_t occluded = 0;
+    double ms = 0.0;
+};
+
+class OcclusionBuffer {
+public:
+    std::vector<float> depth;   // OCCLUSION_WIDTH x OCCLUSION_HEIGHT, row 0 at the bottom
+    std::vector<uint32_t> ids;  // who wrote each pixel, only when `writeIds`
+    bool writeIds = false;
+
+    OcclusionBuffer() : depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f) {}
+
+    void begin(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        std::fill(depth.begin(), depth.end(), 1.0f);
+        if (writeIds) ids.assign(depth.size(), 0);
+    }
+
+    // Rasterizes `mesh` placed by `model`; `id` goes into `ids` when enabled.
+    void drawOccluder(const OccluderMesh& mesh, const glm::mat4& model, uint32_t id = 0)
+    {
+        glm::mat4 m = viewProjection * model;
+        clip.resize(mesh.positions.size());
+        for (size_t i = 0; i < mesh.positions.size(); ++i) clip[i] = m * glm::vec4(mesh.positions[i], 1.0f);
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+            drawClipTriangle(clip[mesh.indices[i]], clip[mesh.indices[i + 1]], clip[mesh.indices[i + 2]], id);
+    }
+
+    // Max-depth pyramid over `depth`; call after the last occluder.
+    void buildHierarchy()
+    {
+        levels.resize(1);
+        levels[0] = depth;
+        int w = OCCLUSION_WIDTH, h = OCCLUSION_HEIGHT;
+        while (w > 1 || h > 1) {
+            int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+            std::vector<float> next(nw * nh);
+            const std::vector<float>& prev = levels.back();
+            for (int y = 0; y < nh; ++y)
+                for (int x = 0; x < nw; ++x) {
+                    int x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+                    int y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+                    next[y * nw + x] = std::max(std::max(prev[y0 * w + x0], prev[y0 * w + x1]),
+                                                std::max(prev[y1 * w + x0], prev[y1 * w + x1]));
+                }
+            levels.push_back(std::move(next));
+            w = nw;
+            h = nh;
+        }
+    }
+
+    // False when the world box is certainly hidden behind what was drawn.
+    bool boxVisible(const glm::vec3& center, const glm::vec3& extent) const
+    {
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearZ = 1.0f;
+        for (int c = 0; c < 8; ++c) {
+            glm::vec3 corner = center + glm::vec3(c & 1 ? extent.x : -extent.x, c & 2 ? extent.y : -extent.y, c & 4 ? extent.z : -extent.z);
+            glm::vec4 p = viewProjection * glm::vec4(corner, 1.0f);
+            if (p.z < -p.w || p.w <= 0.0f) return true; // crosses the near plane
+            glm::vec3 ndc = glm::vec3(p) / p.w;
+            minX = std::min(minX, ndc.x); maxX = std::max(maxX, ndc.x);
+            minY = std::min(minY, ndc.y); maxY = std::max(maxY, ndc.y);
+            nearZ = std::min(nearZ, ndc.z);
+        }
+        int x0 = std::max(0, (int)std::floor((minX * 0.5f + 0.5f) * OCCLUSION_WIDTH));
+        int x1 = std::min(OCCLUSION_WIDTH - 1, (int)std::floor((maxX * 0.5f + 0.5f) * OCCLUSION_WIDTH));
+        int y0 = std::max(0, (int)std::floor((minY * 0.5f + 0.5f) * OCCLUSION_HEIGHT));
+        int y1 = std::min(OCCLUSION_HEIGHT - 1, (int)std::floor((maxY * 0.5f + 0.5f) * OCCLUSION_HEIGHT));
+        if (x0 > x1 || y0 > y1 || levels.empty()) return true;
+
+        int level = 0;
+        while (level + 1 < (int)levels.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3))
+            ++level;
+        int w = std::max(1, OCCLUSION_WIDTH >> level);
+        const std::vector<float>& tiles = levels[level];
+        for (int y = y0 >> level; y <= y1 >> level; ++y)
+            for (int x = x0 >> level; x <= x1 >> level; ++x)
+                if (tiles[y * w + x] >= nearZ) return true;
+        return false;
+    }
+
+private:
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<glm::vec4> clip;
+    std::vector<std::vector<float>> levels;
+
+    // Clips against the near plane (z >= -w), then fans.
+    void drawClipTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, uint32_t id)
+    {
+        glm::vec4 in[3] = { a, b, c };
+        glm::vec4 out[4];
+        int count = 0;
+        for (int i = 0; i < 3; ++i) {
+            const glm::vec4& p = in[i];
+            const glm::vec4& q = in[(i + 1) % 3];
+            float dp = p.z + p.w, dq = q.z + q.w;
+            if (dp >= 0.0f) out[count++] = p;
+            if ((dp >= 0.0f) != (dq >= 0.0f)) out[count++] = p + (q - p) * (dp / (dp - dq));
+        }
+        for (int i = 1; i + 1 < count; ++i) drawScreenTriangle(toScreen(out[0]), toScreen(out[i]), toScreen(out[i + 1]), id);
+    }
+
+    static glm::vec3 toScreen(const glm::vec4& p)
+    {
+        float w = std::max(p.w, 1e-6f);
+        return glm::vec3((p.x / w * 0.5f + 0.5f) * OCCLUSION_WIDTH, (p.y / w * 0.5f + 0.5f) * OCCLUSION_HEIGHT, p.z / w);
+    }
+
+    // Edge functions at pixel centers; both windings are drawn. Everything is relative
+    // to the bounding box corner so the edge constants stay small, and the interpolated
+    // depth is clamped to the vertices' range: slivers would otherwise extrapolate.
+    void drawScreenTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, uint32_t id)
+    {
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (std::fabs(area) < 1e-8f) return;
+        if (area < 0.0f) {
+            std::swap(v1, v2);
+            area = -area;
+        }
+        int x0 = std::max(0, (int)std::floor(std::min(v0.x, std::min(v1.x, v2.x))));
+        int x1 = std::min(OCCLUSION_WIDTH - 1, (int)std::ceil(std::max(v0.x, std::max(v1.x, v2.x))));
+        int y0 = std::max(0, (int)std::floor(std::min(v0.y, std::min(v1.y, v2.y))));
+        int y1 = std::min(OCCLUSION_HEIGHT - 1, (int)std::ceil(std::max(v0.y, std::max(v1.y, v2.y))));
+        x0 &= ~3; // whole groups of four; the buffer width is a multiple of four
+        if (x0 > x1 || y0 > y1) return;
+        glm::vec3 origin((float)x0, (float)y0, 0.0f);
+        v0 -= origin;
+        v1 -= origin;
+        v2 -= origin;
+        float zMin = std::min(v0.z, std::min(v1.z, v2.z)), zMax = std::max(v0.z, std::max(v1.z, v2.z));
+
+        // e_i(x, y) = A_i x + B_i y + C_i, positive inside; barycentric = e_i / area
+        float A[3] = { v1.y - v2.y, v2.y - v0.y, v0.y - v1.y };
+        float B[3] = { v2.x - v1.x, v0.x - v2.x, v1.x - v0.x };
+        float C[3] = { v1.x * v2.y - v2.x * v1.y, v2.x * v0.y - v0.x * v2.y, v0.x * v1.y - v1.x * v0.y };
+        float inv = 1.0f / area;
+        // z(x, y) = zA x + zB y + zC
+        float zA = (A[0] * v0.z + A[1] * v1.z + A[2] * v2.z) * inv;
+        float zB = (B[0] * v0.z + B[1] * v1.z + B[2] * v2.z) * inv;
+        float zC = (C[0] * v0.z + C[1] * v1.z + C[2] * v2.z) * inv;
+
+        for (int y = y0; y <= y1; ++y) {
+            float py = y - y0 + 0.5f;
+            float* row = &depth[y * OCCLUSION_WIDTH];
+            uint32_t* idRow = writeIds ? &ids[y * OCCLUSION_WIDTH] : nullptr;
+            int x = x0;
+#if FRUSTUM_SIMD
+            const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            __m128 e0A = _mm_set1_ps(A[0]), e1A = _mm_set1_ps(A[1]), e2A = _mm_set1_ps(A[2]), vzA = _mm_set1_ps(zA);
+            __m128 e0R = _mm_set1_ps(B[0] * py + C[0]), e1R = _mm_set1_ps(B[1] * py + C[1]), e2R = _mm_set1_ps(B[2] * py + C[2]);
+            __m128 zR = _mm_set1_ps(zB * py + zC);
+            __m128 vzMin = _mm_set1_ps(zMin), vzMax = _mm_set1_ps(zMax);
+            __m128i idv = _mm_set1_epi32((int)id);
+            for (; x <= x1; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)(x - x0)), offsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(e0A, px), e0R);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(e1A, px), e1R);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(e2A, px), e2R);
+                __m128 inside = _mm_cmpge_ps(_mm_min_ps(e0, _mm_min_ps(e1, e2)), _mm_setzero_ps());
+                __m128 z = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(vzA, px), zR), vzMin), vzMax);
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 closer = _mm_and_ps(inside, _mm_cmplt_ps(z, old));
+                if (!_mm_movemask_ps(closer)) continue;
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(closer, z), _mm_andnot_ps(closer, old)));
+                if (idRow) {
+                    __m128i mask = _mm_castps_si128(closer);
+                    __m128i prev = _mm_loadu_si128((const __m128i*)(idRow + x));
+                    _mm_storeu_si128((__m128i*)(idRow + x), _mm_or_si128(_mm_and_si128(mask, idv), _mm_andnot_si128(mask, prev)));
+                }
+            }
+#endif
+            for (; x <= x1; ++x) {
+                float px = x - x0 + 0.5f;
+                float e0 = A[0] * px + B[0] * py + C[0];
+                float e1 = A[1] * px + B[1] * py + C[1];
+                float e2 = A[2] * px + B[2] * py + C[2];
+                if (e0 < 0.0f || e1 < 0.0f || e2 < 0.0f) continue;
+                float z = std::min(std::max(zA * px + zB * py + zC, zMin), zMax);
+                if (z >= row[x]) continue;
+                row[x] = z;
+                if (idRow) idRow[x] = id;
+            }
+        }
+    }
+};
+
+// Occlusion pass over a frustum-culled set: the OCCLUSION_MAX_OCCLUDERS visible
+// objects that look biggest from `eye` draw their occluders, every other visible
+// object is tested and has visible[id] cleared when hidden. `occluderOf(id, mesh,
+// transform)` returns false for objects without an occluder yet (still streaming).
+template <class OccluderOf>
+inline void occlusionCull(OcclusionBuffer& buffer, const glm::mat4& viewProjection, const glm::vec3& eye,
+                          const CullSet& set, std::vector<uint8_t>& visible, OccluderOf occluderOf, OcclusionStats& stats)
+{
+    auto begin = std::chrono::steady_clock::now();
+    static std::vector<std::pair<float, uint32_t>> ranked;
+    ranked.clear();
+    for (size_t id = 0; id < visible.size(); ++id) {
+        if (!visible[id]) continue;
+        glm::vec3 center(set.cx[id], set.cy[id], set.cz[id]);
+        float size = glm::length(glm::vec3(set.ex[id], set.ey[id], set.ez[id]));
+        ranked.push_back(std::make_pair(-size / std::max(glm::length(center - eye), 1e-3f), (uint32_t)id));
+    }
+    size_t occluders = std::min<size_t>(OCCLUSION_MAX_OCCLUDERS, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + occluders, ranked.end());
+
+    buffer.begin(viewProjection);
+    for (size_t i = 0; i < occluders; ++i) {
+        const OccluderMesh* mesh = nullptr;
+        const glm::mat4* transform = nullptr;
+        if (!occluderOf(ranked[i].second, mesh, transform) || mesh->indices.empty()) continue;
+        buffer.drawOccluder(*mesh, *transform, ranked[i].second + 1);
+        ++stats.occluders;
+    }
+    buffer.buildHierarchy();
+
+    for (size_t i = occluders; i < ranked.size(); ++i) {
+        uint32_t id = ranked[i].second;
+        ++stats.tested;
+        if (buffer.boxVisible(glm::vec3(set.cx[id], set.cy[id], set.cz[id]), glm::vec3(set.ex[id], set.ey[id], set.ez[id])))
+            continue;
+        visible[id] = 0;
+        ++stats.occluded;
+    }
+    stats.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader_m.h>
+
+#include "gl_state.h"
+#include "uniforms.h"
+#include "vertex_quantize.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// --------- Texture binding ---------
+#define TEXTURE_ARRAY_UNIT 8 // texture unit of `diffuseArray` in 1.model_loading.fs
+
+inline void bindTextureArray(unsigned int id)
+{
+    glState().bindTexture(TEXTURE_ARRAY_UNIT, GL_TEXTURE_2D_ARRAY, id);
+}
+
+// Same texture binding as learnopengl's Mesh::Draw: unit i gets textures[i], and the
+// sampler uniform named after its type and number points at it (cached locations of
+// the current program).
+inline void bindTextures(const std::vector<Texture>& textures, const ProgramUniforms& uniforms)
+{
+    static const char* const types[UNIFORM_SAMPLER_TYPES] = {
+        "texture_diffuse", "texture_specular", "texture_normal", "texture_height"
+    };
+    int numbers[UNIFORM_SAMPLER_TYPES] = {};
+    for (unsigned int i = 0; i < textures.size(); i++) {
+        const std::string& name = textures[i].type;
+        for (int t = 0; t < UNIFORM_SAMPLER_TYPES; ++t)
+            if (name == types[t]) {
+                if (numbers[t] < UNIFORM_SAMPLERS_PER_TYPE) glUniform1i(uniforms.samplers[t][numbers[t]], i);
+                ++numbers[t];
+                break;
+            }
+        glState().bindTexture(i, GL_TEXTURE_2D, textures[i].id);
+    }
+}
+
+// --------- Render queue ---------
+// Draws are recorded as packets during the frame and issued in one go after a radix
+// sort on a 64-bit key, so packets that share a program, texture and VAO end up next
+// to each other and each switch happens once:
+//   63..60 pass | 59..52 shader | 51..36 texture | 35..20 mesh (VAO) | 19..0 depth
+// Depth is the distance to the camera, front to back, as a tie-breaker inside a state
+// group (cheap early-z for opaque draws). Texture and VAO fields are the low 16 bits
+// of the GL names; a collision only costs an extra switch, never a wrong draw.
+#define RENDER_PASS_OPAQUE 0
+#define RENDER_PASS_TRANSPARENT 1 // weighted blended, see transparency.h; needs no depth order
+#define RENDER_QUEUE_FAR 100.0f // depth range of the key, the camera's far plane
+
+struct DrawPacket {
+    uint64_t key = 0;
+    Shader* shader = nullptr;
+    unsigned int vao = 0;
+    bool indexed = true;
+    GLsizei count = 0;             // indices, or vertices when not indexed
+    size_t first = 0;              // first index / vertex
+    int matrix = -1;               // RenderQueue::matrix() slot for "model", -1 = leave as is
+    const VertexDecode* decode = nullptr; // null = float vertices
+    const std::vector<Texture>* textures = nullptr; // 2D textures, bound like Mesh::Draw
+    unsigned int textureArray = 0; // used instead of `textures` when set
+    int layer = -1;                // diffuseLayer
+    float opacity = -1.0f;         // material opacity of a transparent mesh, -1 = opaque
+    unsigned int instanceBuffer = 0; // mat4 per instance at INSTANCE_MATRIX_ATTRIB when set
+    size_t instanceFirst = 0;
+    unsigned int fadeBuffer = 0;   // float per instance at INSTANCE_FADE_ATTRIB when set, else 0
+    size_t fadeFirst = 0;
+    GLsizei instances = 0;
+};
+
+// Switches needed for one frame's packets, in submission order and after sorting.
+struct RenderQueueStats {
+    size_t packets = 0;
+    size_t programs = 0, textures = 0, vaos = 0;                   // sorted
+    size_t unsortedPrograms = 0, unsortedTextures = 0, unsortedVaos = 0; // submission order
+    size_t transparent = 0;                                        // of `packets`
+    double sortMs = 0.0;
+};
+
+inline uint64_t renderSortKey(unsigned int pass, unsigned int shader, unsigned int texture, unsigned int vao, float distance)
+{
+    uint64_t depth = (uint64_t)(glm::clamp(distance / RENDER_QUEUE_FAR, 0.0f, 1.0f) * 0xFFFFF);
+    return (uint64_t)(pass & 0xF) << 60 | (uint64_t)(shader & 0xFF) << 52 | (uint64_t)(texture & 0xFFFF) << 36
+         | (uint64_t)(vao & 0xFFFF) << 20 | depth;
+}
+
+#define INSTANCE_MATRIX_ATTRIB 7 // aInstanceModel in 1.model_loading.vs, locations 7..10
+#define INSTANCE_FADE_ATTRIB 11  // aInstanceFade in 1.model_loading.vs and impostor.vs (impostors.h)
+
+class RenderQueue {
+public:
+    void begin()
+    {
+        packets.clear();
+        matrices.clear();
+    }
+
+    // Slot for a model matrix that lives until execute().
+    int matrix(const glm::mat4& m)
+    {
+        matrices.push_back(m);
+        return (int)matrices.size() - 1;
+    }
+
+    // Fills in the key from the packet's state; `distance` from the camera. Packets of
+    // transparent materials (an opacity) always go to RENDER_PASS_TRANSPARENT.
+    void submit(DrawPacket packet, unsigned int pass, float distance)
+    {
+        if (packet.opacity >= 0.0f) pass = RENDER_PASS_TRANSPARENT;
+        unsigned int texture = packet.textures && !packet.textures->empty() ? packet.textures->front().id : packet.textureArray;
+        packet.key = renderSortKey(pass, shaderIndex(packet.shader), texture, packet.vao, distance);
+        packets.push_back(packet);
+    }
+
+    // Moves `lane`'s packets (a queue filled on a worker thread, see draw_lists.h)
+    // behind this queue's, renumbering their matrix slots and the key's shader field.
+    void append(const RenderQueue& lane)
+    {
+        int base = (int)matrices.size();
+        matrices.insert(matrices.end(), lane.matrices.begin(), lane.matrices.end());
+        for (DrawPacket packet : lane.packets) {
+            if (packet.matrix >= 0) packet.matrix += base;
+            packet.key = (packet.key & ~((uint64_t)0xFF << 52)) | (uint64_t)(shaderIndex(packet.shader) & 0xFF) << 52;
+            packets.push_back(packet);
+        }
+    }
+
+    // Sorts everything queued and issues the opaque packets. The transparent ones are
+    // left for executeTransparent(); a queue that never calls it (shadow casters) just
+    // skips them.
+    void execute(RenderQueueStats& stats)
+    {
+        transparentFirst = 0;
+        order.clear();
+        if (packets.empty()) return;
+        auto begin = std::chrono::steady_clock::now();
+        order.resize(packets.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = (uint32_t)i;
+        countSwitches(stats.unsortedPrograms, stats.unsortedTextures, stats.unsortedVaos);
+        radixSort();
+        stats.sortMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        countSwitches(stats.programs, stats.textures, stats.vaos);
+        stats.packets += packets.size();
+        transparentFirst = order.size();
+        while (transparentFirst > 0 && packets[order[transparentFirst - 1]].key >> 60 == RENDER_PASS_TRANSPARENT)
+            --transparentFirst;
+        stats.transparent += order.size() - transparentFirst;
+
+        // opaque pass state; elided by the state cache unless something changed it
+        glState().enable(GL_DEPTH_TEST, true);
+        glState().depthMask(true);
+        glState().enable(GL_BLEND, false);
+        issue(0, transparentFirst, false);
+    }
+
+    bool hasTransparent() const { return transparentFirst < order.size(); }
+
+    // The transparent packets of the last execute(), into the accumulation targets
+    // WeightedBlendedOIT::begin() bound: depth tested but not written, color summed,
+    // revealage (alpha) multiplied. Leaves blending on; the resolve restores the state.
+    void executeTransparent()
+    {
+        if (!hasTransparent()) return;
+        glState().enable(GL_DEPTH_TEST, true);
+        glState().depthMask(false);
+        glState().enable(GL_BLEND, true);
+        glState().blendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+        issue(transparentFirst, order.size(), true);
+    }
+
+private:
+    std::vector<DrawPacket> packets;
+    std::vector<glm::mat4> matrices;
+    std::vector<uint32_t> order, scratch;
+    std::vector<Shader*> shaders; // index = shader field of the key
+    size_t transparentFirst = 0;  // into `order`, after execute()
+
+    // Draws order[first, last); `transparent` also sets each packet's opacity.
+    void issue(size_t first, size_t last, bool transparent)
+    {
+        // what the current program's uniforms hold; unknown right after a switch
+        Shader* program = nullptr;
+        const ProgramUniforms* uniforms = nullptr;
+        const std::vector<Texture>* textures = nullptr;
+        const VertexDecode* decode = nullptr;
+        int layer = INT_MIN, model = -1, instanced = -1;
+        float opacity = -1.0f;
+        static const VertexDecode floatVertices;
+        auto leaveProgram = [&]() {
+            if (!program) return;
+            if (instanced == 1) setUniform((*uniforms)[UNIFORM_INSTANCED], false);
+            if (transparent) setUniform((*uniforms)[UNIFORM_TRANSPARENT_PASS], false);
+        };
+        for (size_t o = first; o < last; ++o) {
+            const DrawPacket& p = packets[order[o]];
+            if (p.shader != program) {
+                leaveProgram();
+                program = p.shader;
+                glState().useProgram(program->ID);
+                uniforms = &uniformsOf(*program);
+                textures = nullptr;
+                decode = nullptr;
+                layer = INT_MIN;
+                model = -1;
+                instanced = -1;
+                opacity = -1.0f;
+                if (transparent) setUniform((*uniforms)[UNIFORM_TRANSPARENT_PASS], true);
+            }
+            if (p.textureArray) {
+                bindTextureArray(p.textureArray);
+            } else if (p.textures && p.textures != textures) {
+                bindTextures(*p.textures, *uniforms);
+                textures = p.textures;
+            }
+            if (p.layer != layer) setUniform((*uniforms)[UNIFORM_DIFFUSE_LAYER], layer = p.layer);
+            if (transparent && p.opacity != opacity) setUniform((*uniforms)[UNIFORM_OPACITY], opacity = p.opacity);
+            const VertexDecode* d = p.decode ? p.decode : &floatVertices;
+            if (d != decode) setVertexDecode(*uniforms, *(decode = d));
+            if (p.matrix >= 0 && p.matrix != model) setUniform((*uniforms)[UNIFORM_MODEL], matrices[model = p.matrix]);
+            if ((int)(p.instances > 0) != instanced) setUniform((*uniforms)[UNIFORM_INSTANCED], (instanced = p.instances > 0) == 1);
+            glState().bindVertexArray(p.vao);
+
+            if (p.instances > 0) {
+                glState().bindBuffer(GL_ARRAY_BUFFER, p.instanceBuffer);
+                for (GLuint column = 0; column < 4; ++column) {
+                    GLuint attrib = INSTANCE_MATRIX_ATTRIB + column;
+                    glEnableVertexAttribArray(attrib);
+                    glVertexAttribPointer(attrib, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                          (void*)(p.instanceFirst * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+                    glVertexAttribDivisor(attrib, 1);
+                }
+                if (p.fadeBuffer) {
+                    glState().bindBuffer(GL_ARRAY_BUFFER, p.fadeBuffer);
+                    glEnableVertexAttribArray(INSTANCE_FADE_ATTRIB);
+                    glVertexAttribPointer(INSTANCE_FADE_ATTRIB, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)(p.fadeFirst * sizeof(float)));
+                    glVertexAttribDivisor(INSTANCE_FADE_ATTRIB, 1);
+                } else {
+                    glVertexAttrib1f(INSTANCE_FADE_ATTRIB, 0.0f);
+                }
+                glDrawElementsInstanced(GL_TRIANGLES, p.count, GL_UNSIGNED_INT, (void*)(p.first * sizeof(unsigned int)), p.instances);
+                // plain draws of the same VAO (car, meshlets) must not read the instance buffer
+                for (GLuint column = 0; column < 4; ++column)
+                    glDisableVertexAttribArray(INSTANCE_MATRIX_ATTRIB + column);
+                if (p.fadeBuffer) glDisableVertexAttribArray(INSTANCE_FADE_ATTRIB);
+            } else if (p.indexed) {
+                glDrawElements(GL_TRIANGLES, p.count, GL_UNSIGNED_INT, (void*)(p.first * sizeof(unsigned int)));
+            } else {
+                glDrawArrays(GL_TRIANGLES, (GLint)p.first, p.count);
+            }
+        }
+        leaveProgram();
+    }
+
+    unsigned int shaderIndex(Shader* shader)
+    {
+        for (size_t i = 0; i < shaders.size(); ++i)
+            if (shaders[i] == shader) return (unsigned int)i;
+        shaders.push_back(shader);
+        return (unsigned int)shaders.size() - 1;
+    }
+
+    // LSD radix sort of `order` by key, 8 bits per pass; passes where every key has
+    // the same byte are skipped (the pass and shader bytes usually are).
+    void radixSort()
+    {
+        scratch.resize(order.size());
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[256] = {};
+            for (uint32_t i : order) ++counts[packets[i].key >> shift & 0xFF];
+            if (counts[packets[order[0]].key >> shift & 0xFF] == order.size()) continue;
+            size_t offsets[256], sum = 0;
+            for (int b = 0; b < 256; ++b) {
+                offsets[b] = sum;
+                sum += counts[b];
+            }
+            for (uint32_t i : order) scratch[offsets[packets[i].key >> shift & 0xFF]++] = i;
+            order.swap(scratch);
+        }
+    }
+
+    void countSwitches(size_t& programs, size_t& textures, size_t& vaos) const
+    {
+        const Shader* program = nullptr;
+        const void* texture = nullptr;
+        unsigned int vao = 0;
+        for (uint32_t index : order) {
+            const DrawPacket& p = packets[index];
+            if (p.shader != program) {
+                ++programs;
+                program = p.shader;
+                texture = nullptr;
+            }
+            const void* t = p.textureArray ? (const void*)(uintptr_t)p.textureArray : (const void*)p.textures;
+            if (t && t != texture) {
+                ++textures;
+                texture = t;
+            }
+            if (p.vao != vao) {
+                ++vaos;
+                vao = p.vao;
+            }
+        }
+    }
+};
+
+#endif
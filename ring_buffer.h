@@ -0,0 +1,222 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// --------- Streaming ring buffer ---------
+// One buffer split into RING_BUFFER_FRAMES regions; each frame writes its dynamic data
+// (instance matrices, the camera block, multi-draw commands) into the next region and
+// fences it when the frame is done. A region is only written again after its fence
+// signalled, so the CPU never overwrites what the GPU may still read and no upload
+// waits on the driver. With GL 4.4 / ARB_buffer_storage the buffer is mapped once,
+// persistent and coherent, and allocations are plain memory writes; without it they go
+// to a staging copy that flush() uploads with glBufferSubData into the fenced region.
+// A frame that outgrows its region moves to a buffer twice the size; the old one is
+// deleted once the GPU is done with it.
+#define RING_BUFFER_FRAMES 3
+#define RING_BUFFER_FRAME_BYTES (4 << 20) // initial size of one frame's region
+#define RING_BUFFER_PERSISTENT true       // persistent mapping where the driver has it
+
+inline bool persistentMappingSupported()
+{
+    return GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4) || GLAD_GL_ARB_buffer_storage;
+}
+
+struct RingAllocation {
+    unsigned int buffer;
+    size_t offset; // bytes into `buffer`
+    void* data;    // write `bytes` here before the next allocate()
+};
+
+struct RingStats {
+    size_t bytes = 0;      // streamed
+    size_t fenceWaits = 0; // regions that were still in use at the start of a frame
+    double waitMs = 0.0;
+    size_t grows = 0;
+};
+
+class StreamRing {
+public:
+    explicit StreamRing(bool persistent = RING_BUFFER_PERSISTENT) : wantPersistent(persistent) {}
+    ~StreamRing() { release(); }
+
+    StreamRing(const StreamRing&) = delete;
+    StreamRing& operator=(const StreamRing&) = delete;
+
+    // Frees the buffers and fences; must run while the context is current.
+    void release()
+    {
+        destroy(buffer, mapped);
+        for (GLsync& fence : fences) deleteFence(fence);
+        for (auto& old : retired) {
+            deleteFence(old.fence);
+            destroy(old.buffer, old.mapped);
+        }
+        retired.clear();
+        frameBytes = 0;
+    }
+
+    bool persistent() const { return mapped != nullptr; }
+
+    // Alignments GL requires for glBindBufferRange offsets.
+    size_t uniformAlignment() const { return uniformAlign; }
+    size_t storageAlignment() const { return storageAlign; }
+
+    // Starts a frame: moves to the next region and waits until the GPU is done with it.
+    void beginFrame(RingStats& stats)
+    {
+        if (!buffer) create(RING_BUFFER_FRAME_BYTES);
+        region = (region + 1) % RING_BUFFER_FRAMES;
+        head = flushed = 0;
+        if (fences[region]) {
+            auto begin = std::chrono::steady_clock::now();
+            if (glClientWaitSync(fences[region], 0, 0) == GL_TIMEOUT_EXPIRED) {
+                ++stats.fenceWaits;
+                while (glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+                stats.waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            }
+            deleteFence(fences[region]);
+        }
+        for (auto it = retired.begin(); it != retired.end();) {
+            if (it->fence && glClientWaitSync(it->fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+                deleteFence(it->fence);
+                destroy(it->buffer, it->mapped);
+                it = retired.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        this->stats = &stats;
+    }
+
+    // `bytes` of this frame's region, `alignment` a power of two.
+    RingAllocation allocate(size_t bytes, size_t alignment)
+    {
+        size_t start = (head + alignment - 1) & ~(alignment - 1);
+        if (start + bytes > frameBytes) {
+            grow(std::max(frameBytes * 2, (bytes + alignment) * 2));
+            start = 0;
+        }
+        head = start + bytes;
+        stats->bytes += bytes;
+        RingAllocation a;
+        a.buffer = buffer;
+        a.offset = region * frameBytes + start;
+        a.data = mapped ? (char*)mapped + a.offset : (void*)(staging.data() + start);
+        return a;
+    }
+
+    // Makes everything allocated so far visible to GL; a no-op with persistent mapping.
+    void flush()
+    {
+        if (mapped || head == flushed) return;
+        glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, region * frameBytes + flushed, head - flushed, staging.data() + flushed);
+        flushed = head;
+    }
+
+    // Ends the frame: the region (and any buffer retired during it) is fenced.
+    void endFrame()
+    {
+        flush();
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        for (auto& old : retired)
+            if (!old.fence) old.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+private:
+    struct Retired {
+        unsigned int buffer;
+        void* mapped;
+        GLsync fence;
+    };
+
+    bool wantPersistent;
+    unsigned int buffer = 0;
+    void* mapped = nullptr;          // whole buffer, persistent mode
+    std::vector<char> staging;       // one region, fallback mode
+    size_t frameBytes = 0;
+    size_t uniformAlign = 256, storageAlign = 256;
+    GLsync fences[RING_BUFFER_FRAMES] = {};
+    int region = 0;
+    size_t head = 0, flushed = 0;    // bytes into the current region
+    std::vector<Retired> retired;
+    RingStats* stats = nullptr;
+
+    void create(size_t bytes)
+    {
+        GLint align = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+        uniformAlign = std::max<size_t>(align, 16);
+        if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3)) {
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+            storageAlign = std::max<size_t>(align, 16);
+        }
+        // regions start aligned for every binding
+        frameBytes = (bytes + 255) & ~(size_t)255;
+        glGenBuffers(1, &buffer);
+        glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        size_t total = frameBytes * RING_BUFFER_FRAMES;
+        if (wantPersistent && persistentMappingSupported()) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, total, NULL, flags);
+            mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags);
+            if (!mapped) std::cout << "Stream ring: Failed to map persistently, using glBufferSubData" << std::endl;
+        }
+        if (!mapped) {
+            if (wantPersistent && persistentMappingSupported()) { // storage is immutable, start over
+                glDeleteBuffers(1, &buffer);
+                glState().forgetBuffer(buffer);
+                glGenBuffers(1, &buffer);
+                glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            }
+            glBufferData(GL_COPY_WRITE_BUFFER, total, NULL, GL_STREAM_DRAW);
+            staging.assign(frameBytes, 0);
+        }
+    }
+
+    // The current frame's allocations stay valid in the old buffer until it is retired.
+    void grow(size_t bytes)
+    {
+        flush();
+        retired.push_back({ buffer, mapped, 0 });
+        buffer = 0;
+        mapped = nullptr;
+        for (GLsync& fence : fences) deleteFence(fence); // the new buffer is idle
+        create(bytes);
+        head = flushed = 0;
+        ++stats->grows;
+        std::cout << "Stream ring: grown to " << frameBytes / 1024 << " KB per frame" << std::endl;
+    }
+
+    static void deleteFence(GLsync& fence)
+    {
+        if (fence) glDeleteSync(fence);
+        fence = 0;
+    }
+
+    static void destroy(unsigned int& buffer, void*& mapped)
+    {
+        if (!buffer) return;
+        if (mapped) {
+            glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        glDeleteBuffers(1, &buffer);
+        glState().forgetBuffer(buffer);
+        buffer = 0;
+        mapped = nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,373 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+// --------- Scene format ---------
+// Text source (.scene), one statement per line, '#' starts a comment:
+//
+//   model <name> <path relative to the scene file> <min x y z> <max x y z>
+//   place <name> <x y z> <rotation y, degrees> <scale x y z>
+//
+// A model must be declared before it is placed; min/max is its local collision box.
+// `--compile-scene` turns it into the binary form (<scene>.bin), which the loader
+// prefers while it is newer than the text:
+//
+//   SceneFileHeader, then per model: u32 name length, name, u32 path length, path,
+//   float min[3], float max[3]; then placementCount packed ScenePlacement records.
+#define SCENE_MAGIC 0x314E4353u        // "SCN1"
+#define SCENE_VERSION 1u
+#define SCENE_BINARY_EXT ".bin"
+#define SCENE_CHUNK_PLACEMENTS 4096    // per message from the parser thread
+#define SCENE_MAX_QUEUED_CHUNKS 64     // parser waits when the game falls this far behind
+
+struct SceneFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t modelCount;
+    uint32_t placementCount;
+};
+
+struct SceneModel {
+    std::string name;
+    std::string path; // absolute once loaded
+    glm::vec3 boxMin;
+    glm::vec3 boxMax;
+};
+
+#pragma pack(push, 1)
+struct ScenePlacement {
+    uint32_t model;     // index into the scene's models
+    float position[3];
+    float rotationY;    // radians
+    float scale[3];
+};
+#pragma pack(pop)
+
+// What the parser thread hands over: models declared since the last chunk, then
+// placements that may refer to any model declared so far.
+struct SceneChunk {
+    std::vector<SceneModel> models;
+    std::vector<ScenePlacement> placements;
+};
+
+inline std::string sceneDirectory(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+// Incremental text parser; feed it lines, it fills `chunk`. Returns false on a bad line.
+class SceneTextParser {
+public:
+    explicit SceneTextParser(const std::string& directory) : directory(directory) {}
+
+    std::vector<std::string> modelNames;
+
+    bool parseLine(const char* line, SceneChunk& chunk)
+    {
+        while (*line == ' ' || *line == '\t') ++line;
+        if (*line == '#' || *line == '\0' || *line == '\r' || *line == '\n') return true;
+
+        char word[16];
+        char name[128];
+        char path[512];
+        int used = 0;
+        if (sscanf(line, "%15s %127s%n", word, name, &used) != 2) return false;
+        line += used;
+
+        if (strcmp(word, "model") == 0) {
+            SceneModel model;
+            float v[6];
+            if (sscanf(line, "%511s%n", path, &used) != 1) return false;
+            line += used;
+            if (!readFloats(line, v, 6)) return false;
+            model.name = name;
+            model.path = directory.empty() ? std::string(path) : directory + "/" + path;
+            model.boxMin = glm::vec3(v[0], v[1], v[2]);
+            model.boxMax = glm::vec3(v[3], v[4], v[5]);
+            modelNames.push_back(model.name);
+            chunk.models.push_back(model);
+            return true;
+        }
+        if (strcmp(word, "place") == 0) {
+            ScenePlacement placement;
+            float v[7];
+            if (!readFloats(line, v, 7)) return false;
+            placement.model = UINT32_MAX;
+            for (size_t i = modelNames.size(); i-- > 0;)
+                if (modelNames[i] == name) {
+                    placement.model = (uint32_t)i;
+                    break;
+                }
+            if (placement.model == UINT32_MAX) return false;
+            memcpy(placement.position, v, sizeof(float) * 3);
+            placement.rotationY = glm::radians(v[3]);
+            memcpy(placement.scale, v + 4, sizeof(float) * 3);
+            chunk.placements.push_back(placement);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    std::string directory;
+
+    static bool readFloats(const char* line, float* out, int count)
+    {
+        char* end;
+        for (int i = 0; i < count; ++i) {
+            out[i] = strtof(line, &end);
+            if (end == line) return false;
+            line = end;
+        }
+        return true;
+    }
+};
+
+// --------- Streaming loader ---------
+// Parses the scene on its own thread in chunks of SCENE_CHUNK_PLACEMENTS; the game
+// pops chunks whenever it likes (usually a few per frame) and builds from them, so a
+// scene of any size starts rendering right away and fills in over the next frames.
+class SceneStreamer {
+public:
+    explicit SceneStreamer(const std::string& path) : path(path)
+    {
+        thread = std::thread(&SceneStreamer::run, this);
+    }
+
+    ~SceneStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    SceneStreamer(const SceneStreamer&) = delete;
+    SceneStreamer& operator=(const SceneStreamer&) = delete;
+
+    bool pop(SceneChunk& chunk)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (chunks.empty()) return false;
+        chunk = std::move(chunks.front());
+        chunks.pop_front();
+        cv.notify_all();
+        return true;
+    }
+
+    // Parsing has ended and every chunk has been popped.
+    bool done()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return finished && chunks.empty();
+    }
+
+    double parseMs = 0.0; // valid once done()
+    bool binary = false;
+
+private:
+    std::string path;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<SceneChunk> chunks;
+    bool finished = false;
+    bool quit = false;
+
+    // false when the game is shutting down
+    bool push(SceneChunk& chunk)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return quit || chunks.size() < SCENE_MAX_QUEUED_CHUNKS; });
+        if (quit) return false;
+        chunks.push_back(std::move(chunk));
+        chunk = SceneChunk();
+        return true;
+    }
+
+    void run()
+    {
+        auto begin = std::chrono::steady_clock::now();
+        std::string bin = path + SCENE_BINARY_EXT;
+        struct stat textStat, binStat;
+        bool haveText = stat(path.c_str(), &textStat) == 0;
+        bool haveBin = stat(bin.c_str(), &binStat) == 0;
+        binary = haveBin && (!haveText || binStat.st_mtime >= textStat.st_mtime);
+        if (binary) streamBinary(bin);
+        else streamText();
+        parseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+
+    void streamText()
+    {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "Scene: Failed to open " << path << std::endl;
+            return;
+        }
+        SceneTextParser parser(sceneDirectory(path));
+        SceneChunk chunk;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            ++lineNumber;
+            if (!parser.parseLine(line.c_str(), chunk))
+                std::cout << "Scene: Failed to parse " << path << ":" << lineNumber << ": " << line << std::endl;
+            if (chunk.placements.size() >= SCENE_CHUNK_PLACEMENTS && !push(chunk)) return;
+        }
+        if (!chunk.models.empty() || !chunk.placements.empty()) push(chunk);
+    }
+
+    void streamBinary(const std::string& bin)
+    {
+        FILE* file = fopen(bin.c_str(), "rb");
+        if (!file) {
+            std::cout << "Scene: Failed to open " << bin << std::endl;
+            return;
+        }
+        SceneFileHeader header;
+        SceneChunk chunk;
+        bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == SCENE_MAGIC && header.version == SCENE_VERSION;
+        std::string directory = sceneDirectory(path);
+        for (uint32_t i = 0; ok && i < header.modelCount; ++i) {
+            SceneModel model;
+            std::string* strings[2] = { &model.name, &model.path };
+            for (std::string* s : strings) {
+                uint32_t len = 0;
+                ok = ok && fread(&len, sizeof(len), 1, file) == 1 && len < 4096;
+                if (!ok) break;
+                s->resize(len);
+                ok = len == 0 || fread(&(*s)[0], 1, len, file) == len;
+            }
+            float box[6];
+            ok = ok && fread(box, sizeof(box), 1, file) == 1;
+            model.path = directory + "/" + model.path;
+            model.boxMin = glm::vec3(box[0], box[1], box[2]);
+            model.boxMax = glm::vec3(box[3], box[4], box[5]);
+            chunk.models.push_back(model);
+        }
+        uint32_t remaining = ok ? header.placementCount : 0;
+        while (ok && remaining > 0) {
+            uint32_t count = remaining < SCENE_CHUNK_PLACEMENTS ? remaining : SCENE_CHUNK_PLACEMENTS;
+            chunk.placements.resize(count);
+            ok = fread(chunk.placements.data(), sizeof(ScenePlacement), count, file) == count;
+            for (const auto& p : chunk.placements) ok = ok && p.model < header.modelCount;
+            if (!ok || !push(chunk)) break;
+            remaining -= count;
+        }
+        if (!ok) std::cout << "Scene: Failed to read " << bin << std::endl;
+        else if (!chunk.models.empty()) push(chunk); // no placements at all
+        fclose(file);
+    }
+};
+
+// --------- Offline tools ---------
+// `--compile-scene <scene>`: writes <scene>.bin. Model paths are stored as written.
+inline bool compileScene(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "Scene: Failed to open " << path << std::endl;
+        return false;
+    }
+    SceneTextParser parser(""); // keep the paths relative
+    SceneChunk all;
+    std::string line;
+    int lineNumber = 0;
+    bool ok = true;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        if (!parser.parseLine(line.c_str(), all)) {
+            std::cout << "Scene: Failed to parse " << path << ":" << lineNumber << ": " << line << std::endl;
+            ok = false;
+        }
+    }
+    if (!ok) return false;
+
+    std::string bin = path + SCENE_BINARY_EXT;
+    FILE* out = fopen(bin.c_str(), "wb");
+    if (!out) {
+        std::cout << "Scene: Failed to write " << bin << std::endl;
+        return false;
+    }
+    SceneFileHeader header = { SCENE_MAGIC, SCENE_VERSION, (uint32_t)all.models.size(), (uint32_t)all.placements.size() };
+    fwrite(&header, sizeof(header), 1, out);
+    for (const auto& model : all.models) {
+        const std::string* strings[2] = { &model.name, &model.path };
+        for (const std::string* s : strings) {
+            uint32_t len = (uint32_t)s->size();
+            fwrite(&len, sizeof(len), 1, out);
+            fwrite(s->data(), 1, len, out);
+        }
+        float box[6] = { model.boxMin.x, model.boxMin.y, model.boxMin.z, model.boxMax.x, model.boxMax.y, model.boxMax.z };
+        fwrite(box, sizeof(box), 1, out);
+    }
+    fwrite(all.placements.data(), sizeof(ScenePlacement), all.placements.size(), out);
+    ok = fclose(out) == 0;
+    std::cout << "Scene: " << bin << ": " << all.models.size() << " models, " << all.placements.size() << " placements" << std::endl;
+    return ok;
+}
+
+// `--generate-scene <out> <count>`: a grid of `count` buildings reusing the model
+// declarations of `templatePath`, for load and draw tests at scale. Written as text;
+// model paths are copied as-is, so write it next to the template.
+inline bool generateScene(const std::string& path, const std::string& templatePath, size_t count)
+{
+    std::ifstream in(templatePath);
+    std::ofstream out(path);
+    if (!in || !out) {
+        std::cout << "Scene: Failed to generate " << path << std::endl;
+        return false;
+    }
+    std::vector<std::string> names;
+    std::string line;
+    out << "# generated from " << templatePath << "\n";
+    while (std::getline(in, line))
+        if (line.compare(0, 6, "model ") == 0) {
+            out << line << "\n";
+            char name[128];
+            if (sscanf(line.c_str(), "model %127s", name) == 1) names.push_back(name);
+        }
+    if (names.empty()) return false;
+
+    size_t side = (size_t)std::ceil(std::sqrt((double)count));
+    const float spacing = 12.0f;
+    uint32_t seed = 12345u;
+    auto rnd = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) / 16777216.0f; };
+    size_t written = 0;
+    for (size_t i = 0; written < count; ++i) {
+        float x = ((float)(i % (side + 1)) - side * 0.5f) * spacing;
+        float z = ((float)(i / (side + 1)) - side * 0.5f) * spacing;
+        if (std::fabs(x) < spacing && std::fabs(z) < spacing) continue; // keep the car's start clear
+        ++written;
+        float s = 0.03f + rnd() * 0.03f;
+        out << "place " << names[written % names.size()] << " " << x << " 0 " << z << " " << (rnd() < 0.5f ? 0 : 180)
+            << " " << s << " " << s << " " << s << "\n";
+    }
+    std::cout << "Scene: " << path << ": " << count << " placements" << std::endl;
+    return true;
+}
+
+#endif
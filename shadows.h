@@ -0,0 +1,227 @@
+#ifndef SHADOWS_H
+#define SHADOWS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gl_state.h"
+#include "ring_buffer.h"
+#include "uniforms.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+// --------- Cascaded sun shadows ---------
+// The view up to SHADOW_DISTANCE is split into SHADOW_CASCADES depth ranges, each with
+// its own orthographic light view in one layer of a depth texture array. Buildings do
+// not move, so their depth is rendered into a separate cached array and only redrawn
+// for a cascade once the view leaves what that cascade covers: a cascade is fitted
+// around the bounding sphere of its part of the view (so turning the camera does not
+// change its size), padded by SHADOW_CACHE_PADDING and snapped to whole texels. Every
+// frame the cached layers are copied into the sampled array and the moving casters
+// (the car) are drawn on top. invalidate() drops the cache when the static scene
+// changed (buildings placed, models streamed in).
+#define SHADOWS true // default; --no-shadows turns them off
+#define SHADOW_CASCADES 3
+#define SHADOW_MAP_SIZE 1024
+#define SHADOW_DISTANCE 60.0f        // view depth where the last cascade ends
+#define SHADOW_SPLIT_LAMBDA 0.7f     // 0 = even splits, 1 = logarithmic
+#define SHADOW_CACHE_PADDING 1.25f   // a cascade covers this much more than its view range
+#define SHADOW_CASTER_DEPTH 50.0f    // extra depth towards the sun for casters outside the view
+#define SHADOW_DARKNESS 0.45f        // light taken away in full shadow
+#define SHADOW_MAP_UNIT 10           // texture unit of `shadowMap`
+#define SHADOW_SUN_DIRECTION glm::vec3(-0.4f, -1.0f, 0.3f) // the way the sunlight travels
+
+// std140 mirror of the shaders' Shadows block.
+struct ShadowData {
+    glm::mat4 lightSpace[SHADOW_CASCADES];
+    glm::vec4 cascadeEnds;    // view depth where each cascade ends
+    glm::vec4 normalOffsets;  // per cascade, world units receivers move along the normal
+    glm::vec4 sun;            // xyz towards the sun, w = SHADOW_DARKNESS, 0 = no shadows
+};
+static_assert(sizeof(ShadowData) == 64 * SHADOW_CASCADES + 48, "must match the std140 Shadows block");
+static_assert(SHADOW_CASCADES <= 4, "cascadeEnds holds four");
+
+struct ShadowStats {
+    size_t refreshes = 0;      // cached cascades redrawn
+    size_t staticCasters = 0;  // drawn by those refreshes
+    size_t dynamicCasters = 0;
+    double ms = 0.0;
+};
+
+class CascadedShadows {
+public:
+    // Draws the static (buildings) or the moving casters of `cascade` with `lightSpace`
+    // into the bound depth target; returns how many objects it drew.
+    typedef std::function<size_t(int cascade, const glm::mat4& lightSpace, bool staticCasters)> DrawCasters;
+
+    CascadedShadows() {}
+    ~CascadedShadows() { release(); }
+
+    CascadedShadows(const CascadedShadows&) = delete;
+    CascadedShadows& operator=(const CascadedShadows&) = delete;
+
+    // Frees the maps; must run while the context is current.
+    void release()
+    {
+        if (cachedMaps) glDeleteTextures(1, &cachedMaps);
+        if (maps) glDeleteTextures(1, &maps);
+        if (cachedFbo) glDeleteFramebuffers(1, &cachedFbo);
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        cachedMaps = maps = cachedFbo = fbo = 0;
+        invalidate();
+    }
+
+    // Redraws every cached cascade next frame.
+    void invalidate()
+    {
+        for (Cascade& c : cascades) c.valid = false;
+    }
+
+    // Fits the cascades to the view of `view` with a (fovY, aspect, zNear) perspective,
+    // redraws the stale cached ones and composites the moving casters; then binds
+    // `target` again with a viewport of the given size.
+    void render(const glm::mat4& view, float fovY, float aspect, float zNear, unsigned int target,
+                int viewportWidth, int viewportHeight, const DrawCasters& draw, ShadowStats& stats)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        if (!maps) create();
+        glm::mat4 inverseView = glm::inverse(view);
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), glm::normalize(SHADOW_SUN_DIRECTION), glm::vec3(0.0f, 0.0f, 1.0f));
+        float tanY = std::tan(fovY * 0.5f), tanX = tanY * aspect;
+
+        glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+        glState().enable(GL_DEPTH_TEST, true);
+        glState().depthMask(true);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        float start = zNear;
+        for (int i = 0; i < SHADOW_CASCADES; ++i) {
+            Cascade& c = cascades[i];
+            float t = (float)(i + 1) / SHADOW_CASCADES;
+            float end = SHADOW_SPLIT_LAMBDA * zNear * std::pow(SHADOW_DISTANCE / zNear, t)
+                      + (1.0f - SHADOW_SPLIT_LAMBDA) * (zNear + (SHADOW_DISTANCE - zNear) * t);
+            c.end = end;
+
+            // bounding sphere of this part of the view, in light space
+            glm::vec3 corners[8], center(0.0f);
+            for (int k = 0; k < 8; ++k) {
+                float d = k < 4 ? start : end;
+                corners[k] = glm::vec3(inverseView * glm::vec4((k & 1 ? 1.0f : -1.0f) * d * tanX, (k & 2 ? 1.0f : -1.0f) * d * tanY, -d, 1.0f));
+                center += corners[k] / 8.0f;
+            }
+            float radius = 0.0f;
+            for (const glm::vec3& p : corners) radius = std::max(radius, glm::length(p - center));
+            radius = std::ceil(radius * 16.0f) / 16.0f; // steady size while the view only turns
+            glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+            start = end;
+
+            glm::vec3 offset = glm::abs(lightCenter - c.center);
+            bool covered = c.valid && radius <= c.radius && std::max(std::max(offset.x, offset.y), offset.z) + radius <= c.halfSize;
+            if (!covered) {
+                c.radius = radius;
+                c.halfSize = radius * SHADOW_CACHE_PADDING;
+                c.texel = 2.0f * c.halfSize / SHADOW_MAP_SIZE;
+                c.center = glm::vec3(std::floor(lightCenter.x / c.texel) * c.texel, std::floor(lightCenter.y / c.texel) * c.texel,
+                                     lightCenter.z);
+                // the light looks down -z, casters between it and the view are at larger z
+                glm::mat4 projection = glm::ortho(c.center.x - c.halfSize, c.center.x + c.halfSize,
+                                                  c.center.y - c.halfSize, c.center.y + c.halfSize,
+                                                  -(c.center.z + c.halfSize + SHADOW_CASTER_DEPTH), -(c.center.z - c.halfSize));
+                c.lightSpace = projection * lightView;
+                c.valid = true;
+                glBindFramebuffer(GL_FRAMEBUFFER, cachedFbo);
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cachedMaps, 0, i);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                stats.staticCasters += draw(i, c.lightSpace, true);
+                ++stats.refreshes;
+            }
+
+            // cached layer, then the moving casters on top
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, cachedFbo);
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cachedMaps, 0, i);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, maps, 0, i);
+            glBlitFramebuffer(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE,
+                              GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            stats.dynamicCasters += draw(i, c.lightSpace, false);
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(0, 0, viewportWidth, viewportHeight);
+        stats.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // Writes the cascades of the last render() into `ring` and binds them with the maps;
+    // with `enabled` false the shaders skip the lookup.
+    void upload(StreamRing& ring, bool enabled)
+    {
+        if (!maps) create();
+        ShadowData data;
+        for (int i = 0; i < SHADOW_CASCADES; ++i) {
+            data.lightSpace[i] = cascades[i].lightSpace;
+            data.cascadeEnds[i] = cascades[i].end;
+            data.normalOffsets[i] = cascades[i].texel * 1.5f;
+        }
+        data.sun = glm::vec4(-glm::normalize(SHADOW_SUN_DIRECTION), enabled ? SHADOW_DARKNESS : 0.0f);
+        RingAllocation slice = ring.allocate(sizeof(ShadowData), ring.uniformAlignment());
+        memcpy(slice.data, &data, sizeof(ShadowData));
+        ring.flush();
+        glState().bindBufferRange(GL_UNIFORM_BUFFER, SHADOW_UNIFORM_BINDING, slice.buffer, slice.offset, sizeof(ShadowData));
+        glState().bindTexture(SHADOW_MAP_UNIT, GL_TEXTURE_2D_ARRAY, maps);
+    }
+
+private:
+    struct Cascade {
+        bool valid = false;
+        glm::vec3 center = glm::vec3(0.0f); // light space, x and y on the texel grid
+        float radius = 0.0f;                // of the view range it was fitted to
+        float halfSize = 0.0f;
+        float texel = 0.0f;
+        float end = 0.0f;
+        glm::mat4 lightSpace = glm::mat4(1.0f);
+    };
+
+    Cascade cascades[SHADOW_CASCADES];
+    unsigned int cachedMaps = 0, maps = 0; // depth arrays, one layer per cascade
+    unsigned int cachedFbo = 0, fbo = 0;
+
+    void create()
+    {
+        GLint bound = 0; // upload() may run with the frame's target bound
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+        for (unsigned int* texture : { &cachedMaps, &maps }) {
+            glGenTextures(1, texture);
+            glState().bindTexture(SHADOW_MAP_UNIT, GL_TEXTURE_2D_ARRAY, *texture);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, SHADOW_CASCADES,
+                         0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            const float border[] = { 1.0f, 1.0f, 1.0f, 1.0f }; // outside every cascade = lit
+            glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        }
+        for (unsigned int* target : { &cachedFbo, &fbo }) {
+            glGenFramebuffers(1, target);
+            glBindFramebuffer(GL_FRAMEBUFFER, *target);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, *target == fbo ? maps : cachedMaps, 0, 0);
+            glDrawBuffer(GL_NONE); // depth only
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Shadows: Failed to create the shadow map framebuffer" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, bound);
+    }
+};
+
+#endif
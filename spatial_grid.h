@@ -0,0 +1,74 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// --------- Spatial grid ---------
+// Uniform hash grid over the ground plane (x/z). Static objects are inserted once with
+// their world box; a box query returns every id whose box touches the same cells, each
+// id once. The city is flat, so height is ignored.
+#define SPATIAL_GRID_CELL 16.0f
+
+class SpatialGrid {
+public:
+    explicit SpatialGrid(float cellSize = SPATIAL_GRID_CELL) : cellSize(cellSize) {}
+
+    void insert(uint32_t id, const glm::vec3& mn, const glm::vec3& mx)
+    {
+        int x0, z0, x1, z1;
+        cellRange(mn, mx, x0, z0, x1, z1);
+        for (int z = z0; z <= z1; ++z)
+            for (int x = x0; x <= x1; ++x)
+                cells[key(x, z)].push_back(id);
+        if (id >= stamps.size()) stamps.resize(id + 1, 0);
+    }
+
+    // Appends to `out` (not cleared) the ids that may overlap [mn, mx].
+    void query(const glm::vec3& mn, const glm::vec3& mx, std::vector<uint32_t>& out)
+    {
+        int x0, z0, x1, z1;
+        cellRange(mn, mx, x0, z0, x1, z1);
+        ++stamp;
+        for (int z = z0; z <= z1; ++z)
+            for (int x = x0; x <= x1; ++x) {
+                auto it = cells.find(key(x, z));
+                if (it == cells.end()) continue;
+                for (uint32_t id : it->second) {
+                    if (stamps[id] == stamp) continue; // spans several cells
+                    stamps[id] = stamp;
+                    out.push_back(id);
+                }
+            }
+    }
+
+    void clear()
+    {
+        cells.clear();
+        stamps.clear();
+    }
+
+    size_t cellCount() const { return cells.size(); }
+
+private:
+    float cellSize;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    std::vector<uint32_t> stamps; // per id, last query that returned it
+    uint32_t stamp = 0;
+
+    static uint64_t key(int x, int z) { return (uint64_t)(uint32_t)x << 32 | (uint32_t)z; }
+
+    void cellRange(const glm::vec3& mn, const glm::vec3& mx, int& x0, int& z0, int& x1, int& z1) const
+    {
+        x0 = (int)std::floor(mn.x / cellSize);
+        z0 = (int)std::floor(mn.z / cellSize);
+        x1 = (int)std::floor(mx.x / cellSize);
+        z1 = (int)std::floor(mx.z / cellSize);
+    }
+};
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include "model_asset.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+
+// --------- Texture array packing ---------
+// Groups packable textures by size, format and mip count and copies each group into
+// one GL_TEXTURE_2D_ARRAY, a layer per texture. Meshes whose diffuse texture is packed
+// then only differ by a layer index, so any number of them draw with one texture bind
+// (and later in one batch). The copy goes texture -> pixel buffer -> array layer and
+// never leaves the GPU. A group is rebuilt whole when a member joins, leaves or is
+// reloaded; that only happens while the loader is idle, so nothing is mid-stream.
+struct TextureArray {
+    unsigned int id = 0;
+    int width = 0, height = 0, levels = 0;
+    unsigned int glFormat = 0;
+    std::vector<std::pair<const TextureAsset*, unsigned int>> layers; // member, its version when copied
+    size_t gpuBytes = 0;
+};
+
+inline size_t textureLevelBytes(unsigned int glFormat, int w, int h)
+{
+    if (glFormat == GL_RGBA8) return (size_t)w * h * 4;
+    size_t blocks = (size_t)((w + 3) / 4) * ((h + 3) / 4);
+    return blocks * (glFormat == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ? 8 : 16);
+}
+
+class TextureArrayPacker {
+public:
+    TextureArrayPacker() {}
+    ~TextureArrayPacker() { clear(); }
+
+    TextureArrayPacker(const TextureArrayPacker&) = delete;
+    TextureArrayPacker& operator=(const TextureArrayPacker&) = delete;
+
+    // Frees every array; must run while the context is current (the destructor calls
+    // it too, for packers that die before the context does).
+    void clear()
+    {
+        for (auto& a : arrays) glDeleteTextures(1, &a.second.id);
+        arrays.clear();
+        if (pbo) glDeleteBuffers(1, &pbo);
+        pbo = 0;
+    }
+
+    // `textures`: every live packable texture. Returns the number of arrays rebuilt.
+    int pack(const std::vector<TextureHandle>& textures)
+    {
+        std::map<Key, std::vector<TextureAsset*>> groups;
+        for (const auto& t : textures)
+            if (t->resident && !t->aliasOf && t->levels > 0)
+                groups[Key(t->width, t->height, t->glFormat, t->levels)].push_back(t.get());
+
+        int rebuilt = 0;
+        for (auto it = arrays.begin(); it != arrays.end();) {
+            if (groups.count(it->first)) { ++it; continue; }
+            glDeleteTextures(1, &it->second.id);
+            it = arrays.erase(it);
+            ++rebuilt;
+        }
+        for (auto& group : groups) {
+            TextureArray& array = arrays[group.first];
+            if (!upToDate(array, group.second)) {
+                build(array, group.first, group.second);
+                ++rebuilt;
+            }
+            for (size_t layer = 0; layer < group.second.size(); ++layer) {
+                group.second[layer]->arrayId = array.id;
+                group.second[layer]->arrayLayer = (int)layer;
+            }
+        }
+
+        // aliases share their twin's layer; anything not resident yet stays unpacked
+        for (const auto& t : textures) {
+            const TextureAsset* source = t->aliasOf ? t->aliasOf.get() : t.get();
+            bool packed = source->resident && source->levels > 0 && arrays.count(Key(source->width, source->height, source->glFormat, source->levels));
+            t->arrayId = packed ? source->arrayId : 0;
+            t->arrayLayer = packed ? source->arrayLayer : -1;
+        }
+        return rebuilt;
+    }
+
+    void report(std::ostream& out) const
+    {
+        for (const auto& a : arrays)
+            out << "  array   " << std::setw(8) << a.second.gpuBytes / 1024 << " KB  " << a.second.layers.size() << " layers "
+                << a.second.width << "x" << a.second.height << ", " << a.second.levels << " levels" << std::endl;
+    }
+
+    size_t gpuBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto& a : arrays) bytes += a.second.gpuBytes;
+        return bytes;
+    }
+
+private:
+    typedef std::tuple<int, int, unsigned int, int> Key; // width, height, format, levels
+    std::map<Key, TextureArray> arrays;
+    unsigned int pbo = 0;
+
+    static bool upToDate(const TextureArray& array, const std::vector<TextureAsset*>& members)
+    {
+        if (!array.id || array.layers.size() != members.size()) return false;
+        for (size_t i = 0; i < members.size(); ++i)
+            if (array.layers[i].first != members[i] || array.layers[i].second != members[i]->version) return false;
+        return true;
+    }
+
+    void build(TextureArray& array, const Key& key, const std::vector<TextureAsset*>& members)
+    {
+        if (array.id) glDeleteTextures(1, &array.id);
+        array.width = std::get<0>(key);
+        array.height = std::get<1>(key);
+        array.glFormat = std::get<2>(key);
+        array.levels = std::get<3>(key);
+        array.layers.clear();
+        array.gpuBytes = 0;
+        bool compressed = array.glFormat != GL_RGBA8;
+        GLsizei layers = (GLsizei)members.size();
+
+        glGenTextures(1, &array.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+        int w = array.width, h = array.height;
+        for (int level = 0; level < array.levels; ++level) {
+            size_t bytes = textureLevelBytes(array.glFormat, w, h);
+            if (compressed)
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, array.glFormat, w, h, layers, 0, (GLsizei)(bytes * layers), NULL);
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            array.gpuBytes += bytes * layers;
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, array.levels - 1);
+
+        if (!pbo) glGenBuffers(1, &pbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t layer = 0; layer < members.size(); ++layer) {
+            const TextureAsset& texture = *members[layer];
+            w = array.width;
+            h = array.height;
+            for (int level = 0; level < array.levels; ++level) {
+                size_t bytes = textureLevelBytes(array.glFormat, w, h);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+                glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)bytes, NULL, GL_STREAM_COPY);
+                glBindTexture(GL_TEXTURE_2D, texture.id);
+                if (compressed) glGetCompressedTexImage(GL_TEXTURE_2D, level, (void*)0);
+                else glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+                glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+                if (compressed)
+                    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, (GLint)layer, w, h, 1, array.glFormat, (GLsizei)bytes, (void*)0);
+                else
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, (GLint)layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                w = std::max(1, w / 2);
+                h = std::max(1, h / 2);
+            }
+            array.layers.push_back(std::make_pair(members[layer], members[layer]->version));
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+#endif
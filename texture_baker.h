@@ -0,0 +1,472 @@
+#ifndef TEXTURE_BAKER_H
+#define TEXTURE_BAKER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// Offline texture baking: source JPEG/PNG -> DDS with a full box-filtered mip chain,
+// block compressed to BC1 (opaque) or BC3 (has alpha). The loader uploads the levels
+// as-is, so startup skips both the JPEG decode and glGenerateMipmap.
+//
+// BC7 is not produced: a usable BC7 encoder is a mode/partition search far bigger than
+// everything else here, and BC1/BC3 already give the 4-8x memory cut. Drivers without
+// S3TC get the blocks decoded to RGBA8 on load.
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#define BAKED_TEXTURE_EXT ".dds"
+
+enum BakedFormat {
+    BAKED_RGBA8,
+    BAKED_BC1,
+    BAKED_BC3
+};
+
+// --------- DDS container ---------
+#define DDS_MAGIC       0x20534444u // "DDS "
+#define DDSD_CAPS        0x1u
+#define DDSD_HEIGHT      0x2u
+#define DDSD_WIDTH       0x4u
+#define DDSD_PITCH       0x8u
+#define DDSD_PIXELFORMAT 0x1000u
+#define DDSD_MIPMAPCOUNT 0x20000u
+#define DDSD_LINEARSIZE  0x80000u
+#define DDPF_ALPHAPIXELS 0x1u
+#define DDPF_FOURCC      0x4u
+#define DDPF_RGB         0x40u
+#define DDSCAPS_COMPLEX  0x8u
+#define DDSCAPS_TEXTURE  0x1000u
+#define DDSCAPS_MIPMAP   0x400000u
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+struct DdsPixelFormat {
+    uint32_t size, flags, fourCC, rgbBitCount, rMask, gMask, bMask, aMask;
+};
+
+struct DdsHeader {
+    uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+    uint32_t reserved1[11];
+    DdsPixelFormat ddspf;
+    uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+struct BakedLevel {
+    int width, height;
+    std::vector<uint8_t> data;
+};
+
+inline size_t bakedLevelSize(BakedFormat format, int w, int h)
+{
+    if (format == BAKED_RGBA8) return (size_t)w * h * 4;
+    size_t blocks = (size_t)((w + 3) / 4) * ((h + 3) / 4);
+    return blocks * (format == BAKED_BC1 ? 8 : 16);
+}
+
+// --------- Mip chain ---------
+inline void flipRowsRGBA8(std::vector<uint8_t>& pixels, int w, int h)
+{
+    size_t row = (size_t)w * 4;
+    std::vector<uint8_t> tmp(row);
+    for (int y = 0; y < h / 2; ++y) {
+        uint8_t* a = &pixels[(size_t)y * row];
+        uint8_t* b = &pixels[(size_t)(h - 1 - y) * row];
+        memcpy(tmp.data(), a, row);
+        memcpy(a, b, row);
+        memcpy(b, tmp.data(), row);
+    }
+}
+
+// 2x2 box filter, odd edges clamp.
+inline std::vector<uint8_t> downsampleRGBA8(const std::vector<uint8_t>& src, int w, int h, int& outW, int& outH)
+{
+    outW = std::max(1, w / 2);
+    outH = std::max(1, h / 2);
+    std::vector<uint8_t> dst((size_t)outW * outH * 4);
+    for (int y = 0; y < outH; ++y)
+        for (int x = 0; x < outW; ++x) {
+            int x0 = std::min(x * 2, w - 1), x1 = std::min(x * 2 + 1, w - 1);
+            int y0 = std::min(y * 2, h - 1), y1 = std::min(y * 2 + 1, h - 1);
+            for (int c = 0; c < 4; ++c) {
+                int sum = src[((size_t)y0 * w + x0) * 4 + c] + src[((size_t)y0 * w + x1) * 4 + c]
+                        + src[((size_t)y1 * w + x0) * 4 + c] + src[((size_t)y1 * w + x1) * 4 + c];
+                dst[((size_t)y * outW + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+            }
+        }
+    return dst;
+}
+
+// --------- BC1/BC3 encode ---------
+inline uint16_t packRGB565(const glm::vec3& c)
+{
+    int r = (int)(glm::clamp(c.x, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(glm::clamp(c.y, 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(glm::clamp(c.z, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline glm::vec3 unpackRGB565(uint16_t c)
+{
+    return glm::vec3((float)((c >> 11) & 31) * 255.0f / 31.0f,
+                     (float)((c >> 5) & 63) * 255.0f / 63.0f,
+                     (float)(c & 31) * 255.0f / 31.0f);
+}
+
+// Endpoints along the principal axis of the block colours (a few power iterations),
+// inset slightly, then every texel snaps to the closest of the 4 palette entries.
+inline void encodeBC1Block(const uint8_t block[16 * 4], uint8_t out[8])
+{
+    glm::vec3 px[16];
+    glm::vec3 mean(0.0f);
+    for (int i = 0; i < 16; ++i) {
+        px[i] = glm::vec3(block[i * 4 + 0], block[i * 4 + 1], block[i * 4 + 2]);
+        mean += px[i];
+    }
+    mean = mean / 16.0f;
+
+    float cov[6] = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        glm::vec3 d = px[i] - mean;
+        cov[0] += d.x * d.x; cov[1] += d.x * d.y; cov[2] += d.x * d.z;
+        cov[3] += d.y * d.y; cov[4] += d.y * d.z; cov[5] += d.z * d.z;
+    }
+    glm::vec3 axis(1.0f, 1.0f, 1.0f);
+    for (int it = 0; it < 4; ++it) {
+        glm::vec3 n(cov[0] * axis.x + cov[1] * axis.y + cov[2] * axis.z,
+                    cov[1] * axis.x + cov[3] * axis.y + cov[4] * axis.z,
+                    cov[2] * axis.x + cov[4] * axis.y + cov[5] * axis.z);
+        float len = glm::length(n);
+        if (len < 1e-6f) break;
+        axis = n / len;
+    }
+
+    float tMin = FLT_MAX, tMax = -FLT_MAX;
+    for (int i = 0; i < 16; ++i) {
+        float t = glm::dot(px[i] - mean, axis);
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    float inset = (tMax - tMin) / 32.0f;
+    glm::vec3 c0 = mean + axis * (tMax - inset);
+    glm::vec3 c1 = mean + axis * (tMin + inset);
+
+    uint16_t e0 = packRGB565(c0), e1 = packRGB565(c1);
+    if (e0 < e1) std::swap(e0, e1);   // e0 > e1 selects 4-colour mode
+    glm::vec3 palette[4];
+    palette[0] = unpackRGB565(e0);
+    palette[1] = unpackRGB565(e1);
+    palette[2] = (palette[0] * 2.0f + palette[1]) / 3.0f;
+    palette[3] = (palette[0] + palette[1] * 2.0f) / 3.0f;
+
+    uint32_t bits = 0;
+    if (e0 != e1) {
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            float bestD = FLT_MAX;
+            for (int p = 0; p < 4; ++p) {
+                glm::vec3 d = px[i] - palette[p];
+                float dist = glm::dot(d, d);
+                if (dist < bestD) { bestD = dist; best = p; }
+            }
+            bits |= (uint32_t)best << (i * 2);
+        }
+    }
+    out[0] = (uint8_t)(e0 & 0xff); out[1] = (uint8_t)(e0 >> 8);
+    out[2] = (uint8_t)(e1 & 0xff); out[3] = (uint8_t)(e1 >> 8);
+    memcpy(out + 4, &bits, 4);
+}
+
+// 8-value interpolated alpha (a0 > a1 mode), endpoints = block min/max.
+inline void encodeBC3AlphaBlock(const uint8_t block[16 * 4], uint8_t out[8])
+{
+    int aMin = 255, aMax = 0;
+    for (int i = 0; i < 16; ++i) {
+        aMin = std::min(aMin, (int)block[i * 4 + 3]);
+        aMax = std::max(aMax, (int)block[i * 4 + 3]);
+    }
+    out[0] = (uint8_t)aMax;
+    out[1] = (uint8_t)aMin;
+    uint64_t bits = 0;
+    if (aMax != aMin) {
+        int palette[8];
+        palette[0] = aMax;
+        palette[1] = aMin;
+        for (int i = 1; i < 7; ++i) palette[i + 1] = ((7 - i) * aMax + i * aMin) / 7;
+        for (int i = 0; i < 16; ++i) {
+            int a = block[i * 4 + 3], best = 0, bestD = 256;
+            for (int p = 0; p < 8; ++p) {
+                int d = std::abs(a - palette[p]);
+                if (d < bestD) { bestD = d; best = p; }
+            }
+            bits |= (uint64_t)best << (i * 3);
+        }
+    }
+    for (int i = 0; i < 6; ++i) out[2 + i] = (uint8_t)(bits >> (i * 8));
+}
+
+inline std::vector<uint8_t> encodeBlocks(const std::vector<uint8_t>& rgba, int w, int h, BakedFormat format)
+{
+    std::vector<uint8_t> out(bakedLevelSize(format, w, h));
+    uint8_t* dst = out.data();
+    uint8_t block[16 * 4];
+    for (int by = 0; by < h; by += 4)
+        for (int bx = 0; bx < w; bx += 4) {
+            for (int y = 0; y < 4; ++y)
+                for (int x = 0; x < 4; ++x) {
+                    int sx = std::min(bx + x, w - 1), sy = std::min(by + y, h - 1);
+                    memcpy(block + (y * 4 + x) * 4, &rgba[((size_t)sy * w + sx) * 4], 4);
+                }
+            if (format == BAKED_BC3) {
+                encodeBC3AlphaBlock(block, dst);
+                dst += 8;
+            }
+            encodeBC1Block(block, dst);
+            dst += 8;
+        }
+    return out;
+}
+
+// Full chain down to 1x1 from an RGBA8 base level, each level encoded as `format`.
+inline std::vector<BakedLevel> buildMipChain(std::vector<uint8_t> level, int w, int h, BakedFormat format)
+{
+    std::vector<BakedLevel> levels;
+    while (true) {
+        BakedLevel out;
+        out.width = w;
+        out.height = h;
+        out.data = format == BAKED_RGBA8 ? level : encodeBlocks(level, w, h, format);
+        levels.push_back(std::move(out));
+        if (w == 1 && h == 1) break;
+        level = downsampleRGBA8(level, w, h, w, h);
+    }
+    return levels;
+}
+
+// --------- BC1/BC3 decode (RGBA8 fallback for drivers without S3TC) ---------
+inline std::vector<uint8_t> decodeBlocks(const uint8_t* src, int w, int h, BakedFormat format)
+{
+    std::vector<uint8_t> out((size_t)w * h * 4);
+    for (int by = 0; by < h; by += 4)
+        for (int bx = 0; bx < w; bx += 4) {
+            int alpha[16];
+            for (int i = 0; i < 16; ++i) alpha[i] = 255;
+            if (format == BAKED_BC3) {
+                int a0 = src[0], a1 = src[1];
+                int palette[8] = { a0, a1 };
+                if (a0 > a1) for (int i = 1; i < 7; ++i) palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+                else {
+                    for (int i = 1; i < 5; ++i) palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+                    palette[6] = 0;
+                    palette[7] = 255;
+                }
+                uint64_t bits = 0;
+                for (int i = 0; i < 6; ++i) bits |= (uint64_t)src[2 + i] << (i * 8);
+                for (int i = 0; i < 16; ++i) alpha[i] = palette[(bits >> (i * 3)) & 7];
+                src += 8;
+            }
+            uint16_t e0 = (uint16_t)(src[0] | (src[1] << 8));
+            uint16_t e1 = (uint16_t)(src[2] | (src[3] << 8));
+            uint32_t bits;
+            memcpy(&bits, src + 4, 4);
+            src += 8;
+            glm::vec3 palette[4];
+            palette[0] = unpackRGB565(e0);
+            palette[1] = unpackRGB565(e1);
+            bool transparent3 = false;
+            if (e0 > e1 || format == BAKED_BC3) {
+                palette[2] = (palette[0] * 2.0f + palette[1]) / 3.0f;
+                palette[3] = (palette[0] + palette[1] * 2.0f) / 3.0f;
+            } else {
+                palette[2] = (palette[0] + palette[1]) * 0.5f;
+                palette[3] = glm::vec3(0.0f);
+                transparent3 = true;
+            }
+            for (int y = 0; y < 4; ++y)
+                for (int x = 0; x < 4; ++x) {
+                    int px = bx + x, py = by + y;
+                    if (px >= w || py >= h) continue;
+                    int i = y * 4 + x, idx = (bits >> (i * 2)) & 3;
+                    uint8_t* d = &out[((size_t)py * w + px) * 4];
+                    d[0] = (uint8_t)(palette[idx].x + 0.5f);
+                    d[1] = (uint8_t)(palette[idx].y + 0.5f);
+                    d[2] = (uint8_t)(palette[idx].z + 0.5f);
+                    d[3] = (uint8_t)(transparent3 && idx == 3 ? 0 : alpha[i]);
+                }
+        }
+    return out;
+}
+
+// Builds the mip chain of `level` (RGBA8, rows in the order they will be uploaded)
+// and writes it to `dstPath`: BC1, BC3 when some texel is not opaque, RGBA8 unless
+// `compress`. Also used for images rendered at bake time (impostors.h).
+inline bool writeBakedImage(const std::string& dstPath, const std::vector<uint8_t>& level, int width, int height,
+                            bool compress)
+{
+    bool hasAlpha = false;
+    for (size_t i = 3; i < level.size() && !hasAlpha; i += 4) hasAlpha = level[i] != 255;
+    BakedFormat format = !compress ? BAKED_RGBA8 : (hasAlpha ? BAKED_BC3 : BAKED_BC1);
+
+    std::vector<BakedLevel> levels = buildMipChain(level, width, height, format);
+
+    DdsHeader header;
+    memset(&header, 0, sizeof(header));
+    header.size = sizeof(DdsHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT
+                 | (format == BAKED_RGBA8 ? DDSD_PITCH : DDSD_LINEARSIZE);
+    header.width = (uint32_t)width;
+    header.height = (uint32_t)height;
+    header.pitchOrLinearSize = format == BAKED_RGBA8 ? (uint32_t)width * 4 : (uint32_t)levels[0].data.size();
+    header.mipMapCount = (uint32_t)levels.size();
+    header.ddspf.size = sizeof(DdsPixelFormat);
+    if (format == BAKED_RGBA8) {
+        header.ddspf.flags = DDPF_RGB | DDPF_ALPHAPIXELS;
+        header.ddspf.rgbBitCount = 32;
+        header.ddspf.rMask = 0x000000ffu;
+        header.ddspf.gMask = 0x0000ff00u;
+        header.ddspf.bMask = 0x00ff0000u;
+        header.ddspf.aMask = 0xff000000u;
+    } else {
+        header.ddspf.flags = DDPF_FOURCC;
+        header.ddspf.fourCC = format == BAKED_BC1 ? DDS_FOURCC('D', 'X', 'T', '1') : DDS_FOURCC('D', 'X', 'T', '5');
+    }
+    header.caps = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+    std::ofstream file(dstPath, std::ios::binary);
+    if (!file) {
+        std::cout << "Bake: failed to write " << dstPath << std::endl;
+        return false;
+    }
+    uint32_t magic = DDS_MAGIC;
+    file.write((const char*)&magic, 4);
+    file.write((const char*)&header, sizeof(header));
+    size_t bytes = 0;
+    for (const auto& l : levels) {
+        file.write((const char*)l.data.data(), (std::streamsize)l.data.size());
+        bytes += l.data.size();
+    }
+
+    size_t rgbaBytes = (size_t)width * height * 4 * 4 / 3; // RGBA8 + glGenerateMipmap chain
+    std::cout << "Baked " << dstPath << ": " << width << "x" << height << " "
+              << (format == BAKED_BC1 ? "BC1" : format == BAKED_BC3 ? "BC3" : "RGBA8") << ", "
+              << levels.size() << " mips, " << bytes / 1024 << " KB (RGBA8 " << rgbaBytes / 1024 << " KB)" << std::endl;
+    return true;
+}
+
+// --------- Bake ---------
+// Decode `srcPath`, build the mip chain and write `srcPath + ".dds"`. `flipY` must match
+// how the runtime would have loaded the image (the floor textures flip, model textures don't).
+inline bool bakeTexture(const std::string& srcPath, bool flipY, bool compress = true)
+{
+    // stb's flip flag is global and may be read by streaming workers, flip by hand instead
+    int width, height, nrChannels;
+    unsigned char* pixels = stbi_load(srcPath.c_str(), &width, &height, &nrChannels, 4);
+    if (!pixels) {
+        std::cout << "Bake: failed to load " << srcPath << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> level(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+    if (flipY) flipRowsRGBA8(level, width, height);
+
+    return writeBakedImage(srcPath + BAKED_TEXTURE_EXT, level, width, height, compress);
+}
+
+// True when the source was edited after its bake (like scene.h's .scene.bin check).
+// Impostor atlases have no source and are never stale.
+inline bool bakedTextureStale(const std::string& srcPath)
+{
+    struct stat srcStat, bakedStat;
+    return stat(srcPath.c_str(), &srcStat) == 0 && stat((srcPath + BAKED_TEXTURE_EXT).c_str(), &bakedStat) == 0
+        && bakedStat.st_mtime < srcStat.st_mtime;
+}
+
+// --------- Load ---------
+inline bool hasCompressedFormat(GLenum format)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+    std::vector<GLint> formats(count > 0 ? count : 0);
+    if (count > 0) glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+    return std::find(formats.begin(), formats.end(), (GLint)format) != formats.end();
+}
+
+// Parsed .dds file, levels pointing into `file`.
+struct BakedImage {
+    std::vector<uint8_t> file;
+    BakedFormat format = BAKED_RGBA8;
+    int width = 0, height = 0;
+    std::vector<const uint8_t*> levels;
+};
+
+inline bool readFileBytes(const std::string& path, std::vector<uint8_t>& out)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    std::streamsize size = file.tellg();
+    out.resize((size_t)size);
+    file.seekg(0);
+    file.read((char*)out.data(), size);
+    return (bool)file;
+}
+
+// Parses the .dds already read into `out.file`.
+inline bool parseBakedImage(BakedImage& out)
+{
+    if (out.file.size() < 4 + sizeof(DdsHeader)) return false;
+    uint32_t magic;
+    DdsHeader header;
+    memcpy(&magic, out.file.data(), 4);
+    memcpy(&header, out.file.data() + 4, sizeof(header));
+    if (magic != DDS_MAGIC || header.size != sizeof(DdsHeader)) return false;
+
+    if (header.ddspf.flags & DDPF_FOURCC) {
+        if (header.ddspf.fourCC == DDS_FOURCC('D', 'X', 'T', '1')) out.format = BAKED_BC1;
+        else if (header.ddspf.fourCC == DDS_FOURCC('D', 'X', 'T', '5')) out.format = BAKED_BC3;
+        else return false;
+    } else if (header.ddspf.rgbBitCount == 32 && header.ddspf.rMask == 0x000000ffu) {
+        out.format = BAKED_RGBA8;
+    } else {
+        return false;
+    }
+
+    out.width = (int)header.width;
+    out.height = (int)header.height;
+    int mips = header.mipMapCount > 0 ? (int)header.mipMapCount : 1;
+    size_t offset = 4 + sizeof(DdsHeader);
+    int w = out.width, h = out.height;
+    out.levels.clear();
+    for (int i = 0; i < mips; ++i) {
+        size_t levelSize = bakedLevelSize(out.format, w, h);
+        if (offset + levelSize > out.file.size()) return false;
+        out.levels.push_back(out.file.data() + offset);
+        offset += levelSize;
+        w = std::max(1, w / 2);
+        h = std::max(1, h / 2);
+    }
+    return true;
+}
+
+inline bool readBakedImage(const std::string& path, BakedImage& out)
+{
+    return readFileBytes(path, out.file) && parseBakedImage(out);
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef TRANSPARENCY_H
+#define TRANSPARENCY_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/shader_m.h>
+
+#include "gl_state.h"
+#include "render_queue.h"
+
+#include <iostream>
+
+// --------- Weighted blended transparency ---------
+// Transparent materials (car glass) are not sorted: every transparent fragment adds its
+// premultiplied color, scaled by a weight that falls off with view depth, into an
+// RGBA16F target whose alpha multiplies down the revealage (how much of the opaque
+// frame still shows), and adds alpha * weight into a second R16F target. GL 3.3 has
+// one blend function for all draw buffers, so both targets share (ONE, ONE) for color
+// and (ZERO, ONE_MINUS_SRC_ALPHA) for alpha; see RenderQueue::executeTransparent.
+// resolve() then lays color / weight over the frame with 1 - revealage coverage.
+// The accumulation targets get a copy of the frame's depth so opaque geometry still
+// hides what is behind it.
+#define OIT_ACCUM_UNIT 0  // texture units of oit_resolve.fs's samplers
+#define OIT_WEIGHT_UNIT 1
+
+class WeightedBlendedOIT {
+public:
+    WeightedBlendedOIT() {}
+    ~WeightedBlendedOIT() { release(); }
+
+    WeightedBlendedOIT(const WeightedBlendedOIT&) = delete;
+    WeightedBlendedOIT& operator=(const WeightedBlendedOIT&) = delete;
+
+    // Frees the targets; must run while the context is current.
+    void release()
+    {
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        if (accum) glDeleteTextures(1, &accum);
+        if (weights) glDeleteTextures(1, &weights);
+        if (depth) glDeleteRenderbuffers(1, &depth);
+        if (vao) glDeleteVertexArrays(1, &vao);
+        fbo = accum = weights = depth = vao = 0;
+        width = height = 0;
+    }
+
+    // Binds and clears the accumulation targets, sized like `target` (the framebuffer
+    // the opaque pass drew into, width x height) and holding a copy of its depth.
+    // False when they can't be made; the transparent packets are skipped then.
+    bool begin(unsigned int target, int width, int height)
+    {
+        this->target = target;
+        if (width != this->width || height != this->height) create(width, height);
+        if (!fbo) return false;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        static const float accumClear[4] = { 0.0f, 0.0f, 0.0f, 1.0f }; // alpha = revealage
+        static const float weightClear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, accumClear);
+        glClearBufferfv(GL_COLOR, 1, weightClear);
+        return true;
+    }
+
+    // Composites what was accumulated over `target` with `shader` (oit_resolve.vs/fs)
+    // and leaves the opaque pass state (depth test and writes on, no blending) behind.
+    void resolve(Shader& shader)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glState().enable(GL_DEPTH_TEST, false);
+        glState().depthMask(false);
+        glState().enable(GL_BLEND, true);
+        glState().blendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+        glState().useProgram(shader.ID);
+        glState().bindTexture(OIT_ACCUM_UNIT, GL_TEXTURE_2D, accum);
+        glState().bindTexture(OIT_WEIGHT_UNIT, GL_TEXTURE_2D, weights);
+        glState().bindVertexArray(vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3); // one triangle over the screen, from gl_VertexID
+        glState().enable(GL_BLEND, false);
+        glState().enable(GL_DEPTH_TEST, true);
+        glState().depthMask(true);
+    }
+
+private:
+    unsigned int fbo = 0, accum = 0, weights = 0, depth = 0, vao = 0;
+    unsigned int target = 0;
+    int width = 0, height = 0;
+
+    static unsigned int makeTarget(GLenum format, int width, int height)
+    {
+        unsigned int id;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        return id;
+    }
+
+    void create(int width, int height)
+    {
+        release();
+        this->width = width;
+        this->height = height;
+        accum = makeTarget(GL_RGBA16F, width, height);
+        weights = makeTarget(GL_R16F, width, height);
+        // the depth blit needs the target's format: the window's is usually packed with stencil
+        GLint stencilBits = 0;
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, target ? GL_DEPTH_ATTACHMENT : GL_DEPTH,
+                                              GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, stencilBits ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24, width, height);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accum, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weights, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, stencilBits ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+                                  GL_RENDERBUFFER, depth);
+        const GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, buffers);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glState().invalidate(); // texture and renderbuffer binds above went around the cache
+        glGenVertexArrays(1, &vao);
+        if (!complete) {
+            std::cout << "Transparency: Failed to create the accumulation targets" << std::endl;
+            release();
+            this->width = width; // don't retry every frame
+            this->height = height;
+        }
+    }
+};
+
+#endif
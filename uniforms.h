@@ -0,0 +1,154 @@
+#ifndef UNIFORMS_H
+#define UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <learnopengl/shader_m.h>
+
+#include "gl_state.h"
+#include "ring_buffer.h"
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+// --------- Uniform locations ---------
+// learnopengl's Shader::set*() asks GL for the location by name on every call. The
+// render loop instead reads all locations once when a program is linked and keeps them
+// per program: the uniforms it sets per draw get fixed slots, every other active
+// uniform is in `byName` for code outside the hot path.
+enum UniformSlot {
+    UNIFORM_MODEL,
+    UNIFORM_INSTANCED,
+    UNIFORM_DIFFUSE_LAYER,
+    UNIFORM_POS_OFFSET,
+    UNIFORM_POS_SCALE,
+    UNIFORM_OCT_NORMALS,
+    UNIFORM_OPACITY,
+    UNIFORM_TRANSPARENT_PASS,
+    UNIFORM_LIGHT_SPACE,  // shadow_depth.vs, per cascade
+    UNIFORM_UV_SCALE,     // upscale.fs, per frame
+    UNIFORM_UV_MAX,
+    UNIFORM_SLOT_COUNT
+};
+
+// Mesh::Draw sampler names: texture_diffuse1.., texture_specular1.., texture_normal1..,
+// texture_height1..
+#define UNIFORM_SAMPLER_TYPES 4
+#define UNIFORM_SAMPLERS_PER_TYPE 4
+
+struct ProgramUniforms {
+    GLint slots[UNIFORM_SLOT_COUNT];
+    GLint samplers[UNIFORM_SAMPLER_TYPES][UNIFORM_SAMPLERS_PER_TYPE];
+    std::unordered_map<std::string, GLint> byName;
+
+    GLint operator[](UniformSlot slot) const { return slots[slot]; }
+
+    GLint location(const std::string& name) const
+    {
+        auto it = byName.find(name);
+        return it == byName.end() ? -1 : it->second;
+    }
+};
+
+// --------- Per-frame uniform block ---------
+// Camera data every program reads, written once per frame into the stream ring and
+// bound at FRAME_UNIFORM_BINDING. Mirrors the std140 `Frame` block of the shaders:
+// mat4s and vec4s only, so the C++ layout is the std140 one. The `Lights` and `Shadows`
+// blocks of the lit shaders (clustered_lights.h, shadows.h) are bound the same way.
+#define FRAME_UNIFORM_BINDING 0
+#define LIGHT_UNIFORM_BINDING 1
+#define SHADOW_UNIFORM_BINDING 2
+
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 viewProjection;
+    glm::vec4 eye; // w unused
+};
+static_assert(sizeof(FrameData) == 208, "FrameData must match the std140 Frame block");
+
+inline std::unordered_map<unsigned int, ProgramUniforms>& programUniformTable()
+{
+    static std::unordered_map<unsigned int, ProgramUniforms> table; // by program ID
+    return table;
+}
+
+// Reads the locations of `shader`'s program and points its uniform blocks at their
+// bindings. Called right after the program is linked.
+inline const ProgramUniforms& linkUniforms(const Shader& shader)
+{
+    static const char* const slotNames[UNIFORM_SLOT_COUNT] = {
+        "model", "instanced", "diffuseLayer", "posOffset", "posScale", "octNormals", "opacity", "transparentPass",
+        "lightSpace", "uvScale", "uvMax"
+    };
+    static const char* const samplerTypes[UNIFORM_SAMPLER_TYPES] = {
+        "texture_diffuse", "texture_specular", "texture_normal", "texture_height"
+    };
+
+    ProgramUniforms& u = programUniformTable()[shader.ID];
+    u.byName.clear();
+    GLint count = 0;
+    glGetProgramiv(shader.ID, GL_ACTIVE_UNIFORMS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        char name[256];
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(shader.ID, (GLuint)i, sizeof(name), &length, &size, &type, name);
+        GLint location = glGetUniformLocation(shader.ID, name);
+        if (location >= 0) u.byName[std::string(name, length)] = location; // block members have none
+    }
+    for (int s = 0; s < UNIFORM_SLOT_COUNT; ++s)
+        u.slots[s] = u.location(slotNames[s]);
+    for (int t = 0; t < UNIFORM_SAMPLER_TYPES; ++t)
+        for (int n = 0; n < UNIFORM_SAMPLERS_PER_TYPE; ++n)
+            u.samplers[t][n] = u.location(samplerTypes[t] + std::to_string(n + 1));
+
+    GLuint block = glGetUniformBlockIndex(shader.ID, "Frame");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(shader.ID, block, FRAME_UNIFORM_BINDING);
+    block = glGetUniformBlockIndex(shader.ID, "Lights");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(shader.ID, block, LIGHT_UNIFORM_BINDING);
+    block = glGetUniformBlockIndex(shader.ID, "Shadows");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(shader.ID, block, SHADOW_UNIFORM_BINDING);
+    return u;
+}
+
+// Cached locations of `shader`; programs nobody linked through linkUniforms are read now.
+inline const ProgramUniforms& uniformsOf(const Shader& shader)
+{
+    auto it = programUniformTable().find(shader.ID);
+    return it != programUniformTable().end() ? it->second : linkUniforms(shader);
+}
+
+// Program IDs are reused after glDeleteProgram, so deleting one drops its entry.
+inline void forgetUniforms(unsigned int program)
+{
+    programUniformTable().erase(program);
+}
+
+// Setters on the current program; a location of -1 is ignored by GL, like a missing name.
+inline void setUniform(GLint location, bool value) { glUniform1i(location, (int)value); }
+inline void setUniform(GLint location, int value) { glUniform1i(location, value); }
+inline void setUniform(GLint location, float value) { glUniform1f(location, value); }
+inline void setUniform(GLint location, const glm::vec2& value) { glUniform2f(location, value.x, value.y); }
+inline void setUniform(GLint location, const glm::vec3& value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
+inline void setUniform(GLint location, const glm::mat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+
+// Writes this frame's camera into `ring` and binds the block; once per frame, before drawing.
+inline void updateFrameUniforms(StreamRing& ring, const glm::mat4& projection, const glm::mat4& view, const glm::vec3& eye)
+{
+    FrameData data;
+    data.projection = projection;
+    data.view = view;
+    data.viewProjection = projection * view;
+    data.eye = glm::vec4(eye, 1.0f);
+    RingAllocation slice = ring.allocate(sizeof(FrameData), ring.uniformAlignment());
+    memcpy(slice.data, &data, sizeof(FrameData));
+    ring.flush();
+    glState().bindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, slice.buffer, slice.offset, sizeof(FrameData));
+}
+
+#endif
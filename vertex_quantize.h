@@ -0,0 +1,155 @@
+#ifndef VERTEX_QUANTIZE_H
+#define VERTEX_QUANTIZE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader_m.h>
+
+#include "uniforms.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// --------- Compact vertex format ---------
+// 16 bytes instead of sizeof(Vertex) (88):
+//   position  4 x uint16, normalized, relative to the mesh's bounding box (w unused)
+//   normal    2 x int16,  normalized, octahedral encoding
+//   uv        2 x half
+// Tangents and bone weights are dropped; nothing in 1.model_loading.vs reads them.
+// 1.model_loading.vs undoes the position mapping with posOffset + aPos * posScale and
+// unfolds the normal when octNormals is set; a default VertexDecode describes a float
+// mesh, so both formats go through the same shader.
+struct CompactVertex {
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t texCoords[2];
+};
+
+struct VertexDecode {
+    glm::vec3 offset = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    bool octahedralNormals = false;
+};
+
+struct CompactMeshData {
+    std::vector<CompactVertex> vertices;
+    VertexDecode decode;
+    float maxPositionError = 0.0f; // world units, measured after decoding
+    float maxUvError = 0.0f;
+};
+
+inline int16_t packSnorm16(float v)
+{
+    v = glm::clamp(v, -1.0f, 1.0f);
+    return (int16_t)std::lround(v * 32767.0f);
+}
+
+// Unit vector -> the octahedron |x|+|y|+|z| = 1, lower half folded over the upper.
+inline glm::vec2 octahedralEncode(glm::vec3 n)
+{
+    float len = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (len < 1e-20f) return glm::vec2(0.0f, 0.0f);
+    n /= len;
+    glm::vec2 p(n.x, n.y);
+    if (n.z < 0.0f) {
+        p = glm::vec2((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                      (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+    }
+    return p;
+}
+
+inline glm::vec3 octahedralDecode(glm::vec2 p)
+{
+    glm::vec3 n(p.x, p.y, 1.0f - std::fabs(p.x) - std::fabs(p.y));
+    float t = glm::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// CPU side, safe on worker threads.
+inline CompactMeshData quantizeVertices(const std::vector<Vertex>& vertices)
+{
+    CompactMeshData out;
+    glm::vec3 mn( FLT_MAX);
+    glm::vec3 mx(-FLT_MAX);
+    for (const auto& v : vertices) {
+        mn = glm::min(mn, v.Position);
+        mx = glm::max(mx, v.Position);
+    }
+    if (vertices.empty()) mn = mx = glm::vec3(0.0f);
+    glm::vec3 extent = glm::max(mx - mn, glm::vec3(1e-6f)); // flat meshes keep a usable scale
+    out.decode.offset = mn;
+    out.decode.scale = extent;
+    out.decode.octahedralNormals = true;
+
+    out.vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const Vertex& v = vertices[i];
+        CompactVertex& c = out.vertices[i];
+        glm::vec3 unit = glm::clamp((v.Position - mn) / extent, 0.0f, 1.0f);
+        for (int k = 0; k < 3; ++k) c.position[k] = (uint16_t)std::lround(unit[k] * 65535.0f);
+        c.position[3] = 0;
+
+        glm::vec2 oct = octahedralEncode(v.Normal);
+        c.normal[0] = packSnorm16(oct.x);
+        c.normal[1] = packSnorm16(oct.y);
+        c.texCoords[0] = (uint16_t)glm::packHalf1x16(v.TexCoords.x);
+        c.texCoords[1] = (uint16_t)glm::packHalf1x16(v.TexCoords.y);
+
+        glm::vec3 decoded = mn + glm::vec3(c.position[0], c.position[1], c.position[2]) / 65535.0f * extent;
+        glm::vec2 uv(glm::unpackHalf1x16(c.texCoords[0]), glm::unpackHalf1x16(c.texCoords[1]));
+        out.maxPositionError = glm::max(out.maxPositionError, glm::length(decoded - v.Position));
+        out.maxUvError = glm::max(out.maxUvError, glm::max(std::fabs(uv.x - v.TexCoords.x), std::fabs(uv.y - v.TexCoords.y)));
+    }
+    return out;
+}
+
+// GL thread. Builds a Mesh whose VAO reads `compact` instead of float vertices. The
+// Mesh is created with a single dummy vertex so its own setup only uploads the index
+// buffer; the VAO is then re-pointed at the compact buffer. `cpuVertices` is kept on
+// the Mesh for bounds and later CPU work, exactly like a float mesh.
+inline Mesh makeCompactMesh(std::vector<Vertex> cpuVertices, const std::vector<unsigned int>& indices,
+                            const std::vector<Texture>& textures, const std::vector<CompactVertex>& compact)
+{
+    Mesh mesh(std::vector<Vertex>(1, Vertex()), indices, textures);
+
+    GLint dummy = 0;
+    glBindVertexArray(mesh.VAO);
+    glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &dummy);
+
+    unsigned int vbo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, compact.size() * sizeof(CompactVertex), compact.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoords));
+    for (GLuint attrib = 3; attrib <= 6; ++attrib) // tangent, bitangent, bones
+        glDisableVertexAttribArray(attrib);
+    glBindVertexArray(0);
+
+    GLuint old = (GLuint)dummy;
+    glDeleteBuffers(1, &old);
+    mesh.vertices = std::move(cpuVertices);
+    return mesh;
+}
+
+// On the current program, through its cached locations.
+inline void setVertexDecode(const ProgramUniforms& uniforms, const VertexDecode& decode)
+{
+    setUniform(uniforms[UNIFORM_POS_OFFSET], decode.offset);
+    setUniform(uniforms[UNIFORM_POS_SCALE], decode.scale);
+    setUniform(uniforms[UNIFORM_OCT_NORMALS], decode.octahedralNormals);
+}
+
+#endif